@@ -18,6 +18,8 @@ uniform float lodFactor = 14.0f;
 
 mat4 modelViewProjectionMatrix = viewProjectionMatrix * modelMatrix;
 
+in vec3 grid_position[];
+
 in vec3 varying_position[];
 in vec3 varying_normal[];
 in vec2 varying_texcoords[];
@@ -31,6 +33,8 @@ in vec3 reflected_vector[];
 
 in vec4 projected_texcoords[];
 
+out vec3 grid_position_tc[];
+
 out vec3 varying_position_tc[];
 out vec3 varying_normal_tc[];
 out vec2 varying_texcoords_tc[];
@@ -81,6 +85,8 @@ void main()
 {
 		#define ID gl_InvocationID
 		gl_out[ID].gl_Position = gl_in[ID].gl_Position;
+
+		grid_position_tc[ID] = grid_position[ID];
 	  
 	   varying_position_tc[ID] = varying_position[ID];
 		varying_normal_tc[ID] = varying_normal[ID];
@@ -13,7 +13,42 @@ uniform float time;
 uniform vec2 windDir;
  
 mat4 modelViewProjectionMatrix = viewProjectionMatrix * modelMatrix;
- 
+
+// Displacement maps of the ocean cascades, tiled with wrap addressing. Bound by OceanComponent::BindDisplacementMaps.
+const int k_MaxOceanCascades = 4;
+uniform bool useDisplacementMaps;
+uniform int oceanCascadeCount;
+uniform vec4 oceanCascadeMapping[k_MaxOceanCascades]; // Texture coordinates per unit of the undisplaced grid (xy) and their offset (zw).
+uniform float oceanCascadeBlend[k_MaxOceanCascades]; // From the previous simulation (0) to the current one (1).
+layout (binding = 6) uniform sampler2D oceanDisplacementMap[k_MaxOceanCascades]; // Displacement in xyz, foam in w.
+layout (binding = 10) uniform sampler2D oceanSlopeMap[k_MaxOceanCascades]; // dh/dx, dh/dz.
+layout (binding = 14) uniform sampler2D oceanPreviousDisplacementMap[k_MaxOceanCascades];
+layout (binding = 18) uniform sampler2D oceanPreviousSlopeMap[k_MaxOceanCascades];
+
+// Sum of the cascades at a point of the undisplaced grid.
+void SampleOcean(vec3 grid_position, out vec3 displacement, out vec3 normal, out float foam)
+{
+	displacement = vec3(0.0f);
+	vec2 slope = vec2(0.0f);
+	foam = 0.0f;
+
+	for(int c = 0; c < oceanCascadeCount; ++c)
+	{
+		vec2 uv = grid_position.xz * oceanCascadeMapping[c].xy + oceanCascadeMapping[c].zw;
+		float blend = oceanCascadeBlend[c];
+		vec4 texel = mix(textureLod(oceanPreviousDisplacementMap[c], uv, 0.0f), textureLod(oceanDisplacementMap[c], uv, 0.0f), blend);
+		displacement += texel.xyz;
+		foam += texel.w;
+		slope += mix(textureLod(oceanPreviousSlopeMap[c], uv, 0.0f).xy, textureLod(oceanSlopeMap[c], uv, 0.0f).xy, blend);
+	}
+
+	// The normal of the height field y = h(x, z) is (-dh/dx, 1, -dh/dz).
+	normal = normalize(vec3(-slope.x, 1.0f, -slope.y));
+	foam = min(foam, 1.0f);
+}
+
+in vec3 grid_position_tc[];
+
 in vec3 varying_position_tc[];
 in vec3 varying_normal_tc[];
 in vec2 varying_texcoords_tc[];
@@ -66,5 +101,25 @@ vec2 Interpolate2D(vec2 v0, vec2 v1, vec2 v2)
 		vec3 p2 = gl_in[2].gl_Position.xyz;
 		
 		vec3 tePosition = Interpolate3D(p0, p1, p2);
+
+		// Sample the maps again at the tessellated vertices, which adds the detail between the vertices of the grid.
+		if(useDisplacementMaps)
+		{
+			vec3 grid_position = Interpolate3D(grid_position_tc[0], grid_position_tc[1], grid_position_tc[2]);
+
+			vec3 displacement;
+			vec3 normal;
+			float foam;
+			SampleOcean(grid_position, displacement, normal, foam);
+			tePosition = grid_position + displacement;
+
+			varying_position_te = vec3(modelMatrix * vec4(tePosition, 1.0f));
+			varying_normal_te = vec3(modelMatrix * vec4(normal, 0.0f));
+			varying_foam_te = foam;
+
+			view_space_position_te = vec3(viewMatrix * vec4(varying_position_te, 1.0f));
+			view_space_normal_te = vec3(viewMatrix * vec4(varying_normal_te, 0.0f));
+		}
+
 		gl_Position = modelViewProjectionMatrix * vec4(tePosition, 1);
  }
\ No newline at end of file
@@ -2,11 +2,8 @@
 
 layout (location = 0) in vec3 vertex_position;
 layout (location = 1) in vec3 vertex_normal;
-layout (location = 3) in vec2 texcoords;
-layout (location = 4) in float foamAmount;
-/*
-layout (location = 2) in vec2 vertex_texture_coords;
-*/
+layout (location = 2) in vec2 texcoords;
+layout (location = 3) in float foamAmount;
 
 // Default uniforms. Should be in every shaders.
 uniform mat4 viewProjectionMatrix; 
@@ -20,6 +17,41 @@ uniform mat4 remappingMatrix = mat4( 	0.5f, 0.0f, 0.0f, 0.0f,
 
 uniform vec3 cameraPosition;
 
+// Displacement maps of the ocean cascades, tiled with wrap addressing. Bound by OceanComponent::BindDisplacementMaps.
+const int k_MaxOceanCascades = 4;
+uniform bool useDisplacementMaps;
+uniform int oceanCascadeCount;
+uniform vec4 oceanCascadeMapping[k_MaxOceanCascades]; // Texture coordinates per unit of the undisplaced grid (xy) and their offset (zw).
+uniform float oceanCascadeBlend[k_MaxOceanCascades]; // From the previous simulation (0) to the current one (1).
+layout (binding = 6) uniform sampler2D oceanDisplacementMap[k_MaxOceanCascades]; // Displacement in xyz, foam in w.
+layout (binding = 10) uniform sampler2D oceanSlopeMap[k_MaxOceanCascades]; // dh/dx, dh/dz.
+layout (binding = 14) uniform sampler2D oceanPreviousDisplacementMap[k_MaxOceanCascades];
+layout (binding = 18) uniform sampler2D oceanPreviousSlopeMap[k_MaxOceanCascades];
+
+// Sum of the cascades at a point of the undisplaced grid.
+void SampleOcean(vec3 grid_position, out vec3 displacement, out vec3 normal, out float foam)
+{
+	displacement = vec3(0.0f);
+	vec2 slope = vec2(0.0f);
+	foam = 0.0f;
+
+	for(int c = 0; c < oceanCascadeCount; ++c)
+	{
+		vec2 uv = grid_position.xz * oceanCascadeMapping[c].xy + oceanCascadeMapping[c].zw;
+		float blend = oceanCascadeBlend[c];
+		vec4 texel = mix(textureLod(oceanPreviousDisplacementMap[c], uv, 0.0f), textureLod(oceanDisplacementMap[c], uv, 0.0f), blend);
+		displacement += texel.xyz;
+		foam += texel.w;
+		slope += mix(textureLod(oceanPreviousSlopeMap[c], uv, 0.0f).xy, textureLod(oceanSlopeMap[c], uv, 0.0f).xy, blend);
+	}
+
+	// The normal of the height field y = h(x, z) is (-dh/dx, 1, -dh/dz).
+	normal = normalize(vec3(-slope.x, 1.0f, -slope.y));
+	foam = min(foam, 1.0f);
+}
+
+out vec3 grid_position;
+
 out vec3 varying_position;
 out vec3 varying_normal;
 out vec2 varying_texcoords;
@@ -44,15 +76,26 @@ void main(void)
 	varying_texture_coords = vertex_texture_coords;
 	*/
 
-	varying_normal = vec3(modelMatrix * vec4(vertex_normal, 0.0));
-	varying_position = vec3(modelMatrix * vec4(vertex_position, 1.0f));
+	vec3 position = vertex_position;
+	vec3 normal = vertex_normal;
+	float foam = foamAmount;
+	if(useDisplacementMaps)
+	{
+		vec3 displacement;
+		SampleOcean(vertex_position, displacement, normal, foam);
+		position += displacement;
+	}
+	grid_position = vertex_position;
+
+	varying_normal = vec3(modelMatrix * vec4(normal, 0.0));
+	varying_position = vec3(modelMatrix * vec4(position, 1.0f));
 
 	varying_texcoords = texcoords;
 
-	varying_foam = foamAmount;
+	varying_foam = foam;
 	
-	view_space_normal = vec3(viewMatrix * modelMatrix * vec4(vertex_normal, 0.0));
-	view_space_position = vec3(viewMatrix * modelMatrix * vec4(vertex_position, 1.0f));
+	view_space_normal = vec3(viewMatrix * modelMatrix * vec4(normal, 0.0));
+	view_space_position = vec3(viewMatrix * modelMatrix * vec4(position, 1.0f));
 
 	reflected_vector = reflect(vec3(varying_position - cameraPosition), normalize(varying_normal));
 	
@@ -60,5 +103,5 @@ void main(void)
 	//disturbed_pos.xz = varying_position.xz + 0.7f * varying_normal.xz; //TODO: MOVE THIS IN FRAGMENT!!
 	projected_texcoords = remappingMatrix * viewProjectionMatrix * vec4(disturbed_pos, 1.0f);
 	
-	gl_Position = vec4(vertex_position, 1.0f);
+	gl_Position = vec4(position, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+// Offline baking of ocean sequences.
+// Simulates the cascades described by a settings file and writes every frame to a baked sequence (see OceanBake.h)
+// the demo can play back instead of simulating.
+//
+// Usage: OceanBakeTool <settings file> <output file>
+//
+// The settings file holds one "name = value" per line, # starts a comment. The names are those of OceanSettings,
+// cascade c is set through cascadeC.patchSize, cascadeC.resolution... Booleans are 0 or 1, enums their value.
+// Besides those:
+//   frames      Frames to bake. A loop bakes loopFrameCount frames of one period instead.
+//   frameStep   Seconds between frames, without a loop.
+
+#include "OceanBake.h"
+#include "OceanSimulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace acqua;
+
+namespace
+{
+	// Heights are scaled like in OceanComponent, 1 / (GRID_MULTIPLIER * SEGMENT_WIDTH).
+	const Real k_HeightScale = 1.0f / 50.0f;
+
+	struct BakeOptions
+	{
+		u32 frames;
+		Real frameStep;
+
+		BakeOptions() : frames(300), frameStep(1.0f / 30.0f) {}
+	};
+
+	template <typename T>
+	bool ParseValue(const String& text, T& value)
+	{
+		std::istringstream stream(text);
+		T parsed;
+		if(!(stream >> parsed))
+			return false;
+
+		value = parsed;
+		return true;
+	}
+
+	template <typename E>
+	bool ParseEnum(const String& text, E& value)
+	{
+		u32 parsed = 0;
+		if(!ParseValue(text, parsed))
+			return false;
+
+		value = static_cast<E>(parsed);
+		return true;
+	}
+
+	bool ParseCascadeSetting(CascadeSettings& cascade, const String& name, const String& value)
+	{
+		if(name == "patchSize")		return ParseValue(value, cascade.patchSize);
+		if(name == "resolution")	return ParseValue(value, cascade.resolution);
+		if(name == "minWavelength")	return ParseValue(value, cascade.minWavelength);
+		if(name == "maxWavelength")	return ParseValue(value, cascade.maxWavelength);
+		if(name == "updateRate")	return ParseValue(value, cascade.updateRate);
+		return false;
+	}
+
+	bool ParseSetting(OceanSettings& settings, BakeOptions& options, const String& name, const String& value)
+	{
+		if(name == "frames")			return ParseValue(value, options.frames);
+		if(name == "frameStep")			return ParseValue(value, options.frameStep);
+
+		if(name == "V")					return ParseValue(value, settings.V);
+		if(name == "l")					return ParseValue(value, settings.l);
+		if(name == "A")					return ParseValue(value, settings.A);
+		if(name == "W")					return ParseValue(value, settings.W);
+		if(name == "windAlignment")		return ParseValue(value, settings.windAlignment);
+		if(name == "seed")				return ParseValue(value, settings.seed);
+		if(name == "dampReflections")	return ParseValue(value, settings.dampReflections);
+		if(name == "depth")				return ParseValue(value, settings.depth);
+		if(name == "chopAmount")		return ParseValue(value, settings.chopAmount);
+		if(name == "pruneThreshold")	return ParseValue(value, settings.pruneThreshold);
+		if(name == "foamSlopeRatio")	return ParseValue(value, settings.foamSlopeRatio);
+		if(name == "foamFader")			return ParseValue(value, settings.foamFader);
+		if(name == "jacobianFoam")		return ParseValue(value, settings.jacobianFoam);
+		if(name == "foamJacobianLimit")	return ParseValue(value, settings.foamJacobianLimit);
+		if(name == "batchedFFT")		return ParseValue(value, settings.batchedFFT);
+		if(name == "spectralNormals")	return ParseValue(value, settings.spectralNormals);
+		if(name == "planningMode")		return ParseEnum(value, settings.planningMode);
+		if(name == "planningTimeLimit")	return ParseValue(value, settings.planningTimeLimit);
+		if(name == "threadCount")		return ParseValue(value, settings.threadCount);
+		if(name == "simdLevel")			return ParseEnum(value, settings.simdLevel);
+		if(name == "cascadeCount")		return ParseValue(value, settings.cascadeCount);
+		if(name == "loop")				return ParseValue(value, settings.loop);
+		if(name == "loopPeriod")		return ParseValue(value, settings.loopPeriod);
+		if(name == "loopFrameCount")	return ParseValue(value, settings.loopFrameCount);
+
+		// cascadeC.name
+		if(name.size() > 9 && name.compare(0, 7, "cascade") == 0 && name[8] == '.')
+		{
+			u32 c = static_cast<u32>(name[7] - '0');
+			if(c < k_MaxOceanCascades)
+				return ParseCascadeSetting(settings.cascades[c], name.substr(9), value);
+		}
+
+		return false;
+	}
+
+	String Trim(const String& text)
+	{
+		size_t begin = text.find_first_not_of(" \t\r\n");
+		if(begin == String::npos)
+			return String();
+
+		size_t end = text.find_last_not_of(" \t\r\n");
+		return text.substr(begin, end - begin + 1);
+	}
+
+	bool LoadSettings(const char* path, OceanSettings& settings, BakeOptions& options)
+	{
+		std::ifstream file(path);
+		if(!file)
+		{
+			printf("Can't open %s\n", path);
+			return false;
+		}
+
+		String line;
+		u32 line_number = 0;
+		while(std::getline(file, line))
+		{
+			++line_number;
+
+			size_t comment = line.find('#');
+			if(comment != String::npos)
+				line.erase(comment);
+
+			line = Trim(line);
+			if(line.empty())
+				continue;
+
+			size_t equals = line.find('=');
+			if(equals == String::npos || !ParseSetting(settings, options, Trim(line.substr(0, equals)), Trim(line.substr(equals + 1))))
+			{
+				printf("%s(%u): can't parse \"%s\"\n", path, line_number, line.c_str());
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 3)
+	{
+		printf("Usage: OceanBakeTool <settings file> <output file>\n");
+		return 1;
+	}
+
+	OceanSettings settings;
+	BakeOptions options;
+	if(!LoadSettings(argv[1], settings, options))
+		return 1;
+
+	// A loop is one period, baked after a first period that lets the foam settle, like the demo does.
+	u32 frame_count = settings.loop ? std::max(settings.loopFrameCount, 2u) : std::max(options.frames, 1u);
+	Real step = settings.loop ? settings.loopPeriod / frame_count : options.frameStep;
+	u32 warm_up_frames = settings.loop ? frame_count : 0;
+
+	if(step <= 0.0f)
+	{
+		printf("The frame step must be positive.\n");
+		return 1;
+	}
+
+	OceanSimulation simulation;
+	simulation.Reset(settings);
+	u32 cascade_count = simulation.GetCascadeCount();
+
+	OceanBakeHeader header;
+	header.cascadeCount = cascade_count;
+	header.frameStep = step;
+	header.period = settings.loop ? settings.loopPeriod : 0.0f;
+	header.settingsHash = HashOceanSettings(settings);
+
+	std::vector<OceanTexel> displacement[k_MaxOceanCascades];
+	std::vector<OceanTexel> slope[k_MaxOceanCascades];
+	const OceanTexel* displacement_texels[k_MaxOceanCascades];
+	const OceanTexel* slope_texels[k_MaxOceanCascades];
+
+	for(u32 c = 0; c < cascade_count; ++c)
+	{
+		const OceanCascade& cascade = simulation.GetCascade(c);
+		header.M[c] = cascade.GetM();
+		header.N[c] = cascade.GetN();
+		header.LX[c] = header.LZ[c] = cascade.GetPatchSize();
+
+		size_t texel_count = static_cast<size_t>(header.M[c]) * header.N[c];
+		displacement[c].resize(texel_count * 4);
+		slope[c].resize(texel_count * 2);
+		displacement_texels[c] = &displacement[c][0];
+		slope_texels[c] = &slope[c][0];
+	}
+
+	OceanBakeWriter writer;
+	if(!writer.Open(argv[2], header))
+	{
+		printf("Can't create %s\n", argv[2]);
+		return 1;
+	}
+
+	printf("Baking %u frames of %u cascades, %.4f s apart, %.1f MB per frame.\n", frame_count, cascade_count, step, writer.GetHeader().frameStride / (1024.0f * 1024.0f));
+
+	// Every cascade every frame, the update rates only save time when simulating live.
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for(u32 f = 0; f < warm_up_frames + frame_count; ++f)
+	{
+		simulation.SimulateAll(f * step, k_HeightScale);
+
+		if(f < warm_up_frames)
+			continue;
+
+		for(u32 c = 0; c < cascade_count; ++c)
+		{
+			simulation.GetCascade(c).PackTexels(&displacement[c][0], &slope[c][0]);
+		}
+
+		if(!writer.WriteFrame(displacement_texels, slope_texels))
+		{
+			printf("Can't write frame %u to %s\n", f - warm_up_frames, argv[2]);
+			return 1;
+		}
+	}
+
+	if(!writer.Close())
+	{
+		printf("Can't write %s\n", argv[2]);
+		return 1;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Wrote %s in %.1f s.\n", argv[2], seconds);
+
+	return 0;
+}
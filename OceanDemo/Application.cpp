@@ -16,6 +16,9 @@
 #include <SFML\Graphics.hpp>
 #include <math.h>
 
+#include <algorithm>
+#include <cstdio>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -37,6 +40,24 @@ namespace acqua
 		gCurrentOcean->ResetOcean(gOceanSettings);
 	}
 
+	void TW_CALL PrintOceanMemory( void* )
+	{
+		if(gCurrentOcean == NULL)
+			return;
+
+		const float megabyte = 1024.0f * 1024.0f;
+		OceanComponent::MemoryReport report = gCurrentOcean->GetMemoryReport();
+		printf("Ocean memory (MB): spectrum %.2f, evolution %.2f, fft %.2f, outputs %.2f, frames %.2f, loop %.2f, mesh %.2f, buoyancy %.2f, total %.2f\n",
+			report.simulation.spectrum / megabyte, report.simulation.evolution / megabyte, report.simulation.fft / megabyte, report.simulation.outputs / megabyte,
+			report.frames / megabyte, report.loop / megabyte, report.mesh / megabyte, report.buoyancy / megabyte, report.GetTotal() / megabyte);
+	}
+
+	// Lets the tweak bar edit std::string settings across the DLL boundary.
+	void TW_CALL CopyStdStringToClient( std::string& destination, const std::string& source )
+	{
+		destination = source;
+	}
+
 
 	Application::Application(void) :
 		  window(nullptr)
@@ -85,6 +106,7 @@ namespace acqua
 #pragma region TWEAK_BAR_INITIALIZATION
 		TwInit(TW_OPENGL_CORE, NULL);
 		TwWindowSize(appSettings.width, appSettings.height);
+		TwCopyStdStringToClientFunc(CopyStdStringToClient);
 
 		GUISystem = TwNewBar("Ocean Settings");
 		TwAddVarRW(GUISystem, "Wave speed", TW_TYPE_FLOAT, &gOceanSettings.V, NULL);
@@ -92,14 +114,66 @@ namespace acqua
 		TwAddVarRW(GUISystem, "Amplitude", TW_TYPE_FLOAT, &gOceanSettings.A, NULL);
 		TwAddVarRW(GUISystem, "Wind Direction (Rad.)", TW_TYPE_FLOAT, &gOceanSettings.W, NULL);
 		TwAddVarRW(GUISystem, "Wind Alignment", TW_TYPE_FLOAT, &gOceanSettings.windAlignment, NULL);
+		TwAddVarRW(GUISystem, "Seed", TW_TYPE_UINT32, &gOceanSettings.seed, "help='The same seed gives the same ocean, whatever the machine and thread count.'");
 		TwAddVarRW(GUISystem, "Reflections Damping", TW_TYPE_FLOAT, &gOceanSettings.dampReflections, NULL);
 		TwAddVarRW(GUISystem, "Depth", TW_TYPE_FLOAT, &gOceanSettings.depth, NULL);
 		TwAddVarRW(GUISystem, "Choppiness", TW_TYPE_FLOAT, &gOceanSettings.chopAmount, NULL);
+		TwAddVarRW(GUISystem, "Prune Threshold", TW_TYPE_FLOAT, &gOceanSettings.pruneThreshold, "min=0 max=1 step=0.000001 help='Bins with less energy than this fraction of the strongest one are not simulated.'");
 
 		TwAddVarRW(GUISystem, "Foam Slope Start", TW_TYPE_FLOAT, &gOceanSettings.foamSlopeRatio, NULL);
 		TwAddVarRW(GUISystem, "Foam Fader", TW_TYPE_FLOAT, &gOceanSettings.foamFader, NULL);
+		TwAddVarRW(GUISystem, "Jacobian Foam", TW_TYPE_BOOLCPP, &gOceanSettings.jacobianFoam, "help='Foam from the Jacobian of the chop instead of finite differences. Uses Foam Jacobian Limit instead of Foam Slope Start.'");
+		TwAddVarRW(GUISystem, "Foam Jacobian Limit", TW_TYPE_FLOAT, &gOceanSettings.foamJacobianLimit, "step=0.01");
+
+		TwAddVarRW(GUISystem, "Batched FFT", TW_TYPE_BOOLCPP, &gOceanSettings.batchedFFT, NULL);
+		TwAddVarRW(GUISystem, "Spectral Normals", TW_TYPE_BOOLCPP, &gOceanSettings.spectralNormals, "help='Normals from the FFT of the slopes instead of the displaced triangles.'");
+
+		TwEnumVal planning_modes[] = { {FFT_PLAN_ESTIMATE, "Estimate"}, {FFT_PLAN_MEASURE, "Measure"}, {FFT_PLAN_PATIENT, "Patient"} };
+		TwType planning_mode_type = TwDefineEnum("FFTPlanningMode", planning_modes, FFT_PLAN_COUNT);
+		TwAddVarRW(GUISystem, "FFT Planning", planning_mode_type, &gOceanSettings.planningMode, NULL);
+		TwAddVarRW(GUISystem, "FFT Planning Time Limit", TW_TYPE_FLOAT, &gOceanSettings.planningTimeLimit, NULL);
+		TwAddVarRW(GUISystem, "Simulation Threads", TW_TYPE_UINT32, &gOceanSettings.threadCount, "help='0 uses every hardware thread.'");
+
+		TwEnumVal simd_levels[] = { {SIMD_SCALAR, "Scalar"}, {SIMD_SSE2, "SSE2"}, {SIMD_AVX2, "AVX2"} };
+		TwType simd_level_type = TwDefineEnum("SIMDLevel", simd_levels, SIMD_LEVEL_COUNT);
+		TwAddVarRW(GUISystem, "Spectrum SIMD", simd_level_type, &gOceanSettings.simdLevel, "help='Clamped to what the CPU supports.'");
+
+		TwAddVarRW(GUISystem, "Displacement Maps", TW_TYPE_BOOLCPP, &gOceanSettings.displacementMaps, "help='Upload the simulation as float textures tiled by the shaders. The vertex buffer stays static.'");
+		TwAddVarRW(GUISystem, "Fixed Update Rate", TW_TYPE_FLOAT, &appSettings.fixedUpdateRate, "min=1 max=240 help='Simulation steps per second. Rendering interpolates between the last two.'");
+		TwAddVarRW(GUISystem, "Async Simulation", TW_TYPE_BOOLCPP, &gOceanSettings.asyncSimulation, "help='Simulate the next frame on a thread of its own while this one is rendered. Adds a frame of latency.'");
+		TwAddVarRW(GUISystem, "Loop", TW_TYPE_BOOLCPP, &gOceanSettings.loop, "group='Looping' help='Quantise the dispersion so the ocean repeats, simulate one period up front and play it back.'");
+		TwAddVarRW(GUISystem, "Loop Period", TW_TYPE_FLOAT, &gOceanSettings.loopPeriod, "group='Looping' min=1 help='Seconds.'");
+		TwAddVarRW(GUISystem, "Loop Frames", TW_TYPE_UINT32, &gOceanSettings.loopFrameCount, "group='Looping' min=2 max=1024 help='Frames kept in memory for one period.'");
+		TwAddVarRW(GUISystem, "Loop Interpolation", TW_TYPE_BOOLCPP, &gOceanSettings.loopInterpolate, "group='Looping' help='Blend between frames instead of holding each one.'");
+		TwAddVarRW(GUISystem, "Playback File", TW_TYPE_STDSTRING, &gOceanSettings.playbackFile, "group='Playback' help='Sequence baked with OceanBakeTool, played back instead of simulating. Empty simulates.'");
+		TwAddVarRW(GUISystem, "Playback Read Ahead", TW_TYPE_UINT32, &gOceanSettings.playbackReadAhead, "group='Playback' min=0 max=256 help='Frames read from disk ahead of the one shown.'");
+		TwAddVarRW(GUISystem, "Cascades", TW_TYPE_UINT32, &gOceanSettings.cascadeCount, "min=1 max=4 help='Patches of different sizes summed together, from the largest to the smallest.'");
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			CascadeSettings& cascade = gOceanSettings.cascades[c];
+
+			String name = "Cascade ";
+			name += static_cast<char>('1' + c);
+			String group = " group='" + name + "' ";
+
+			TwAddVarRW(GUISystem, (name + " Patch Size").c_str(), TW_TYPE_FLOAT, &cascade.patchSize, (group + "label='Patch Size' min=1").c_str());
+			TwAddVarRW(GUISystem, (name + " Resolution").c_str(), TW_TYPE_UINT32, &cascade.resolution, (group + "label='Resolution' min=8 max=2048 step=8 help='Rounded to the nearest size with no prime factor above 7, such as 192, 384 or 768.'").c_str());
+			TwAddVarRW(GUISystem, (name + " Min Wavelength").c_str(), TW_TYPE_FLOAT, &cascade.minWavelength, (group + "label='Min Wavelength' min=0 help='0 stops at the patch of the next cascade.'").c_str());
+			TwAddVarRW(GUISystem, (name + " Max Wavelength").c_str(), TW_TYPE_FLOAT, &cascade.maxWavelength, (group + "label='Max Wavelength' min=0 help='0 keeps the longest waves.'").c_str());
+			TwAddVarRW(GUISystem, (name + " Update Rate").c_str(), TW_TYPE_FLOAT, &cascade.updateRate, (group + "label='Update Rate' min=0 help='Simulations per second. 0 simulates every frame.'").c_str());
+			TwDefine((" 'Ocean Settings'/'" + name + "' opened=false ").c_str());
+		}
+
+		const FFTWisdomCache::Statistics& wisdom_stats = FFTWisdomCache::GetInstance().GetStatistics();
+		TwAddVarRO(GUISystem, "Plans From Wisdom", TW_TYPE_UINT32, &wisdom_stats.plansFromWisdom, "group='FFTW Wisdom'");
+		TwAddVarRO(GUISystem, "Plans Measured", TW_TYPE_UINT32, &wisdom_stats.plansMeasured, "group='FFTW Wisdom'");
+		TwAddVarRO(GUISystem, "Plans Estimated", TW_TYPE_UINT32, &wisdom_stats.plansEstimated, "group='FFTW Wisdom'");
+		TwAddVarRO(GUISystem, "Last Measure (s)", TW_TYPE_FLOAT, &wisdom_stats.lastMeasureSeconds, "group='FFTW Wisdom'");
+		TwAddVarRO(GUISystem, "Wisdom Files Loaded", TW_TYPE_UINT32, &wisdom_stats.wisdomLoads, "group='FFTW Wisdom'");
+		TwAddVarRO(GUISystem, "Wisdom Files Saved", TW_TYPE_UINT32, &wisdom_stats.wisdomSaves, "group='FFTW Wisdom'");
 
 		TwAddButton(GUISystem, "Apply", ApplyOceanSettings, NULL, NULL);
+		TwAddButton(GUISystem, "Print Memory", PrintOceanMemory, NULL, "help='Prints the memory held by the ocean on the CPU, by subsystem, to the console.'");
 
 #pragma endregion
 
@@ -256,6 +330,14 @@ namespace acqua
 		GameObject& ocean = scene.CreateGameObject();
 		ocean.AddComponent("OceanComponent");
 		gCurrentOcean = ocean.GetComponent<OceanComponent>();
+		if(gCurrentOcean != NULL)
+		{
+			const OceanComponent::Statistics& ocean_stats = gCurrentOcean->GetStatistics();
+			TwAddVarRO(GUISystem, "Dropped Frames", TW_TYPE_UINT32, &ocean_stats.droppedFrames, "group='Simulation Frames' help='Simulated but replaced by a newer frame before being shown.'");
+			TwAddVarRO(GUISystem, "Stale Frames", TW_TYPE_UINT32, &ocean_stats.staleFrames, "group='Simulation Frames' help='Updates that showed the previous simulation again.'");
+			TwAddVarRO(GUISystem, "Loop Memory (MB)", TW_TYPE_FLOAT, &ocean_stats.loopMegabytes, "group='Looping'");
+			TwAddVarRO(GUISystem, "Playback Frames", TW_TYPE_UINT32, &ocean_stats.playbackFrames, "group='Playback' help='Frames of the sequence played back. 0 when the file could not be opened.'");
+		}
 		GeometryRenderer* ocean_renderer = ocean.GetComponent<GeometryRenderer>();
 		if(ocean_renderer != NULL)
 			ocean_renderer->SetShaderProgram(ocean_shader_program);
@@ -284,6 +366,7 @@ namespace acqua
 		float last_time = current_time;
 
 		float time_accumulator = 0.0f;
+		float fixed_time_accumulator = 0.0f;
 
 		float yaw = 0.f; 
 		float pitch = 0.f;
@@ -359,6 +442,21 @@ namespace acqua
 			}
 			/*************************/
 
+			// Fixed steps for the time elapsed, then a variable one for the rest.
+			float fixed_delta_time = 1.0f / std::max(appSettings.fixedUpdateRate, 1.0f);
+			fixed_time_accumulator += delta_time;
+
+			int fixed_steps = 0;
+			while(fixed_time_accumulator >= fixed_delta_time && fixed_steps < appSettings.maxFixedStepsPerFrame)
+			{
+				scene.FixedUpdate(fixed_delta_time);
+				fixed_time_accumulator -= fixed_delta_time;
+				++fixed_steps;
+			}
+
+			if(fixed_time_accumulator >= fixed_delta_time)
+				fixed_time_accumulator = fmod(fixed_time_accumulator, fixed_delta_time);
+
 			scene.Update(delta_time);
 			scene.Draw(delta_time);
 
@@ -26,7 +26,10 @@ namespace acqua
 		bool		fullscreen;
 		std::string title;
 
-		AppSettings() : width(1920), height(1080), fullscreen(false), title("")
+		float		fixedUpdateRate;		// FixedUpdate steps per second.
+		int			maxFixedStepsPerFrame;	// Steps past this are dropped, so a slow frame doesn't make the next one slower.
+
+		AppSettings() : width(1920), height(1080), fullscreen(false), title(""), fixedUpdateRate(30.0f), maxFixedStepsPerFrame(8)
 		{
 		}
 	};
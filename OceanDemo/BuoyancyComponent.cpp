@@ -0,0 +1,69 @@
+#include "BuoyancyComponent.h"
+#include "DebugUtil.h"
+
+#include "GameObject.h"
+#include "OceanComponent.h"
+
+namespace acqua
+{
+	BuoyancyComponent::BuoyancyComponent( void ) : Component(CT_BUOYANCYCOMPONENT)
+		, ocean(NULL)
+		, body(k_InvalidBuoyancyBody)
+	{
+	}
+
+	BuoyancyComponent::~BuoyancyComponent( void )
+	{
+		Detach();
+	}
+
+	bool BuoyancyComponent::Init( GameObject* o )
+	{
+		return Component::Init(o);
+	}
+
+	void BuoyancyComponent::FixedUpdate( float fixed_delta_time )
+	{
+		// The ocean steps every body at once.
+	}
+
+	void BuoyancyComponent::Update( float delta_time )
+	{
+		if(ocean == NULL)
+			return;
+
+		const BuoyancySystem& buoyancy = ocean->GetBuoyancy();
+		Transform& transform = GetGameObject().GetTransform();
+		transform.SetPosition(buoyancy.GetPosition(body));
+		transform.SetOrientation(buoyancy.GetOrientation(body));
+	}
+
+	void BuoyancyComponent::Draw( float delta_time )
+	{
+
+	}
+
+	void BuoyancyComponent::Attach( OceanComponent* new_ocean, const BuoyancyBodyDesc& desc )
+	{
+		ASSERT(new_ocean != NULL, "A floating body needs an ocean.");
+		Detach();
+
+		const Transform& transform = GetGameObject().GetTransform();
+		BuoyancyBodyDesc body_desc = desc;
+		body_desc.position = transform.GetPosition();
+		body_desc.orientation = transform.GetOrientation();
+
+		ocean = new_ocean;
+		body = ocean->GetBuoyancy().AddBody(body_desc);
+	}
+
+	void BuoyancyComponent::Detach()
+	{
+		if(ocean == NULL)
+			return;
+
+		ocean->GetBuoyancy().RemoveBody(body);
+		ocean = NULL;
+		body = k_InvalidBuoyancyBody;
+	}
+}
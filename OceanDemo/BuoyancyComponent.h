@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Component.h"
+#include "BuoyancySystem.h"
+#include "Types.h"
+
+namespace acqua
+{
+	// Forward declarations.
+	class OceanComponent;
+
+	// Floats its game object on an ocean. The body is simulated by the buoyancy system of the ocean, on its fixed
+	// steps, and the component copies the result to the transform every frame.
+	class BuoyancyComponent : public Component
+	{
+	public:
+		BuoyancyComponent(void);
+		~BuoyancyComponent(void);
+
+		virtual bool Init( GameObject* o );
+
+		virtual void FixedUpdate( float fixed_delta_time );
+
+		virtual void Update( float delta_time );
+
+		virtual void Draw( float delta_time );
+
+		// Floats on ocean as described by desc, starting from the current transform of the game object.
+		// Replaces the previous body. The ocean has to outlive the component, or Detach it first.
+		void Attach(OceanComponent* ocean, const BuoyancyBodyDesc& desc);
+		void Detach();
+
+		bool IsAttached() const { return ocean != NULL; }
+		BuoyancyBody GetBody() const { return body; }
+
+	private:
+		OceanComponent* ocean;
+		BuoyancyBody body;
+	};
+
+	REGISTER_COMPONENT(BuoyancyComponent)
+}
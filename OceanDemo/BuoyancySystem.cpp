@@ -0,0 +1,328 @@
+#include "BuoyancySystem.h"
+#include "DebugUtil.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace acqua
+{
+	// Bodies below this count are integrated on the calling thread.
+	static const int k_MinParallelBodies = 64;
+
+	// Moves the last element into index, the order of the others doesn't matter.
+	template <typename T>
+	static void RemoveSwap(std::vector<T>& values, u32 index)
+	{
+		values[index] = values.back();
+		values.pop_back();
+	}
+
+	template <typename T>
+	static void EraseRange(std::vector<T>& values, u32 begin, u32 count)
+	{
+		values.erase(values.begin() + begin, values.begin() + begin + count);
+	}
+
+	// Interleaves the bits of x and z, so that cells close in space are mostly close in the order.
+	static u32 MortonKey(u32 x, u32 z)
+	{
+		u32 key = 0;
+		for(u32 bit = 0; bit < 16; ++bit)
+		{
+			key |= ((x >> bit) & 1u) << (2 * bit);
+			key |= ((z >> bit) & 1u) << (2 * bit + 1);
+		}
+		return key;
+	}
+
+	static void ForEachBody(WorkerPool* pool, int count, const WorkerPool::RangeFunction& fn)
+	{
+		if(pool != NULL && count >= k_MinParallelBodies)
+			pool->ParallelFor(0, count, fn);
+		else
+			fn(0, count);
+	}
+
+	BuoyancySystem::BuoyancySystem( void )
+	{
+	}
+
+	BuoyancySystem::~BuoyancySystem( void )
+	{
+	}
+
+	BuoyancyBody BuoyancySystem::AddBody( const BuoyancyBodyDesc& desc )
+	{
+		ASSERT(desc.mass > 0.0f && desc.inertia > 0.0f, "Floating bodies need a mass and an inertia.");
+		ASSERT(desc.probeCount == 0 || desc.probes != NULL, "The probes of a floating body are missing.");
+
+		BuoyancyBody body;
+		if(!freeHandles.empty())
+		{
+			body = freeHandles.back();
+			freeHandles.pop_back();
+		}
+		else
+		{
+			body = static_cast<BuoyancyBody>(handleIndices.size());
+			handleIndices.push_back(0);
+		}
+
+		handleIndices[body] = static_cast<u32>(bodyHandles.size());
+		bodyHandles.push_back(body);
+
+		positionX.push_back(desc.position.x);
+		positionY.push_back(desc.position.y);
+		positionZ.push_back(desc.position.z);
+		velocityX.push_back(desc.velocity.x);
+		velocityY.push_back(desc.velocity.y);
+		velocityZ.push_back(desc.velocity.z);
+		angularX.push_back(0.0f);
+		angularY.push_back(0.0f);
+		angularZ.push_back(0.0f);
+		orientations.push_back(glm::normalize(desc.orientation));
+		inverseMass.push_back(1.0f / desc.mass);
+		inverseInertia.push_back(1.0f / desc.inertia);
+		linearDrag.push_back(desc.probeCount > 0 ? desc.linearDrag / desc.probeCount : 0.0f);
+		angularDrag.push_back(desc.angularDrag);
+		probeVolume.push_back(desc.probeVolume);
+		inverseProbeHeight.push_back(1.0f / std::max(desc.probeHeight, 1e-6f));
+		probeBegin.push_back(static_cast<u32>(probeX.size()));
+		probeCount.push_back(desc.probeCount);
+
+		for(u32 p = 0; p < desc.probeCount; ++p)
+		{
+			probeX.push_back(desc.probes[p].x);
+			probeY.push_back(desc.probes[p].y);
+			probeZ.push_back(desc.probes[p].z);
+		}
+
+		return body;
+	}
+
+	void BuoyancySystem::RemoveBody( BuoyancyBody body )
+	{
+		ASSERT(body < handleIndices.size() && handleIndices[body] != ~0u, "Removing a floating body that doesn't exist.");
+
+		// The probes keep the order of the bodies, the bodies are swapped with the last one.
+		u32 index = handleIndices[body];
+		u32 begin = probeBegin[index];
+		u32 count = probeCount[index];
+		EraseRange(probeX, begin, count);
+		EraseRange(probeY, begin, count);
+		EraseRange(probeZ, begin, count);
+		for(u32 b = 0; b < probeBegin.size(); ++b)
+		{
+			if(probeBegin[b] > begin)
+				probeBegin[b] -= count;
+		}
+
+		handleIndices[bodyHandles.back()] = index;
+		handleIndices[body] = ~0u;
+		freeHandles.push_back(body);
+
+		RemoveSwap(bodyHandles, index);
+		RemoveSwap(positionX, index);
+		RemoveSwap(positionY, index);
+		RemoveSwap(positionZ, index);
+		RemoveSwap(velocityX, index);
+		RemoveSwap(velocityY, index);
+		RemoveSwap(velocityZ, index);
+		RemoveSwap(angularX, index);
+		RemoveSwap(angularY, index);
+		RemoveSwap(angularZ, index);
+		RemoveSwap(orientations, index);
+		RemoveSwap(inverseMass, index);
+		RemoveSwap(inverseInertia, index);
+		RemoveSwap(linearDrag, index);
+		RemoveSwap(angularDrag, index);
+		RemoveSwap(probeVolume, index);
+		RemoveSwap(inverseProbeHeight, index);
+		RemoveSwap(probeBegin, index);
+		RemoveSwap(probeCount, index);
+	}
+
+	template <typename T>
+	static size_t GetBytes(const std::vector<T>& values)
+	{
+		return values.capacity() * sizeof(T);
+	}
+
+	size_t BuoyancySystem::GetMemoryBytes() const
+	{
+		return GetBytes(handleIndices) + GetBytes(freeHandles) + GetBytes(bodyHandles)
+			+ GetBytes(positionX) + GetBytes(positionY) + GetBytes(positionZ)
+			+ GetBytes(velocityX) + GetBytes(velocityY) + GetBytes(velocityZ)
+			+ GetBytes(angularX) + GetBytes(angularY) + GetBytes(angularZ)
+			+ GetBytes(orientations) + GetBytes(inverseMass) + GetBytes(inverseInertia)
+			+ GetBytes(linearDrag) + GetBytes(angularDrag) + GetBytes(probeVolume) + GetBytes(inverseProbeHeight)
+			+ GetBytes(probeBegin) + GetBytes(probeCount)
+			+ GetBytes(probeX) + GetBytes(probeY) + GetBytes(probeZ)
+			+ GetBytes(order) + GetBytes(cellKeys) + GetBytes(queryBegin)
+			+ GetBytes(queryX) + GetBytes(queryY) + GetBytes(queryZ) + GetBytes(surfaceHeight);
+	}
+
+	glm::vec3 BuoyancySystem::GetPosition( BuoyancyBody body ) const
+	{
+		u32 index = handleIndices[body];
+		return glm::vec3(positionX[index], positionY[index], positionZ[index]);
+	}
+
+	glm::quat BuoyancySystem::GetOrientation( BuoyancyBody body ) const
+	{
+		return orientations[handleIndices[body]];
+	}
+
+	glm::vec3 BuoyancySystem::GetVelocity( BuoyancyBody body ) const
+	{
+		u32 index = handleIndices[body];
+		return glm::vec3(velocityX[index], velocityY[index], velocityZ[index]);
+	}
+
+	void BuoyancySystem::SetTransform( BuoyancyBody body, const glm::vec3& position, const glm::quat& orientation )
+	{
+		u32 index = handleIndices[body];
+		positionX[index] = position.x;
+		positionY[index] = position.y;
+		positionZ[index] = position.z;
+		orientations[index] = glm::normalize(orientation);
+		velocityX[index] = velocityY[index] = velocityZ[index] = 0.0f;
+		angularX[index] = angularY[index] = angularZ[index] = 0.0f;
+	}
+
+	void BuoyancySystem::Step( const OceanQuerySurface& surface, Real step, WorkerPool* pool )
+	{
+		if(bodyHandles.empty() || step <= 0.0f)
+			return;
+
+		const u32 substeps = std::max(settings.substeps, 1u);
+		for(u32 s = 0; s < substeps; ++s)
+		{
+			Substep(surface, step / substeps, pool);
+		}
+	}
+
+	void BuoyancySystem::SortBodies()
+	{
+		// Cell in the high bits, body in the low ones. Bodies move little between steps, so the order barely changes.
+		const u32 body_count = static_cast<u32>(bodyHandles.size());
+		const Real inverse_cell = 1.0f / settings.cellSize;
+		cellKeys.resize(body_count);
+		for(u32 b = 0; b < body_count; ++b)
+		{
+			u32 cell_x = static_cast<u32>(static_cast<int>(floor(positionX[b] * inverse_cell)) + 0x8000) & 0xFFFF;
+			u32 cell_z = static_cast<u32>(static_cast<int>(floor(positionZ[b] * inverse_cell)) + 0x8000) & 0xFFFF;
+			cellKeys[b] = (static_cast<u64>(MortonKey(cell_x, cell_z)) << 32) | b;
+		}
+		std::sort(cellKeys.begin(), cellKeys.end());
+
+		order.resize(body_count);
+		queryBegin.resize(body_count);
+		u32 query_count = 0;
+		for(u32 o = 0; o < body_count; ++o)
+		{
+			order[o] = static_cast<u32>(cellKeys[o] & 0xFFFFFFFFu);
+			queryBegin[o] = query_count;
+			query_count += probeCount[order[o]];
+		}
+
+		queryX.resize(query_count);
+		queryY.resize(query_count);
+		queryZ.resize(query_count);
+		surfaceHeight.resize(query_count);
+	}
+
+	void BuoyancySystem::Substep( const OceanQuerySurface& surface, Real dt, WorkerPool* pool )
+	{
+		SortBodies();
+
+		const int body_count = static_cast<int>(bodyHandles.size());
+		const u32 query_count = static_cast<u32>(queryX.size());
+
+		// Probes to world space, in cell order.
+		ForEachBody(pool, body_count, [&](int begin, int end)
+		{
+			for(int o = begin; o < end; ++o)
+			{
+				const u32 b = order[o];
+				const glm::mat3 rotation = glm::mat3_cast(orientations[b]);
+				const u32 local = probeBegin[b];
+				const u32 world = queryBegin[o];
+				for(u32 p = 0; p < probeCount[b]; ++p)
+				{
+					glm::vec3 r = rotation * glm::vec3(probeX[local + p], probeY[local + p], probeZ[local + p]);
+					queryX[world + p] = positionX[b] + r.x;
+					queryY[world + p] = positionY[b] + r.y;
+					queryZ[world + p] = positionZ[b] + r.z;
+				}
+			}
+		});
+
+		if(query_count > 0)
+		{
+			OceanQueryResults results;
+			results.height = &surfaceHeight[0];
+			QueryOceanSurface(surface, query_count, &queryX[0], &queryZ[0], results, settings.query, pool);
+		}
+
+		// Each probe under water lifts its part of the hull and drags against the water at its velocity.
+		const Real gravity = settings.gravity;
+		const Real pressure = settings.waterDensity * settings.gravity;
+		ForEachBody(pool, body_count, [&](int begin, int end)
+		{
+			for(int o = begin; o < end; ++o)
+			{
+				const u32 b = order[o];
+				const glm::vec3 position(positionX[b], positionY[b], positionZ[b]);
+				glm::vec3 velocity(velocityX[b], velocityY[b], velocityZ[b]);
+				glm::vec3 angular(angularX[b], angularY[b], angularZ[b]);
+
+				const Real lift = pressure * probeVolume[b];
+				glm::vec3 force(0.0f);
+				glm::vec3 torque(0.0f);
+				Real submerged = 0.0f;
+
+				const u32 world = queryBegin[o];
+				for(u32 p = 0; p < probeCount[b]; ++p)
+				{
+					const glm::vec3 r = glm::vec3(queryX[world + p], queryY[world + p], queryZ[world + p]) - position;
+					const Real depth = surfaceHeight[world + p] - queryY[world + p];
+					const Real fraction = glm::clamp(depth * inverseProbeHeight[b] + 0.5f, 0.0f, 1.0f);
+
+					const glm::vec3 probe_velocity = velocity + glm::cross(angular, r);
+					const glm::vec3 probe_force = glm::vec3(0.0f, lift * fraction, 0.0f) - (linearDrag[b] * fraction) * probe_velocity;
+
+					force += probe_force;
+					torque += glm::cross(r, probe_force);
+					submerged += fraction;
+				}
+
+				if(probeCount[b] > 0)
+					torque -= (angularDrag[b] * submerged / probeCount[b]) * angular;
+
+				velocity += force * (inverseMass[b] * dt);
+				velocity.y -= gravity * dt;
+				angular += torque * (inverseInertia[b] * dt);
+
+				positionX[b] += velocity.x * dt;
+				positionY[b] += velocity.y * dt;
+				positionZ[b] += velocity.z * dt;
+				velocityX[b] = velocity.x;
+				velocityY[b] = velocity.y;
+				velocityZ[b] = velocity.z;
+				angularX[b] = angular.x;
+				angularY[b] = angular.y;
+				angularZ[b] = angular.z;
+
+				// dq/dt = (0, w) * q / 2.
+				glm::quat& q = orientations[b];
+				glm::quat spin = glm::quat(0.0f, angular.x, angular.y, angular.z) * q;
+				q.w += 0.5f * dt * spin.w;
+				q.x += 0.5f * dt * spin.x;
+				q.y += 0.5f * dt * spin.y;
+				q.z += 0.5f * dt * spin.z;
+				q = glm::normalize(q);
+			}
+		});
+	}
+}
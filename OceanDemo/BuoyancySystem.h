@@ -0,0 +1,137 @@
+#pragma once
+
+#include "OceanQuery.h"
+#include "Types.h"
+#include "WorkerPool.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+namespace acqua
+{
+	// Handle of a body, stable while the others come and go.
+	typedef u32 BuoyancyBody;
+	const BuoyancyBody k_InvalidBuoyancyBody = ~0u;
+
+	// A rigid body floating on probes. Each probe is a small volume of the hull, pushed up by the water it displaces
+	// and slowed down by it.
+	struct BuoyancyBodyDesc
+	{
+		glm::vec3 position;
+		glm::quat orientation;
+		glm::vec3 velocity;
+
+		Real mass;
+		Real inertia;			// Moment of inertia around any axis through the centre of mass, a sphere or a cube.
+		Real linearDrag;		// Force per unit of velocity of the whole hull under water, spread over the probes.
+		Real angularDrag;		// Torque per unit of angular velocity under water.
+
+		u32 probeCount;
+		const glm::vec3* probes;	// Centres of the probes, in body space.
+		Real probeVolume;		// Volume each probe displaces when it's under water.
+		Real probeHeight;		// Depth over which a probe goes from dry to under water, centred on the surface.
+
+		BuoyancyBodyDesc()
+			: position(0.0f)
+			, orientation(1.0f, 0.0f, 0.0f, 0.0f)
+			, velocity(0.0f)
+			, mass(1.0f)
+			, inertia(1.0f)
+			, linearDrag(1.0f)
+			, angularDrag(1.0f)
+			, probeCount(0)
+			, probes(NULL)
+			, probeVolume(1.0f)
+			, probeHeight(1.0f)
+		{}
+	};
+
+	struct BuoyancySettings
+	{
+		Real gravity;
+		Real waterDensity;
+		u32 substeps;				// Integration steps per Step, each one querying the surface again.
+		Real cellSize;				// Bodies are processed in cells of this size, neighbours read the same texels.
+		OceanQueryOptions query;	// Probes only need the height, and a rough inversion of the chop.
+
+		BuoyancySettings() : gravity(9.8f), waterDensity(1.0f), substeps(1), cellSize(50.0f)
+		{
+			query.inversionIterations = 1;
+		}
+	};
+
+	// Floating rigid bodies, stepped together against an ocean surface.
+	// The probes of every body are queried in one batch, ordered by cell so that nearby probes are sampled together,
+	// and the bodies are integrated in parallel. Semi-implicit Euler on fixed steps.
+	class BuoyancySystem
+	{
+	public:
+		BuoyancySystem(void);
+		~BuoyancySystem(void);
+
+		void SetSettings(const BuoyancySettings& new_settings) { settings = new_settings; }
+		const BuoyancySettings& GetSettings() const { return settings; }
+
+		BuoyancyBody AddBody(const BuoyancyBodyDesc& desc);
+		void RemoveBody(BuoyancyBody body);
+
+		u32 GetBodyCount() const { return static_cast<u32>(bodyHandles.size()); }
+		u32 GetProbeCount() const { return static_cast<u32>(probeX.size()); }
+		size_t GetMemoryBytes() const;
+
+		glm::vec3 GetPosition(BuoyancyBody body) const;
+		glm::quat GetOrientation(BuoyancyBody body) const;
+		glm::vec3 GetVelocity(BuoyancyBody body) const;
+
+		// Teleports the body, and stops it.
+		void SetTransform(BuoyancyBody body, const glm::vec3& position, const glm::quat& orientation);
+
+		// Advances every body by step seconds on surface. pool can be NULL.
+		void Step(const OceanQuerySurface& surface, Real step, WorkerPool* pool);
+
+	private:
+		BuoyancySystem(const BuoyancySystem&);
+		BuoyancySystem& operator=(const BuoyancySystem&);
+
+		// Orders the bodies by cell and places their probes in the query arrays in that order.
+		void SortBodies();
+
+		void Substep(const OceanQuerySurface& surface, Real dt, WorkerPool* pool);
+
+	private:
+		BuoyancySettings settings;
+
+		// Handles to dense indices and back. Removing a body moves the last one into its place.
+		std::vector<u32> handleIndices;
+		std::vector<BuoyancyBody> freeHandles;
+		std::vector<BuoyancyBody> bodyHandles;
+
+		// Bodies, one entry each.
+		std::vector<Real> positionX, positionY, positionZ;
+		std::vector<Real> velocityX, velocityY, velocityZ;
+		std::vector<Real> angularX, angularY, angularZ;
+		std::vector<glm::quat> orientations;
+		std::vector<Real> inverseMass;
+		std::vector<Real> inverseInertia;
+		std::vector<Real> linearDrag;		// Per probe.
+		std::vector<Real> angularDrag;
+		std::vector<Real> probeVolume;
+		std::vector<Real> inverseProbeHeight;
+		std::vector<u32> probeBegin;		// First probe of each body.
+		std::vector<u32> probeCount;
+
+		// Probes, in body space, one range per body.
+		std::vector<Real> probeX, probeY, probeZ;
+
+		// Bodies in cell order, and where the probes of each one start in the query arrays.
+		std::vector<u32> order;
+		std::vector<u64> cellKeys;
+		std::vector<u32> queryBegin;
+
+		// Probes in world space in body order, and the surface height above them.
+		std::vector<Real> queryX, queryY, queryZ;
+		std::vector<Real> surfaceHeight;
+	};
+}
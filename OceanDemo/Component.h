@@ -14,6 +14,7 @@ namespace acqua
 		CT_CAMERA,
 		CT_OCEANCOMPONENT,
 		CT_TERRAINCOMPONENT,
+		CT_BUOYANCYCOMPONENT,
 		CT_COUNT
 	};
 
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Types.h"
+
+#include <cmath>
+
+namespace acqua
+{
+	// Philox4x32-10, the counter based generator of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3".
+	// The output is a function of the counter and the key only, so any number of the sequence can be drawn on any thread,
+	// in any order, and comes out the same.
+	class Philox4x32
+	{
+	public:
+		Philox4x32(u32 key0, u32 key1)
+		{
+			key[0] = key0;
+			key[1] = key1;
+		}
+
+		// The 4 random words of counter (c0, c1, c2, c3).
+		void Generate(u32 c0, u32 c1, u32 c2, u32 c3, u32 out[4]) const
+		{
+			u32 counter[4] = { c0, c1, c2, c3 };
+			u32 k0 = key[0];
+			u32 k1 = key[1];
+
+			for(u32 round = 0; round < 10; ++round)
+			{
+				u64 product0 = static_cast<u64>(0xD2511F53u) * counter[0];
+				u64 product1 = static_cast<u64>(0xCD9E8D57u) * counter[2];
+
+				u32 hi0 = static_cast<u32>(product0 >> 32), lo0 = static_cast<u32>(product0);
+				u32 hi1 = static_cast<u32>(product1 >> 32), lo1 = static_cast<u32>(product1);
+
+				counter[0] = hi1 ^ counter[1] ^ k0;
+				counter[1] = lo1;
+				counter[2] = hi0 ^ counter[3] ^ k1;
+				counter[3] = lo0;
+
+				k0 += 0x9E3779B9u;
+				k1 += 0xBB67AE85u;
+			}
+
+			out[0] = counter[0];
+			out[1] = counter[1];
+			out[2] = counter[2];
+			out[3] = counter[3];
+		}
+
+		// Two independent normally distributed numbers from counter (c0, c1), with Box-Muller.
+		template <typename T>
+		void GaussianPair(u32 c0, u32 c1, T& g0, T& g1) const
+		{
+			u32 bits[4];
+			Generate(c0, c1, 0, 0, bits);
+
+			// The top 24 bits as a float in (0, 1], so the log is finite.
+			double u0 = ((bits[0] >> 8) + 1) * (1.0 / 16777216.0);
+			double u1 = (bits[1] >> 8) * (1.0 / 16777216.0);
+
+			double radius = sqrt(-2.0 * log(u0));
+			double angle = 6.283185307179586 * u1;
+			g0 = static_cast<T>(radius * cos(angle));
+			g1 = static_cast<T>(radius * sin(angle));
+		}
+
+	private:
+		u32 key[2];
+	};
+}
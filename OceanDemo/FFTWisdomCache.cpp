@@ -0,0 +1,116 @@
+#include "FFTWisdomCache.h"
+
+#include <chrono>
+#include <sstream>
+
+namespace acqua
+{
+	// Start clean so the file we save only holds the plans of the key.
+	template <typename T>
+	static bool ImportWisdom(const String& filename)
+	{
+		FFTW<T>::ForgetWisdom();
+		return FFTW<T>::ImportWisdom(filename.c_str());
+	}
+
+	FFTWisdomCache& FFTWisdomCache::GetInstance()
+	{
+		static FFTWisdomCache cache;
+		return cache;
+	}
+
+	FFTWisdomCache::FFTWisdomCache( void ) :
+		precisionBits(32)
+		, planningMode(FFT_PLAN_ESTIMATE)
+		, timeLimit(0.0f)
+		, dirty(false)
+	{
+	}
+
+	String FFTWisdomCache::GetWisdomFilename( const FFTWisdomKey& key ) const
+	{
+		std::ostringstream str;
+		if(!wisdomDirectory.empty())
+			str << wisdomDirectory << "/";
+
+		str << "ocean_fftw_f" << key.precisionBits << "_" << key.M << "x" << key.N << "_t" << key.threads << ".wisdom";
+		return str.str();
+	}
+
+	void FFTWisdomCache::Begin( const FFTWisdomKey& key, FFTPlanningMode mode, float time_limit_seconds )
+	{
+		precisionBits = key.precisionBits;
+		planningMode = mode;
+		timeLimit = time_limit_seconds;
+		statistics.lastMeasureSeconds = 0.0f;
+
+		if(planningMode == FFT_PLAN_ESTIMATE)
+			return; // Estimated plans don't use wisdom.
+
+		if(key == currentKey)
+			return; // Already loaded.
+
+		String filename = GetWisdomFilename(key);
+		bool loaded = (precisionBits == 64) ? ImportWisdom<double>(filename) : ImportWisdom<float>(filename);
+		currentKey = key;
+		dirty = false;
+
+		if(loaded)
+			++statistics.wisdomLoads;
+	}
+
+	void FFTWisdomCache::End()
+	{
+		if(precisionBits == 64)
+			FFTW<double>::SetTimeLimit(FFTW_NO_TIMELIMIT);
+		else
+			FFTW<float>::SetTimeLimit(FFTW_NO_TIMELIMIT);
+
+		if(!dirty)
+			return;
+
+		String filename = GetWisdomFilename(currentKey);
+		bool saved = (currentKey.precisionBits == 64) ? FFTW<double>::ExportWisdom(filename.c_str()) : FFTW<float>::ExportWisdom(filename.c_str());
+		if(saved)
+			++statistics.wisdomSaves;
+
+		dirty = false;
+	}
+
+	template <typename T>
+	typename FFTW<T>::Plan FFTWisdomCache::Plan( const std::function<typename FFTW<T>::Plan (unsigned flags)>& make_plan )
+	{
+		if(planningMode == FFT_PLAN_ESTIMATE)
+		{
+			++statistics.plansEstimated;
+			return make_plan(FFTW_ESTIMATE);
+		}
+
+		unsigned flags = (planningMode == FFT_PLAN_PATIENT) ? FFTW_PATIENT : FFTW_MEASURE;
+
+		// Wisdom only planning is immediate and fails if this problem was never measured.
+		typename FFTW<T>::Plan plan = make_plan(flags | FFTW_WISDOM_ONLY);
+		if(plan != NULL)
+		{
+			++statistics.plansFromWisdom;
+			return plan;
+		}
+
+		// Measure it. The time limit keeps settings changes responsive on a cold cache.
+		FFTW<T>::SetTimeLimit(timeLimit > 0.0f ? timeLimit : FFTW_NO_TIMELIMIT);
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		plan = make_plan(flags);
+		std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+		++statistics.plansMeasured;
+		statistics.lastMeasureSeconds += elapsed.count();
+		statistics.totalMeasureSeconds += elapsed.count();
+		dirty = true;
+
+		return plan;
+	}
+
+	template FFTW<float>::Plan FFTWisdomCache::Plan<float>(const std::function<FFTW<float>::Plan (unsigned flags)>& make_plan);
+	template FFTW<double>::Plan FFTWisdomCache::Plan<double>(const std::function<FFTW<double>::Plan (unsigned flags)>& make_plan);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Types.h"
+
+#include <fftw3.h>
+#include <functional>
+
+namespace acqua
+{
+	// How hard FFTW works to find a fast plan.
+	enum FFTPlanningMode
+	{
+		FFT_PLAN_ESTIMATE,	// Heuristic plans, no measuring and no wisdom.
+		FFT_PLAN_MEASURE,	// Measured plans, cached as wisdom.
+		FFT_PLAN_PATIENT,	// Exhaustively measured plans, cached as wisdom.
+		FFT_PLAN_COUNT
+	};
+
+	// Identifies a wisdom file. Plans for different grids, precisions or thread counts never share a file.
+	struct FFTWisdomKey
+	{
+		u32 M;
+		u32 N;
+		u32 precisionBits;	// 32 for fftwf, 64 for fftw.
+		u32 threads;
+
+		FFTWisdomKey() : M(0), N(0), precisionBits(0), threads(0) {}
+		FFTWisdomKey(u32 m, u32 n, u32 precision_bits, u32 num_threads) : M(m), N(n), precisionBits(precision_bits), threads(num_threads) {}
+
+		bool operator==(const FFTWisdomKey& other) const
+		{
+			return M == other.M && N == other.N && precisionBits == other.precisionBits && threads == other.threads;
+		}
+	};
+
+	// FFTW in single (fftwf) or double (fftw) precision behind the same names, for code written once for both.
+	template <typename T>
+	struct FFTW;
+
+	template <>
+	struct FFTW<float>
+	{
+		typedef fftwf_plan Plan;
+		typedef fftwf_iodim IODim;
+
+		static int InitThreads() { return fftwf_init_threads(); }
+		static void PlanWithThreads(int threads) { fftwf_plan_with_nthreads(threads); }
+		static Plan PlanSplitC2R(int rank, const IODim* dims, int howmany_rank, const IODim* howmany_dims, float* in_re, float* in_im, float* out, unsigned flags)
+		{
+			return fftwf_plan_guru_split_dft_c2r(rank, dims, howmany_rank, howmany_dims, in_re, in_im, out, flags);
+		}
+		static void Execute(Plan plan) { fftwf_execute(plan); }
+		static void Destroy(Plan plan) { fftwf_destroy_plan(plan); }
+
+		static void ForgetWisdom() { fftwf_forget_wisdom(); }
+		static bool ImportWisdom(const char* filename) { return fftwf_import_wisdom_from_filename(filename) != 0; }
+		static bool ExportWisdom(const char* filename) { return fftwf_export_wisdom_to_filename(filename) != 0; }
+		static void SetTimeLimit(double seconds) { fftwf_set_timelimit(seconds); }
+	};
+
+	template <>
+	struct FFTW<double>
+	{
+		typedef fftw_plan Plan;
+		typedef fftw_iodim IODim;
+
+		static int InitThreads() { return fftw_init_threads(); }
+		static void PlanWithThreads(int threads) { fftw_plan_with_nthreads(threads); }
+		static Plan PlanSplitC2R(int rank, const IODim* dims, int howmany_rank, const IODim* howmany_dims, double* in_re, double* in_im, double* out, unsigned flags)
+		{
+			return fftw_plan_guru_split_dft_c2r(rank, dims, howmany_rank, howmany_dims, in_re, in_im, out, flags);
+		}
+		static void Execute(Plan plan) { fftw_execute(plan); }
+		static void Destroy(Plan plan) { fftw_destroy_plan(plan); }
+
+		static void ForgetWisdom() { fftw_forget_wisdom(); }
+		static bool ImportWisdom(const char* filename) { return fftw_import_wisdom_from_filename(filename) != 0; }
+		static bool ExportWisdom(const char* filename) { return fftw_export_wisdom_to_filename(filename) != 0; }
+		static void SetTimeLimit(double seconds) { fftw_set_timelimit(seconds); }
+	};
+
+	// Loads and saves FFTW wisdom on disk so measured plans are only paid for once per key.
+	// FFTW wisdom is process wide, hence a single cache. The key's precision picks the FFTW library it goes to.
+	class FFTWisdomCache
+	{
+	public:
+
+		struct Statistics
+		{
+			u32 wisdomLoads;		// Wisdom files successfully imported.
+			u32 wisdomSaves;		// Wisdom files written.
+			u32 plansFromWisdom;	// Measured plans rebuilt from wisdom, no measuring needed.
+			u32 plansMeasured;		// Plans that had to be measured.
+			u32 plansEstimated;		// Plans made with FFTW_ESTIMATE.
+			float lastMeasureSeconds;	// Time spent measuring during the last Begin/End block.
+			float totalMeasureSeconds;
+
+			Statistics() : wisdomLoads(0), wisdomSaves(0), plansFromWisdom(0), plansMeasured(0), plansEstimated(0), lastMeasureSeconds(0.0f), totalMeasureSeconds(0.0f) {}
+		};
+
+		static FFTWisdomCache& GetInstance();
+
+		// Wraps the planning of a group of plans. Begin loads the wisdom for the key, End saves it if new plans were measured.
+		void Begin(const FFTWisdomKey& key, FFTPlanningMode mode, float time_limit_seconds);
+		void End();
+
+		// Makes a plan of precision T, with make_plan called with the planner flags. make_plan must return NULL
+		// when the plan can't be made. Instantiated for float and double.
+		template <typename T>
+		typename FFTW<T>::Plan Plan(const std::function<typename FFTW<T>::Plan (unsigned flags)>& make_plan);
+
+		// Accessors.
+		void SetDirectory(const String& directory) { wisdomDirectory = directory; }
+		const String& GetDirectory() const { return wisdomDirectory; }
+
+		const Statistics& GetStatistics() const { return statistics; }
+
+		String GetWisdomFilename(const FFTWisdomKey& key) const;
+
+	private:
+		FFTWisdomCache(void);
+		FFTWisdomCache(const FFTWisdomCache&);
+		FFTWisdomCache& operator=(const FFTWisdomCache&);
+
+	private:
+		String			wisdomDirectory; // Where the wisdom files live. Empty means the working directory.
+
+		FFTWisdomKey	currentKey;	// Key whose wisdom is currently loaded in FFTW.
+		u32				precisionBits; // Of the plans made between Begin and End.
+		FFTPlanningMode	planningMode;
+		float			timeLimit;	// Seconds FFTW may spend on a single plan. <= 0 means no limit.
+		bool			dirty;		// New wisdom was measured since the last save.
+
+		Statistics		statistics;
+	};
+}
@@ -133,6 +133,22 @@ namespace acqua
 			return component;
 		}
 
+		template <typename T>
+		const T* GetComponent() const
+		{
+			T c;
+			const T* component = NULL;
+
+			std::map<ComponentType, Component*>::const_iterator it;
+			it = components.find(c.GetType());
+			if(it != components.end())
+			{
+				component = dynamic_cast<const T*>(it->second);
+			}
+
+			return component;
+		}
+
 		template <typename T>
 		bool HasComponent() const 
 		{
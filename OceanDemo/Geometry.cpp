@@ -27,6 +27,7 @@ namespace acqua
 			return false;
 		}
 
+		Unload();
 		graphicsContext = graphics_context;
 
 		vertexLayout = graphicsContext->AddVertexLayout(num_attributes, attributes);
@@ -49,6 +50,20 @@ namespace acqua
 		return true;
 	}
 
+	void Geometry::Unload()
+	{
+		if(graphicsContext == NULL)
+			return;
+
+		graphicsContext->DestroyVertexArray(vertexArray);
+		graphicsContext->DestroyBuffer(indexBuffer);
+		graphicsContext->DestroyBuffer(vertexBuffer);
+		graphicsContext->RemoveVertexLayout(vertexLayout);
+
+		indexBuffer = vertexBuffer = vertexArray = vertexLayout = 0;
+		indexCount = vertexCount = 0;
+	}
+
 	void Geometry::UpdateVertexData( void* vertex_data, u32 offset )
 	{
 		ASSERT(graphicsContext != NULL, "Graphics Context cannot be null.");
@@ -16,8 +16,12 @@ namespace acqua
 		~Geometry(void);
 
 		// TODO: One day, make a file format and stream a bunch of data, please.
+		// Replaces what was loaded before.
 		bool Load(GraphicsContext* graphics_context, const void* vertex_data, u32 num_vertices, const void* index_data, u32 num_indices, const VertexLayoutAttrib* attributes, u32 num_attributes);
 
+		// Releases the buffers, vertex array and layout.
+		void Unload();
+
 		void UpdateVertexData(void* vertex_data, u32 offset);
 
 	private:
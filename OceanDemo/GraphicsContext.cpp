@@ -218,6 +218,18 @@ namespace acqua
 		return vertexArrays.Add(vao); // Return the handle to the VAO.
 	}
 
+	void GraphicsContext::DestroyVertexArray(u32 handle)
+	{
+		if(handle == 0)
+			return;
+
+		GCVertexArray& vao = vertexArrays.GetRef(handle);
+
+		glDeleteVertexArrays(1, &vao.glObj);
+
+		vertexArrays.Remove(handle);
+	}
+
 	// Vertex Layouts.
 	u32 GraphicsContext::AddVertexLayout(u32 num_attribs, const VertexLayoutAttrib* attribs)
 	{
@@ -238,6 +250,14 @@ namespace acqua
 		return vertexLayouts.Add(vl); // TODO: This does an extra copy. Maybe it's better to use a simple array in this class with a maximum size.
 	}
 
+	void GraphicsContext::RemoveVertexLayout(u32 vertex_layout_handle)
+	{
+		if(vertex_layout_handle == 0)
+			return;
+
+		vertexLayouts.Remove(vertex_layout_handle);
+	}
+
 	//	Shaders.
 	u32 GraphicsContext::CreateShader(ShaderType type, const char* source)
 	{
@@ -354,6 +374,12 @@ namespace acqua
 		case TextureFormats::RGBA32F:
 			tex.glFormat = GL_RGBA32F_ARB;
 			break;
+		case TextureFormats::RG16F:
+			tex.glFormat = GL_RG16F;
+			break;
+		case TextureFormats::RG32F:
+			tex.glFormat = GL_RG32F;
+			break;
 		case TextureFormats::DEPTH:
 			tex.glFormat = GL_DEPTH_COMPONENT24;
 			break;
@@ -394,10 +420,21 @@ namespace acqua
 		switch( format )
 		{
 		case TextureFormats::RGBA16F:
+			input_format = GL_RGBA;
+			input_type = GL_HALF_FLOAT;
+			break;
 		case TextureFormats::RGBA32F:
 			input_format = GL_RGBA;
 			input_type = GL_FLOAT;
 			break;
+		case TextureFormats::RG16F:
+			input_format = GL_RG;
+			input_type = GL_HALF_FLOAT;
+			break;
+		case TextureFormats::RG32F:
+			input_format = GL_RG;
+			input_type = GL_FLOAT;
+			break;
 		case TextureFormats::RGB:
 			input_format = GL_RGB;
 			input_type = GL_UNSIGNED_BYTE;
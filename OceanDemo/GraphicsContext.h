@@ -113,8 +113,10 @@ namespace acqua
 			RGB,
 			RGBA,
 			BGRA8,
-			RGBA16F,
+			RGBA16F,	// Uploaded from half floats.
 			RGBA32F,
+			RG16F,		// Uploaded from half floats.
+			RG32F,
 			DEPTH
 		};
 	};
@@ -177,10 +179,12 @@ namespace acqua
 
 		// Vertex Arrays.
 		u32 CreateVertexArray(u32 vertex_buffer, u32 index_buffer, u32 vertex_layout);
+		void DestroyVertexArray(u32 handle);
 
 		// Vertex Layouts.
 		u32 AddVertexLayout(u32 num_attribs, const VertexLayoutAttrib* attribs);
 		GCVertexLayout& GetVertexLayout(u32 vertex_layout_handle) { return vertexLayouts.GetRef(vertex_layout_handle); }
+		void RemoveVertexLayout(u32 vertex_layout_handle);
 
 		// Shaders.
 		u32 CreateShader(ShaderType type, const char* source);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Types.h"
+
+#include <cstring>
+
+namespace acqua
+{
+	// IEEE 754 binary16, the layout of GL_HALF_FLOAT. Only a storage format, arithmetic goes through float.
+	struct Half
+	{
+		u16 bits;
+	};
+
+	// Rounds to the nearest half, ties to even. Overflows to infinity, NaNs stay NaNs.
+	// After F. Giesen's float_to_half_fast3_rtne.
+	inline Half FloatToHalf(float value)
+	{
+		const u32 f32_infinity = 255u << 23;
+		const u32 f16_overflow = (127u + 16u) << 23;	// Smallest float rounding to a half infinity.
+		const u32 f16_normal = 113u << 23;				// Smallest float with a normal half, 2^-14.
+		const u32 denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+		u32 f;
+		memcpy(&f, &value, sizeof(f));
+
+		u32 sign = f & 0x80000000u;
+		f ^= sign;
+
+		Half half;
+		if(f >= f16_overflow)
+		{
+			half.bits = static_cast<u16>(f > f32_infinity ? 0x7E00 : 0x7C00);
+		}
+		else if(f < f16_normal)
+		{
+			// Adding 0.5 shifts the mantissa of a denormal half in place, and the FPU does the rounding.
+			float magic;
+			memcpy(&magic, &denormal_magic, sizeof(magic));
+
+			float shifted;
+			memcpy(&shifted, &f, sizeof(shifted));
+			shifted += magic;
+			memcpy(&f, &shifted, sizeof(f));
+
+			half.bits = static_cast<u16>(f - denormal_magic);
+		}
+		else
+		{
+			// Rebias the exponent and round the 13 dropped bits, ties to the even mantissa.
+			u32 mantissa_odd = (f >> 13) & 1;
+			f += (static_cast<u32>(15 - 127) << 23) + 0xFFF;
+			f += mantissa_odd;
+			half.bits = static_cast<u16>(f >> 13);
+		}
+
+		half.bits |= static_cast<u16>(sign >> 16);
+		return half;
+	}
+
+	// Exact, every half is a float.
+	inline float HalfToFloat(Half half)
+	{
+		const u32 shifted_exponent = 0x7C00u << 13;
+		const u32 denormal_magic = 113u << 23;
+
+		u32 f = (half.bits & 0x7FFFu) << 13;
+		u32 exponent = f & shifted_exponent;
+		f += (127u - 15u) << 23;
+
+		if(exponent == shifted_exponent)
+		{
+			f += (128u - 16u) << 23; // Infinity or NaN.
+		}
+		else if(exponent == 0)
+		{
+			// Denormal, renormalised by the FPU.
+			f += 1u << 23;
+
+			float value, magic;
+			memcpy(&value, &f, sizeof(value));
+			memcpy(&magic, &denormal_magic, sizeof(magic));
+			value -= magic;
+			memcpy(&f, &value, sizeof(f));
+		}
+
+		f |= static_cast<u32>(half.bits & 0x8000u) << 16;
+
+		float value;
+		memcpy(&value, &f, sizeof(value));
+		return value;
+	}
+
+	// Texels of the simulation outputs are either float or Half. Code templated on the texel type goes through these,
+	// which are a plain copy for float.
+	inline void StoreTexel(float& texel, float value) { texel = value; }
+	inline void StoreTexel(Half& texel, float value) { texel = FloatToHalf(value); }
+	inline float LoadTexel(float texel) { return texel; }
+	inline float LoadTexel(Half texel) { return HalfToFloat(texel); }
+}
@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace acqua
+{
+	MappedFile::MappedFile( void ) :
+		data(NULL)
+		, size(0)
+		, fileHandle(NULL)
+		, mappingHandle(NULL)
+		, fileDescriptor(-1)
+	{
+	}
+
+	MappedFile::~MappedFile( void )
+	{
+		Close();
+	}
+
+	bool MappedFile::Open( const String& path )
+	{
+		Close();
+
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+		fileHandle = file;
+
+		LARGE_INTEGER file_size;
+		if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 || static_cast<unsigned long long>(file_size.QuadPart) > static_cast<size_t>(-1))
+		{
+			Close();
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(mapping == NULL)
+		{
+			Close();
+			return false;
+		}
+		mappingHandle = mapping;
+
+		data = static_cast<const u8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		size = static_cast<size_t>(file_size.QuadPart);
+#else
+		fileDescriptor = open(path.c_str(), O_RDONLY);
+		if(fileDescriptor < 0)
+			return false;
+
+		struct stat file_stat;
+		if(fstat(fileDescriptor, &file_stat) != 0 || file_stat.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+
+		void* view = mmap(NULL, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		if(view != MAP_FAILED)
+		{
+			data = static_cast<const u8*>(view);
+			size = static_cast<size_t>(file_stat.st_size);
+		}
+#endif
+
+		if(data == NULL)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#if defined(_WIN32)
+		if(data != NULL)
+			UnmapViewOfFile(data);
+		if(mappingHandle != NULL)
+			CloseHandle(static_cast<HANDLE>(mappingHandle));
+		if(fileHandle != NULL)
+			CloseHandle(static_cast<HANDLE>(fileHandle));
+#else
+		if(data != NULL)
+			munmap(const_cast<u8*>(data), size);
+		if(fileDescriptor >= 0)
+			close(fileDescriptor);
+#endif
+
+		data = NULL;
+		size = 0;
+		fileHandle = NULL;
+		mappingHandle = NULL;
+		fileDescriptor = -1;
+	}
+
+	void MappedFile::Prefetch( size_t offset, size_t bytes ) const
+	{
+		if(data == NULL || offset >= size)
+			return;
+
+		bytes = std::min(bytes, size - offset);
+
+#if defined(_WIN32)
+		// PrefetchVirtualMemory needs Windows 8, so the pages are left to Touch.
+		(void)bytes;
+#else
+		// madvise wants a page aligned start.
+		size_t page = GetPageSize();
+		size_t begin = offset - offset % page;
+		madvise(const_cast<u8*>(data) + begin, bytes + (offset - begin), MADV_WILLNEED);
+#endif
+	}
+
+	void MappedFile::Touch( size_t offset, size_t bytes ) const
+	{
+		if(data == NULL || offset >= size)
+			return;
+
+		size_t end = std::min(offset + bytes, size);
+		size_t page = GetPageSize();
+
+		// One read per page faults it in. Volatile so the reads aren't optimised away.
+		volatile u8 sink = 0;
+		for(size_t i = offset; i < end; i += page)
+			sink += data[i];
+		sink += data[end - 1];
+	}
+
+	size_t MappedFile::GetPageSize()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Types.h"
+
+#include <cstddef>
+
+namespace acqua
+{
+	// Read only view of a whole file mapped in memory. Pages are read from disk the first time they are touched.
+	class MappedFile
+	{
+	public:
+		MappedFile(void);
+		~MappedFile(void);
+
+		// Maps the file at path. False if it can't be opened or is empty.
+		bool Open(const String& path);
+		void Close();
+
+		bool IsOpen() const { return data != NULL; }
+		const u8* GetData() const { return data; }
+		size_t GetSize() const { return size; }
+
+		// Asks for the pages of [offset, offset + bytes) to be read ahead. Returns before they are.
+		void Prefetch(size_t offset, size_t bytes) const;
+
+		// Reads the pages of [offset, offset + bytes) in the calling thread, so they are resident when it returns.
+		void Touch(size_t offset, size_t bytes) const;
+
+		static size_t GetPageSize();
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+	private:
+		const u8* data;
+		size_t size;
+
+		// Platform handles. HANDLEs of the file and the mapping on Windows, a file descriptor elsewhere.
+		void* fileHandle;
+		void* mappingHandle;
+		int fileDescriptor;
+	};
+}
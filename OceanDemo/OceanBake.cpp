@@ -0,0 +1,352 @@
+#include "OceanBake.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace acqua
+{
+	// FNV-1a, 64 bits.
+	class SettingsHasher
+	{
+	public:
+		SettingsHasher() : hash(14695981039346656037ull) {}
+
+		void Add(const void* bytes, size_t count)
+		{
+			const u8* p = static_cast<const u8*>(bytes);
+			for(size_t i = 0; i < count; ++i)
+			{
+				hash ^= p[i];
+				hash *= 1099511628211ull;
+			}
+		}
+
+		void Add(Real value) { Add(&value, sizeof(value)); }
+		void Add(u32 value) { Add(&value, sizeof(value)); }
+		void Add(int value) { Add(&value, sizeof(value)); }
+		void Add(bool value) { Add(static_cast<u32>(value ? 1 : 0)); }
+
+		u64 Get() const { return hash; }
+
+	private:
+		u64 hash;
+	};
+
+	static size_t AlignUp(size_t bytes, size_t alignment)
+	{
+		return (bytes + alignment - 1) / alignment * alignment;
+	}
+
+	OceanBakeHeader::OceanBakeHeader() :
+		magic(k_OceanBakeMagic)
+		, version(k_OceanBakeVersion)
+		, cascadeCount(0)
+		, frameCount(0)
+		, texelBytes(sizeof(OceanTexel))
+		, frameStep(0.0f)
+		, period(0.0f)
+		, settingsHash(0)
+		, frameOffset(0)
+		, frameStride(0)
+	{
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			M[c] = N[c] = 0;
+			LX[c] = LZ[c] = 0.0f;
+			displacementOffset[c] = slopeOffset[c] = 0;
+		}
+	}
+
+	u64 HashOceanSettings( const OceanSettings& settings )
+	{
+		// Fields one at a time, the padding of the struct isn't initialised. The FFT plans, threads and
+		// instruction set only change how fast the same ocean is simulated, so they're left out.
+		SettingsHasher hasher;
+		hasher.Add(settings.seed);
+		hasher.Add(settings.V);
+		hasher.Add(settings.l);
+		hasher.Add(settings.A);
+		hasher.Add(settings.W);
+		hasher.Add(settings.windAlignment);
+		hasher.Add(settings.dampReflections);
+		hasher.Add(settings.depth);
+		hasher.Add(settings.chopAmount);
+		hasher.Add(settings.pruneThreshold);
+		hasher.Add(settings.foamSlopeRatio);
+		hasher.Add(settings.foamFader);
+		hasher.Add(settings.jacobianFoam);
+		hasher.Add(settings.foamJacobianLimit);
+		hasher.Add(settings.spectralNormals);
+
+		u32 cascade_count = std::min(settings.cascadeCount, k_MaxOceanCascades);
+		hasher.Add(cascade_count);
+		for(u32 c = 0; c < cascade_count; ++c)
+		{
+			const CascadeSettings& cascade = settings.cascades[c];
+			hasher.Add(cascade.patchSize);
+			hasher.Add(cascade.resolution);
+			hasher.Add(cascade.minWavelength);
+			hasher.Add(cascade.maxWavelength);
+			hasher.Add(cascade.updateRate);
+		}
+
+		hasher.Add(settings.loop);
+		if(settings.loop)
+			hasher.Add(settings.loopPeriod);
+
+		return hasher.Get();
+	}
+
+	void LayoutOceanBake( OceanBakeHeader& header )
+	{
+		size_t offset = 0;
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			size_t texel_count = (c < header.cascadeCount) ? static_cast<size_t>(header.M[c]) * header.N[c] : 0;
+
+			header.displacementOffset[c] = static_cast<u32>(offset);
+			offset += texel_count * 4 * header.texelBytes;
+			header.slopeOffset[c] = static_cast<u32>(offset);
+			offset += texel_count * 2 * header.texelBytes;
+		}
+
+		header.frameOffset = static_cast<u32>(AlignUp(sizeof(OceanBakeHeader), k_OceanBakeAlignment));
+		header.frameStride = static_cast<u32>(AlignUp(offset, k_OceanBakeAlignment));
+	}
+
+	// Writer.
+
+	OceanBakeWriter::OceanBakeWriter( void ) :
+		file(NULL)
+		, written(0)
+		, failed(false)
+	{
+	}
+
+	OceanBakeWriter::~OceanBakeWriter( void )
+	{
+		Close();
+	}
+
+	bool OceanBakeWriter::Open( const String& path, const OceanBakeHeader& new_header )
+	{
+		Close();
+
+		header = new_header;
+		header.magic = k_OceanBakeMagic;
+		header.version = k_OceanBakeVersion;
+		header.frameCount = 0;
+		header.texelBytes = sizeof(OceanTexel);
+		LayoutOceanBake(header);
+
+		file = fopen(path.c_str(), "wb");
+		if(file == NULL)
+			return false;
+
+		// The header is written again with the frame count when closing.
+		failed = false;
+		Write(&header, sizeof(header));
+		Pad(header.frameOffset - sizeof(header));
+		return !failed;
+	}
+
+	bool OceanBakeWriter::WriteFrame( const OceanTexel* const* displacement, const OceanTexel* const* slope )
+	{
+		if(file == NULL)
+			return false;
+
+		written = 0;
+		for(u32 c = 0; c < header.cascadeCount; ++c)
+		{
+			size_t texel_count = static_cast<size_t>(header.M[c]) * header.N[c];
+			Write(displacement[c], texel_count * 4 * sizeof(OceanTexel));
+			Write(slope[c], texel_count * 2 * sizeof(OceanTexel));
+		}
+		Pad(header.frameStride - written);
+
+		if(!failed)
+			++header.frameCount;
+
+		return !failed;
+	}
+
+	bool OceanBakeWriter::Close()
+	{
+		if(file == NULL)
+			return false;
+
+		if(fseek(file, 0, SEEK_SET) != 0)
+			failed = true;
+		Write(&header, sizeof(header));
+
+		if(fclose(file) != 0)
+			failed = true;
+		file = NULL;
+
+		return !failed;
+	}
+
+	bool OceanBakeWriter::Write( const void* bytes, size_t count )
+	{
+		if(count > 0 && fwrite(bytes, 1, count, file) != count)
+			failed = true;
+
+		written += count;
+		return !failed;
+	}
+
+	bool OceanBakeWriter::Pad( size_t count )
+	{
+		static const u8 zeros[256] = { 0 };
+		while(count > 0)
+		{
+			size_t chunk = std::min(count, sizeof(zeros));
+			Write(zeros, chunk);
+			count -= chunk;
+		}
+
+		return !failed;
+	}
+
+	// Player.
+
+	OceanBakePlayer::OceanBakePlayer( void ) :
+		readAheadFrames(0)
+		, requestedFrame(~0u)
+		, stopReadAhead(false)
+	{
+	}
+
+	OceanBakePlayer::~OceanBakePlayer( void )
+	{
+		Close();
+	}
+
+	bool OceanBakePlayer::Open( const String& file_path, u32 read_ahead_frames )
+	{
+		Close();
+
+		if(!file.Open(file_path))
+			return false;
+
+		if(file.GetSize() < sizeof(OceanBakeHeader))
+		{
+			Close();
+			return false;
+		}
+		memcpy(&header, file.GetData(), sizeof(header));
+
+		// Everything the header points at has to be inside the file and where LayoutOceanBake puts it.
+		OceanBakeHeader layout = header;
+		LayoutOceanBake(layout);
+
+		bool valid = header.magic == k_OceanBakeMagic && header.version == k_OceanBakeVersion && header.texelBytes == sizeof(OceanTexel)
+			&& header.cascadeCount >= 1 && header.cascadeCount <= k_MaxOceanCascades && header.frameCount > 0 && header.frameStep > 0.0f
+			&& header.frameOffset == layout.frameOffset && header.frameStride == layout.frameStride
+			&& memcmp(header.displacementOffset, layout.displacementOffset, sizeof(layout.displacementOffset)) == 0
+			&& memcmp(header.slopeOffset, layout.slopeOffset, sizeof(layout.slopeOffset)) == 0
+			&& header.frameOffset + static_cast<u64>(header.frameCount) * header.frameStride <= file.GetSize();
+
+		for(u32 c = 0; valid && c < header.cascadeCount; ++c)
+		{
+			valid = header.M[c] > 0 && header.N[c] > 0 && header.LX[c] > 0.0f && header.LZ[c] > 0.0f;
+		}
+
+		if(!valid)
+		{
+			Close();
+			return false;
+		}
+
+		path = file_path;
+		readAheadFrames = std::min(read_ahead_frames, header.frameCount - 1);
+		if(readAheadFrames > 0)
+		{
+			stopReadAhead = false;
+			requestedFrame = ~0u;
+			readAheadThread = std::thread(&OceanBakePlayer::ReadAheadLoop, this);
+		}
+
+		return true;
+	}
+
+	void OceanBakePlayer::Close()
+	{
+		StopReadAhead();
+		file.Close();
+		path.clear();
+		header = OceanBakeHeader();
+		readAheadFrames = 0;
+	}
+
+	void OceanBakePlayer::ReadAhead( u32 frame )
+	{
+		if(readAheadFrames == 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(readAheadMutex);
+			requestedFrame = frame;
+		}
+		readAheadRequested.notify_one();
+	}
+
+	void OceanBakePlayer::StopReadAhead()
+	{
+		if(!readAheadThread.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(readAheadMutex);
+			stopReadAhead = true;
+		}
+		readAheadRequested.notify_one();
+		readAheadThread.join();
+	}
+
+	void OceanBakePlayer::ReadAheadLoop()
+	{
+		// Frames ahead of the presented one that are already loaded, [loaded_begin, loaded_begin + loaded_count).
+		u32 loaded_begin = 0;
+		u32 loaded_count = 0;
+
+		for(;;)
+		{
+			u32 frame = 0;
+			{
+				std::unique_lock<std::mutex> lock(readAheadMutex);
+				while(requestedFrame == ~0u && !stopReadAhead)
+					readAheadRequested.wait(lock);
+
+				if(stopReadAhead)
+					return;
+
+				frame = requestedFrame;
+				requestedFrame = ~0u;
+			}
+
+			// Playing forward only needs the frames that came into the window, anything else loads it all again.
+			u32 first = (frame + 1) % header.frameCount;
+			u32 skip = 0;
+			u32 distance = (first + header.frameCount - loaded_begin) % header.frameCount;
+			if(distance < loaded_count)
+				skip = loaded_count - distance;
+
+			// Ask for the whole window, then wait for it frame by frame from the nearest one.
+			for(u32 i = skip; i < readAheadFrames; ++i)
+			{
+				u32 f = (first + i) % header.frameCount;
+				file.Prefetch(GetFrame(f) - file.GetData(), header.frameStride);
+			}
+
+			for(u32 i = skip; i < readAheadFrames; ++i)
+			{
+				u32 f = (first + i) % header.frameCount;
+				file.Touch(GetFrame(f) - file.GetData(), header.frameStride);
+			}
+
+			loaded_begin = first;
+			loaded_count = readAheadFrames;
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Types.h"
+#include "MappedFile.h"
+#include "OceanCascade.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace acqua
+{
+	// Baked ocean sequences.
+	// A header followed by frameCount frames. Each frame is a chunk starting on a k_OceanBakeAlignment boundary
+	// and holds the texels of every cascade packed like the displacement maps, so a frame can be mapped and uploaded as is.
+
+	const u32 k_OceanBakeMagic = 0x42514341; // "ACQB".
+	const u32 k_OceanBakeVersion = 2; // 2 added texelBytes.
+	const u32 k_OceanBakeAlignment = 4096; // Multiple of the page size on the platforms we run on.
+
+	struct OceanBakeHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 cascadeCount;
+		u32 frameCount;
+		u32 texelBytes; // Of every channel of the texels, sizeof(OceanTexel) of the build that baked it. Only that build plays it back.
+
+		// Cascades. Patch sizes in world units.
+		u32 M[k_MaxOceanCascades];
+		u32 N[k_MaxOceanCascades];
+		Real LX[k_MaxOceanCascades];
+		Real LZ[k_MaxOceanCascades];
+
+		Real frameStep; // Seconds between two frames.
+		Real period; // Seconds after which the sequence repeats exactly. 0 when it doesn't.
+		u64 settingsHash; // HashOceanSettings of the settings it was baked from.
+
+		// Layout, in bytes. Filled in by LayoutOceanBake.
+		u32 frameOffset; // From the start of the file to the first frame.
+		u32 frameStride; // From one frame to the next.
+		u32 displacementOffset[k_MaxOceanCascades]; // From the start of a frame. (N, M, 4) texels.
+		u32 slopeOffset[k_MaxOceanCascades]; // (N, M, 2) texels.
+
+		OceanBakeHeader();
+	};
+
+	// Hash of everything in the settings that changes the simulated ocean.
+	u64 HashOceanSettings(const OceanSettings& settings);
+
+	// Fills in the layout of the header from its cascades.
+	void LayoutOceanBake(OceanBakeHeader& header);
+
+	// Writes a baked sequence one frame at a time.
+	class OceanBakeWriter
+	{
+	public:
+		OceanBakeWriter(void);
+		~OceanBakeWriter(void);
+
+		// Creates the file for the cascades, frame step, period and settings hash of header.
+		bool Open(const String& path, const OceanBakeHeader& header);
+
+		// Appends a frame. displacement[c] and slope[c] are the texels of cascade c.
+		bool WriteFrame(const OceanTexel* const* displacement, const OceanTexel* const* slope);
+
+		// Writes the final header and closes the file. False if any write failed.
+		bool Close();
+
+		const OceanBakeHeader& GetHeader() const { return header; }
+
+	private:
+		OceanBakeWriter(const OceanBakeWriter&);
+		OceanBakeWriter& operator=(const OceanBakeWriter&);
+
+		bool Write(const void* bytes, size_t count);
+		bool Pad(size_t count);
+
+	private:
+		FILE* file;
+		OceanBakeHeader header;
+		size_t written; // Bytes of the current frame.
+		bool failed;
+	};
+
+	// Plays a baked sequence back from a mapping of the file. The texels are read in place.
+	// A thread of its own reads the frames after the one being presented, so they're resident before they're needed.
+	class OceanBakePlayer
+	{
+	public:
+		OceanBakePlayer(void);
+		~OceanBakePlayer(void);
+
+		// Maps the file and checks its header. Up to read_ahead_frames frames are loaded ahead of the presented one.
+		bool Open(const String& path, u32 read_ahead_frames);
+		void Close();
+
+		bool IsOpen() const { return file.IsOpen(); }
+		const String& GetPath() const { return path; }
+		const OceanBakeHeader& GetHeader() const { return header; }
+
+		// Texels of cascade c in frame, inside the mapping. Valid until the file is closed.
+		const OceanTexel* GetDisplacement(u32 frame, u32 c) const { return reinterpret_cast<const OceanTexel*>(GetFrame(frame) + header.displacementOffset[c]); }
+		const OceanTexel* GetSlope(u32 frame, u32 c) const { return reinterpret_cast<const OceanTexel*>(GetFrame(frame) + header.slopeOffset[c]); }
+
+		// Tells the read ahead thread frame is being presented. The sequence wraps around.
+		void ReadAhead(u32 frame);
+
+	private:
+		OceanBakePlayer(const OceanBakePlayer&);
+		OceanBakePlayer& operator=(const OceanBakePlayer&);
+
+		const u8* GetFrame(u32 frame) const { return file.GetData() + header.frameOffset + static_cast<size_t>(frame) * header.frameStride; }
+
+		void StopReadAhead();
+		void ReadAheadLoop();
+
+	private:
+		MappedFile file;
+		String path;
+		OceanBakeHeader header;
+		u32 readAheadFrames;
+
+		std::thread readAheadThread;
+		std::mutex readAheadMutex;
+		std::condition_variable readAheadRequested;
+		u32 requestedFrame; // Protected by readAheadMutex, like stopReadAhead. ~0 when nothing is requested.
+		bool stopReadAhead;
+	};
+}
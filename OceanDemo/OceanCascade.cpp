@@ -0,0 +1,1092 @@
+#include "OceanCascade.h"
+#include "CounterRandom.h"
+#include "DebugUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define ACQUA_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#define PHASE_RENORMALIZE_PERIOD 64 // Steps between two renormalisations of the phases.
+#define PHASE_STEP_TOLERANCE 1e-3f // Relative dt difference for which the cached rotations are reused.
+#define PHASE_MAX_STEP 1.0f // Longer dt are evaluated exactly.
+#define PHASE_MAX_POLY_ANGLE 0.25f // Largest angle the rotation polynomial is evaluated at.
+#define ACTIVE_SPAN_MIN_GAP 8 // Pruned bins under which two spans of active bins are merged into one.
+#define BOUNDS_TILE_SIZE 8 // Texels per side of the finest tiles of the bounds pyramid.
+#define BOUNDS_PARALLEL_MIN_ROWS 16 // Coarser levels of the bounds pyramid with fewer rows of tiles are merged on the calling thread.
+
+namespace acqua
+{
+	// utilities.
+	template <typename T> static inline T Sqr(T x) { return x*x; }
+
+	// min_values = min(min_values, values) and max_values = max(max_values, values), element wise.
+	template <typename T>
+	static void AccumulateBounds(int count, const T* values, T* min_values, T* max_values)
+	{
+		for(int n = 0; n < count; ++n)
+		{
+			min_values[n] = std::min(min_values[n], values[n]);
+			max_values[n] = std::max(max_values[n], values[n]);
+		}
+	}
+
+#if defined(ACQUA_SSE2)
+	// Same, 4 values at a time.
+	static void AccumulateBounds(int count, const float* values, float* min_values, float* max_values)
+	{
+		int n = 0;
+		for(; n + 4 <= count; n += 4)
+		{
+			__m128 v = _mm_loadu_ps(values + n);
+			_mm_storeu_ps(min_values + n, _mm_min_ps(_mm_loadu_ps(min_values + n), v));
+			_mm_storeu_ps(max_values + n, _mm_max_ps(_mm_loadu_ps(max_values + n), v));
+		}
+
+		AccumulateBounds<float>(count - n, values + n, min_values + n, max_values + n);
+	}
+#endif
+
+	typedef std::chrono::high_resolution_clock StageClock;
+
+	// Seconds since start, then restarts it for the next stage.
+	static double LapSeconds(StageClock::time_point& start)
+	{
+		StageClock::time_point now = StageClock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	}
+
+	// Threads FFTW plans run with, as many as the pool has once FFTW threading is up in the library of precision T.
+	template <typename T>
+	static u32 GetFFTWThreadCount(const WorkerPool& pool)
+	{
+		static bool fftw_threads_initialized = (FFTW<T>::InitThreads() != 0);
+		return fftw_threads_initialized ? pool.GetThreadCount() : 1;
+	}
+
+	static bool HasSmallFactorsOnly(u32 size)
+	{
+		const u32 factors[] = { 2, 3, 5, 7 };
+		for(u32 f = 0; f < 4; ++f)
+		{
+			while(size % factors[f] == 0)
+				size /= factors[f];
+		}
+
+		return size == 1;
+	}
+
+	u32 GetFFTSize( u32 resolution )
+	{
+		const u32 min_size = 8;
+		u32 size = std::max(resolution, min_size);
+
+		// Looks both ways, the smaller size wins a tie.
+		for(u32 distance = 0; ; ++distance)
+		{
+			u32 below = size - distance;
+			if(below >= min_size && below % 2 == 0 && HasSmallFactorsOnly(below))
+				return below;
+
+			u32 above = size + distance;
+			if(above % 2 == 0 && HasSmallFactorsOnly(above))
+				return above;
+		}
+	}
+
+	template <typename T>
+	OceanCascadeT<T>::OceanCascadeT( void )
+		: M(0)
+		, N(0)
+		, LX(0.0f)
+		, LZ(0.0f)
+		, patchSize(0.0f)
+		, minWavelength(0.0f)
+		, maxWavelength(0.0f)
+		, updateInterval(0.0f)
+		, loopPeriod(0.0f)
+		, lastUpdateTime(0.0f)
+		, updated(false)
+		, V(2.0f)
+		, L( V * V / k_Gravity )
+		, l(2.0f)
+		, A(1.0f)
+		, W(4.0f)
+		, WX(cos(W)), WZ(-sin(W))
+		, windAlignment(2.0f)
+		, dampReflections(0.5f)
+		, depth(200.0f)
+		, chopAmount(0.5f)
+		, foamSlopeRatio(0.07f)
+		, foamFader(0.1f)
+		, jacobianFoam(true)
+		, foamJacobianLimit(0.75f)
+		, seed(0)
+		, index(0)
+		, pruneThreshold(0.0f)
+		, activeBinCount(0)
+		, prunedEnergyFraction(0.0)
+		, maxOmega(0.0f)
+		, phaseTime(0.0f)
+		, phaseStepDelta(0.0f)
+		, phaseStepCount(0)
+		, phaseValid(false)
+		, kernels(&SpectrumKernelsT<T>::Get(SIMD_SCALAR))
+		, fftFieldCount(0)
+		, batchedFFT(true)
+		, spectralNormals(true)
+		, planningMode(FFT_PLAN_MEASURE)
+		, planningTimeLimit(1.0f)
+		, planThreadCount(0)
+		, batchedPlan(NULL)
+		, displacementYPlan(NULL)
+		, displacementXPlan(NULL)
+		, displacementZPlan(NULL)
+		, normalXPlan(NULL)
+		, normalZPlan(NULL)
+		, jacobianXXPlan(NULL)
+		, jacobianZZPlan(NULL)
+		, jacobianXZPlan(NULL)
+		, workerPool(NULL)
+	{
+		for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+			fftFieldSlot[f] = -1;
+	}
+
+	template <typename T>
+	OceanCascadeT<T>::~OceanCascadeT( void )
+	{
+		DestroyPlans();
+	}
+
+	template <typename T>
+	T OceanCascadeT<T>::Ph( T kx_, T kz_ ) const
+	{
+		T k2 = kx_*kx_ + kz_*kz_;
+
+		if (k2 == 0.0)
+		{
+			return 0.0; // no DC component
+		}
+
+		// Waves outside the band of this cascade belong to another one.
+		T wavelength = Wavelength(sqrt(k2));
+		if((minWavelength > 0.0f && wavelength < minWavelength) || (maxWavelength > 0.0f && wavelength >= maxWavelength))
+		{
+			return 0.0;
+		}
+
+		// damp out the waves going in the direction opposite the wind
+		T tmp = (WX * kx_  + WZ * kz_)/sqrt(k2);
+		if (tmp < 0)
+		{
+			tmp *= dampReflections;
+		}
+
+		return A * exp( -1.0f / (k2*Sqr(L))) * exp(-k2 * Sqr(l)) * pow(fabs(tmp),windAlignment) / (k2*k2);
+	}
+
+	template <typename T>
+	bool OceanCascadeT<T>::NeedsUpdate( T t ) const
+	{
+		return !updated || t < lastUpdateTime || t - lastUpdateTime >= updateInterval;
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::Simulate( T t, T scale )
+	{
+		StageClock::time_point stage_start = StageClock::now();
+
+		updated = true;
+		lastUpdateTime = t;
+		++timings.simulations;
+
+		// Bring the phases to t, then evolve h0 and build the spectra of all the fields in one pass.
+		// Rows are independent, so they are split among the worker threads.
+		u32 halvings = 0;
+		PhaseUpdate phase_update = PreparePhaseUpdate(t, halvings);
+		bool renormalize = (phase_update == PHASE_STEP || phase_update == PHASE_REBUILD_STEP) && (phaseStepCount % PHASE_RENORMALIZE_PERIOD == 0);
+		T dt = phaseStepDelta;
+
+		const SpectrumKernelsT<T>& kernel = *kernels;
+		u32 num_bins = N / 2 + 1; // See the fftw docs about the mechanics of the complex->real fft storage.
+
+		// Slopes are wanted per world unit. A simulation unit is k_OceanWorldScale world units wide.
+		T slope_scale_x = scale / k_OceanWorldScale;
+		T slope_scale_z = scale / k_OceanWorldScale;
+
+		// Same for the derivatives of the chop displacement, which is also scaled when it moves the vertices.
+		T jacobian_scale_x = k_HorizontalDisplacementScale * chopAmount * slope_scale_x;
+		T jacobian_scale_z = k_HorizontalDisplacementScale * chopAmount * slope_scale_z;
+		T jacobian_scale_xz = sqrt(jacobian_scale_x * jacobian_scale_z);
+
+		int slot_y = fftFieldSlot[FFT_DISPLACEMENT_Y];
+		int slot_x = fftFieldSlot[FFT_DISPLACEMENT_X];
+		int slot_z = fftFieldSlot[FFT_DISPLACEMENT_Z];
+		int slot_slope_x = fftFieldSlot[FFT_SLOPE_X];
+		int slot_slope_z = fftFieldSlot[FFT_SLOPE_Z];
+		int slot_xx = fftFieldSlot[FFT_JACOBIAN_XX];
+		int slot_zz = fftFieldSlot[FFT_JACOBIAN_ZZ];
+		int slot_xz = fftFieldSlot[FFT_JACOBIAN_XZ];
+
+		workerPool->ParallelFor(0, M, [&](int row_begin, int row_end)
+		{
+			for(int i = row_begin; i < row_end; ++i)
+			{
+				// Only the spans of bins with energy are evolved. The inputs of the others are zeroed, the transforms overwrite them.
+				u32 cleared = 0;
+				for(u32 s = activeRowSpans[i]; s < activeRowSpans[i + 1]; ++s)
+				{
+					const u32 first = activeSpans[s].begin;
+					const int b = static_cast<int>(first);
+					const u32 count = activeSpans[s].end - first;
+
+					ClearInputs(i, cleared, first);
+					cleared = activeSpans[s].end;
+
+					T* phase_re = phase.Re(0, i) + first;
+					T* phase_im = phase.Im(0, i) + first;
+
+					if(phase_update == PHASE_RESYNC)
+					{
+						const T* omega_row = &omega(i, b);
+						for(u32 j = 0; j < count; ++j)
+						{
+							phase_re[j] = cos(omega_row[j] * t);
+							phase_im[j] = sin(omega_row[j] * t);
+						}
+					}
+					else if(phase_update != PHASE_KEEP)
+					{
+						T* step_re = phaseStep.Re(0, i) + first;
+						T* step_im = phaseStep.Im(0, i) + first;
+						if(phase_update == PHASE_REBUILD_STEP)
+							kernel.buildRotations(count, &omega(i, b), dt, halvings, step_re, step_im);
+
+						kernel.rotate(count, phase_re, phase_im, step_re, step_im);
+
+						// The products slowly drift off the unit circle.
+						if(renormalize)
+							kernel.renormalize(count, phase_re, phase_im);
+					}
+
+					SpectrumInputRowT<T> row;
+					row.count = count;
+					row.h0Re = h0.Re(0, i) + first; row.h0Im = h0.Im(0, i) + first;
+					row.h0MinusRe = h0Minus.Re(0, i) + first; row.h0MinusIm = h0Minus.Im(0, i) + first;
+					row.phaseRe = phase_re; row.phaseIm = phase_im;
+					row.kInverse = &kInverse(i, b);
+					row.kz = &kz(b);
+					row.kx = kx(i);
+					row.scale = scale;
+					row.chop = chopAmount;
+					row.slopeScaleX = slope_scale_x;
+					row.slopeScaleZ = slope_scale_z;
+					row.jacobianScaleXX = jacobian_scale_x;
+					row.jacobianScaleZZ = jacobian_scale_z;
+					row.jacobianScaleXZ = jacobian_scale_xz;
+					row.yRe = FFTIn.Re(slot_y, i) + first; row.yIm = FFTIn.Im(slot_y, i) + first;
+					row.xRe = FFTIn.Re(slot_x, i) + first; row.xIm = FFTIn.Im(slot_x, i) + first;
+					row.zRe = FFTIn.Re(slot_z, i) + first; row.zIm = FFTIn.Im(slot_z, i) + first;
+
+					row.slopeXRe = row.slopeXIm = row.slopeZRe = row.slopeZIm = NULL;
+					if(spectralNormals)
+					{
+						row.slopeXRe = FFTIn.Re(slot_slope_x, i) + first; row.slopeXIm = FFTIn.Im(slot_slope_x, i) + first;
+						row.slopeZRe = FFTIn.Re(slot_slope_z, i) + first; row.slopeZIm = FFTIn.Im(slot_slope_z, i) + first;
+					}
+
+					row.xxRe = row.xxIm = row.zzRe = row.zzIm = row.xzRe = row.xzIm = NULL;
+					if(jacobianFoam)
+					{
+						row.xxRe = FFTIn.Re(slot_xx, i) + first; row.xxIm = FFTIn.Im(slot_xx, i) + first;
+						row.zzRe = FFTIn.Re(slot_zz, i) + first; row.zzIm = FFTIn.Im(slot_zz, i) + first;
+						row.xzRe = FFTIn.Re(slot_xz, i) + first; row.xzIm = FFTIn.Im(slot_xz, i) + first;
+					}
+
+					kernel.spectrumInputs(row);
+				}
+
+				ClearInputs(i, cleared, num_bins);
+			}
+		});
+
+		timings.evolution += LapSeconds(stage_start);
+
+		// The plans were made with as many FFTW threads as the pool has.
+		if(batchedFFT)
+		{
+			FFTW<T>::Execute(batchedPlan);
+		}
+		else
+		{
+			for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+			{
+				if(fftFieldSlot[f] >= 0)
+					FFTW<T>::Execute(GetFieldPlan(static_cast<FFTField>(f)));
+			}
+		}
+
+		timings.fft += LapSeconds(stage_start);
+
+		if(!spectralNormals)
+		{
+			ComputeTriangleSlopes();
+			timings.normals += LapSeconds(stage_start);
+		}
+
+		AccumulateFoam(scale);
+		timings.foam += LapSeconds(stage_start);
+
+		BuildBoundsPyramid();
+		timings.bounds += LapSeconds(stage_start);
+	}
+
+	template <typename T>
+	CascadeMemory OceanCascadeT<T>::GetMemory() const
+	{
+		// The fields of the transforms are views on FFTOut and the spectral slopes views on the fields, they are counted once.
+		CascadeMemory memory;
+		memory.spectrum = sizeof(T) * (kx.numElements() + kz.numElements() + k.numElements() + kInverse.numElements() + omega.numElements()) + h0.GetSizeInBytes() + h0Minus.GetSizeInBytes()
+			+ sizeof(BinSpan) * activeSpans.capacity() + sizeof(u32) * activeRowSpans.capacity();
+		memory.evolution = phase.GetSizeInBytes() + phaseStep.GetSizeInBytes();
+		memory.fft = FFTIn.GetSizeInBytes() + sizeof(T) * FFTOut.numElements();
+		memory.outputs = sizeof(T) * foamArray.numElements() + sizeof(Vector3T) * (normalArray.numElements() + faceNormals.numElements())
+			+ sizeof(DisplacementBoundsT<T>) * boundsPyramid.capacity() + sizeof(BoundsLevel) * boundsLevels.capacity() + sizeof(T) * boundsColumns.capacity();
+		if(!spectralNormals)
+			memory.outputs += sizeof(T) * (slopeX.numElements() + slopeZ.numElements());
+		return memory;
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::ClearInputs( int i, u32 begin, u32 end )
+	{
+		if(begin >= end)
+			return;
+
+		for(u32 f = 0; f < fftFieldCount; ++f)
+		{
+			std::fill(FFTIn.Re(f, i) + begin, FFTIn.Re(f, i) + end, T(0));
+			std::fill(FFTIn.Im(f, i) + begin, FFTIn.Im(f, i) + end, T(0));
+		}
+	}
+
+	template <typename T>
+	SpectrumBinT<T> OceanCascadeT<T>::GetSpectrumBin( u32 i, u32 j ) const
+	{
+		ASSERT(i < M && j <= N / 2, "Spectrum bin out of range.");
+
+		const int row = static_cast<int>(i);
+		const int column = static_cast<int>(j);
+
+		SpectrumBinT<T> bin;
+		bin.kx = kx(row);
+		bin.kz = kz(column);
+		bin.fx = 2.0f * k_Pi * (2 * i <= M ? row : row - static_cast<int>(M)) / LX;
+		bin.fz = 2.0f * k_Pi * column / LZ;
+		bin.k = k(row, column);
+		bin.omega = omega(row, column);
+		bin.h0Re = h0.Re(0, i)[j];
+		bin.h0Im = h0.Im(0, i)[j];
+		bin.h0MinusRe = h0Minus.Re(0, i)[j];
+		bin.h0MinusIm = h0Minus.Im(0, i)[j];
+		bin.weight = (j == 0 || 2 * j == N) ? T(1) : T(2);
+		return bin;
+	}
+
+	template <typename T>
+	template <typename Texel>
+	void OceanCascadeT<T>::PackTexels( Texel* displacement_texels, Texel* slope_texels ) const
+	{
+		// The first index of the fields runs along the width of the maps, so texel (x, y) is field(x, y).
+		const int width = static_cast<int>(M);
+		const int height = static_cast<int>(N);
+
+		workerPool->ParallelFor(0, height, [&](int row_begin, int row_end)
+		{
+			for(int y = row_begin; y < row_end; ++y)
+			{
+				Texel* displacement_row = displacement_texels + y * width * 4;
+				Texel* slope_row = slope_texels + y * width * 2;
+				for(int x = 0; x < width; ++x)
+				{
+					StoreTexel(displacement_row[x * 4 + 0], static_cast<float>(k_HorizontalDisplacementScale * displacementX(x, y)));
+					StoreTexel(displacement_row[x * 4 + 1], static_cast<float>(displacementY(x, y)));
+					StoreTexel(displacement_row[x * 4 + 2], static_cast<float>(k_HorizontalDisplacementScale * displacementZ(x, y)));
+					StoreTexel(displacement_row[x * 4 + 3], static_cast<float>(foamArray(x, y)));
+
+					StoreTexel(slope_row[x * 2 + 0], static_cast<float>(slopeX(x, y)));
+					StoreTexel(slope_row[x * 2 + 1], static_cast<float>(slopeZ(x, y)));
+				}
+			}
+		});
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::ComputeTriangleSlopes()
+	{
+		// Texel size in world units.
+		T dx = LX / M * k_OceanWorldScale;
+		T dz = LZ / N * k_OceanWorldScale;
+
+		// Face normals of the two triangles of every quad.
+		workerPool->ParallelFor(0, M, [&](int row_begin, int row_end)
+		{
+			for(int i = row_begin; i < row_end; ++i)
+			{
+				for(int j = 0; j < N; ++j)
+				{
+					int i_plus_one = (i + 1);
+					i_plus_one = i_plus_one >= M ? 0 : i_plus_one;
+					int j_plus_one = (j + 1);
+					j_plus_one = j_plus_one >= N ? 0 : j_plus_one;
+
+					Vector3T v0 = Vector3T(k_HorizontalDisplacementScale * displacementX(i,j), displacementY(i,j), k_HorizontalDisplacementScale * displacementZ(i,j));
+					Vector3T v1 = Vector3T(T(0), T(0), dz) + Vector3T(k_HorizontalDisplacementScale * displacementX(i,j_plus_one), displacementY(i,j_plus_one), k_HorizontalDisplacementScale * displacementZ(i,j_plus_one));
+					Vector3T v2 = Vector3T(dx, T(0), T(0)) + Vector3T(k_HorizontalDisplacementScale * displacementX(i_plus_one,j), displacementY(i_plus_one,j), k_HorizontalDisplacementScale * displacementZ(i_plus_one,j));
+					faceNormals(i, j, 0) = glm::normalize( glm::cross( v1 - v0, v2 - v0 ) );
+
+					//second tri.
+					Vector3T v3 = Vector3T(dx, T(0), dz) + Vector3T(k_HorizontalDisplacementScale * displacementX(i_plus_one,j_plus_one), displacementY(i_plus_one, j_plus_one), k_HorizontalDisplacementScale * displacementZ(i_plus_one, j_plus_one));
+					faceNormals(i, j, 1) = glm::normalize( glm::cross( v1 - v3, v1 - v2 ) );
+				}
+			}
+		});
+
+		// Gather the faces around each texel instead of scattering into the neighbours,
+		// so rows can be processed in parallel and the sums are always done in the same order.
+		// The first triangle of a quad touches (i,j), (i,j+1), (i+1,j), the second (i,j+1), (i+1,j), (i+1,j+1).
+		// The normal of the previous frame is part of the sum, which smooths them over time.
+		workerPool->ParallelFor(0, M, [&](int row_begin, int row_end)
+		{
+			for(int i = row_begin; i < row_end; ++i)
+			{
+				int i_minus_one = (i == 0) ? M - 1 : i - 1;
+				for(int j = 0; j < N; ++j)
+				{
+					int j_minus_one = (j == 0) ? N - 1 : j - 1;
+
+					Vector3T normal = glm::normalize(normalArray(i, j));
+					normal += faceNormals(i, j, 0);
+					normal += faceNormals(i, j_minus_one, 0) + faceNormals(i, j_minus_one, 1);
+					normal += faceNormals(i_minus_one, j, 0) + faceNormals(i_minus_one, j, 1);
+					normal += faceNormals(i_minus_one, j_minus_one, 1);
+
+					normalArray(i, j) = normal;
+
+					// Slopes of the plane with this normal, so cascades can be summed.
+					slopeX(i, j) = -normal.x / normal.y;
+					slopeZ(i, j) = -normal.z / normal.y;
+				}
+			}
+		});
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::AccumulateFoam( T scale )
+	{
+		// Foam builds up where the chop squeezes the surface and fades elsewhere.
+		workerPool->ParallelFor(0, M, [&](int row_begin, int row_end)
+		{
+			for(int i = row_begin; i < row_end; ++i)
+			{
+				int i_minus_one = (i == 0) ? M - 1 : i - 1;
+				for(int j = 0; j < N; ++j)
+				{
+					bool squeezed = false;
+					if(jacobianFoam)
+					{
+						// J = (1 + Jxx)(1 + Jzz) - Jxz^2
+						T jacobian = (1.0f + jacobianXX(i, j)) * (1.0f + jacobianZZ(i, j)) - Sqr(jacobianXZ(i, j));
+						squeezed = jacobian < foamJacobianLimit;
+					}
+					else
+					{
+						int j_minus_one = (j == 0) ? N - 1 : j - 1;
+
+						T jxx = scale * (displacementX(i, j) - displacementX(i_minus_one, j));
+						T jzz = scale * (displacementZ(i, j) - displacementZ(i, j_minus_one));
+						squeezed = std::min(jxx, jzz) < -foamSlopeRatio;
+					}
+
+					T foam_add = squeezed ? foamFader : -foamFader;
+					foamArray(i, j) = glm::clamp(foamArray(i, j) + foam_add, T(0), T(1));
+				}
+			}
+		});
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::BuildBoundsPyramid()
+	{
+		const int texel_rows = static_cast<int>(M);
+		const int texel_cols = static_cast<int>(N);
+
+		// The finest level reads every texel, its rows of tiles are split in one chunk per thread, each with its own scratch.
+		const BoundsLevel& finest = boundsLevels[0];
+		const int chunks = std::min(static_cast<int>(finest.rows), static_cast<int>(boundsColumns.size() / (6 * texel_cols)));
+		workerPool->ParallelFor(0, chunks, [&](int chunk_begin, int chunk_end)
+		{
+			for(int chunk = chunk_begin; chunk < chunk_end; ++chunk)
+			{
+				// Bounds of each column of texels over the rows of a row of tiles, accumulated a row at a time so the fields
+				// are read in order, then reduced across the columns of each tile.
+				T* min_x = &boundsColumns[6 * texel_cols * chunk];
+				T* max_x = min_x + texel_cols;
+				T* min_y = max_x + texel_cols;
+				T* max_y = min_y + texel_cols;
+				T* min_z = max_y + texel_cols;
+				T* max_z = min_z + texel_cols;
+
+				int row_begin = chunk * static_cast<int>(finest.rows) / chunks;
+				int row_end = (chunk + 1) * static_cast<int>(finest.rows) / chunks;
+				for(int r = row_begin; r < row_end; ++r)
+				{
+					int i_begin = r * BOUNDS_TILE_SIZE;
+					const T* x = &displacementX(i_begin, 0);
+					const T* y = &displacementY(i_begin, 0);
+					const T* z = &displacementZ(i_begin, 0);
+					std::copy(x, x + texel_cols, min_x); std::copy(x, x + texel_cols, max_x);
+					std::copy(y, y + texel_cols, min_y); std::copy(y, y + texel_cols, max_y);
+					std::copy(z, z + texel_cols, min_z); std::copy(z, z + texel_cols, max_z);
+
+					// The other rows of texels of the tiles, and the first of the next row of tiles.
+					int i_end = std::min(i_begin + BOUNDS_TILE_SIZE, texel_rows);
+					for(int i = i_begin + 1; i <= i_end; ++i)
+					{
+						int i_wrapped = (i == texel_rows) ? 0 : i;
+						AccumulateBounds(texel_cols, &displacementX(i_wrapped, 0), min_x, max_x);
+						AccumulateBounds(texel_cols, &displacementY(i_wrapped, 0), min_y, max_y);
+						AccumulateBounds(texel_cols, &displacementZ(i_wrapped, 0), min_z, max_z);
+					}
+
+					DisplacementBoundsT<T>* tiles = &boundsPyramid[finest.offset + r * finest.cols];
+					for(u32 c = 0; c < finest.cols; ++c)
+					{
+						// Columns of the tile, starting from the first column of the next tile.
+						int j_begin = static_cast<int>(c) * BOUNDS_TILE_SIZE;
+						int j_end = std::min(j_begin + BOUNDS_TILE_SIZE, texel_cols);
+						int j_next = (j_end == texel_cols) ? 0 : j_end;
+
+						DisplacementBoundsT<T> tile = { min_x[j_next], max_x[j_next], min_y[j_next], max_y[j_next], min_z[j_next], max_z[j_next] };
+						for(int j = j_begin; j < j_end; ++j)
+						{
+							tile.minX = std::min(tile.minX, min_x[j]); tile.maxX = std::max(tile.maxX, max_x[j]);
+							tile.minY = std::min(tile.minY, min_y[j]); tile.maxY = std::max(tile.maxY, max_y[j]);
+							tile.minZ = std::min(tile.minZ, min_z[j]); tile.maxZ = std::max(tile.maxZ, max_z[j]);
+						}
+
+						// The scale is positive, it keeps the order.
+						tile.minX *= k_HorizontalDisplacementScale; tile.maxX *= k_HorizontalDisplacementScale;
+						tile.minZ *= k_HorizontalDisplacementScale; tile.maxZ *= k_HorizontalDisplacementScale;
+						tiles[c] = tile;
+					}
+				}
+			}
+		});
+
+		// Each coarser level merges 2x2 tiles of the one below, the last row or column of an odd level merging fewer.
+		for(size_t l = 1; l < boundsLevels.size(); ++l)
+		{
+			const BoundsLevel& fine = boundsLevels[l - 1];
+			const BoundsLevel& coarse = boundsLevels[l];
+
+			WorkerPool::RangeFunction merge_rows = [&](int row_begin, int row_end)
+			{
+				for(u32 r = static_cast<u32>(row_begin); r < static_cast<u32>(row_end); ++r)
+				{
+					u32 fine_row_end = std::min(2 * r + 2, fine.rows);
+					for(u32 c = 0; c < coarse.cols; ++c)
+					{
+						u32 fine_col_end = std::min(2 * c + 2, fine.cols);
+
+						DisplacementBoundsT<T> tile = boundsPyramid[fine.offset + 2 * r * fine.cols + 2 * c];
+						for(u32 fr = 2 * r; fr < fine_row_end; ++fr)
+						{
+							for(u32 fc = 2 * c; fc < fine_col_end; ++fc)
+							{
+								const DisplacementBoundsT<T>& child = boundsPyramid[fine.offset + fr * fine.cols + fc];
+								tile.minX = std::min(tile.minX, child.minX); tile.maxX = std::max(tile.maxX, child.maxX);
+								tile.minY = std::min(tile.minY, child.minY); tile.maxY = std::max(tile.maxY, child.maxY);
+								tile.minZ = std::min(tile.minZ, child.minZ); tile.maxZ = std::max(tile.maxZ, child.maxZ);
+							}
+						}
+
+						boundsPyramid[coarse.offset + r * coarse.cols + c] = tile;
+					}
+				}
+			};
+
+			// A quarter of the tiles of the level below each, only the first coarse levels are worth waking the threads for.
+			if(coarse.rows >= BOUNDS_PARALLEL_MIN_ROWS)
+				workerPool->ParallelFor(0, static_cast<int>(coarse.rows), merge_rows);
+			else
+				merge_rows(0, static_cast<int>(coarse.rows));
+		}
+	}
+
+	template <typename T>
+	typename OceanCascadeT<T>::PhaseUpdate OceanCascadeT<T>::PreparePhaseUpdate( T t, u32& halvings )
+	{
+		halvings = 0;
+
+		T dt = t - phaseTime;
+		if(!phaseValid || dt < 0.0f || dt > PHASE_MAX_STEP)
+		{
+			phaseValid = true;
+			phaseTime = t;
+			phaseStepDelta = 0.0f;
+			phaseStepCount = 0;
+			return PHASE_RESYNC;
+		}
+
+		if(dt == 0.0f)
+			return PHASE_KEEP;
+
+		++phaseStepCount;
+
+		// Fixed dt: reuse the rotations. phaseTime advances by the exact step so the
+		// small differences of a jittery clock don't accumulate.
+		if(fabs(dt - phaseStepDelta) <= PHASE_STEP_TOLERANCE * dt)
+		{
+			phaseTime += phaseStepDelta;
+			return PHASE_STEP;
+		}
+
+		// Variable dt: enough halvings to keep the fastest bin in range of the polynomial.
+		T max_angle = maxOmega * dt;
+		while(max_angle > PHASE_MAX_POLY_ANGLE)
+		{
+			max_angle *= 0.5f;
+			++halvings;
+		}
+
+		phaseTime = t;
+		phaseStepDelta = dt;
+		return PHASE_REBUILD_STEP;
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::CreatePlans()
+	{
+		// Split real and imaginary inputs with padded rows, so they go through the guru interface.
+		typename FFTW<T>::IODim dims[2];
+		dims[0].n = static_cast<int>(M);
+		dims[0].is = static_cast<int>(FFTIn.GetRowStride());
+		dims[0].os = static_cast<int>(N);
+		dims[1].n = static_cast<int>(N);
+		dims[1].is = 1;
+		dims[1].os = 1;
+
+		int field_size = static_cast<int>(M * N); // Distance between two fields in the output.
+
+		T* out = FFTOut.data();
+
+		// FFTW runs its own threads, as many as the pool has.
+		u32 fftw_threads = planThreadCount;
+		FFTW<T>::PlanWithThreads(static_cast<int>(fftw_threads));
+
+		// Measured plans come from the wisdom on disk when this grid has been planned before.
+		FFTWisdomCache& wisdom = FFTWisdomCache::GetInstance();
+		wisdom.Begin(FFTWisdomKey(M, N, 8 * sizeof(T), fftw_threads), planningMode, planningTimeLimit);
+
+		if(batchedFFT)
+		{
+			typename FFTW<T>::IODim howmany;
+			howmany.n = static_cast<int>(fftFieldCount);
+			howmany.is = static_cast<int>(2 * FFTIn.GetPlaneStride()); // T planes of consecutive fields.
+			howmany.os = field_size;
+
+			batchedPlan = wisdom.Plan<T>([&](unsigned flags)
+			{
+				return FFTW<T>::PlanSplitC2R(2, dims, 1, &howmany, FFTIn.Re(0, 0), FFTIn.Im(0, 0), out, flags);
+			});
+		}
+		else
+		{
+			// One plan per field, each reading its own planes.
+			for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+			{
+				int slot = fftFieldSlot[f];
+				if(slot < 0)
+					continue;
+
+				T* field_out = out + slot * field_size;
+				GetFieldPlan(static_cast<FFTField>(f)) = wisdom.Plan<T>([&](unsigned flags)
+				{
+					return FFTW<T>::PlanSplitC2R(2, dims, 0, NULL, FFTIn.Re(slot, 0), FFTIn.Im(slot, 0), field_out, flags);
+				});
+			}
+		}
+
+		wisdom.End();
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::DestroyPlans()
+	{
+		FFTPlan* plans[FFT_FIELD_COUNT + 1];
+		for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+			plans[f] = &GetFieldPlan(static_cast<FFTField>(f));
+		plans[FFT_FIELD_COUNT] = &batchedPlan;
+
+		for(u32 p = 0; p < FFT_FIELD_COUNT + 1; ++p)
+		{
+			if(*plans[p] != NULL)
+				FFTW<T>::Destroy(*plans[p]);
+
+			*plans[p] = NULL;
+		}
+	}
+
+	template <typename T>
+	typename OceanCascadeT<T>::FFTPlan& OceanCascadeT<T>::GetFieldPlan( FFTField field )
+	{
+		switch(field)
+		{
+		case FFT_DISPLACEMENT_Y:	return displacementYPlan;
+		case FFT_DISPLACEMENT_X:	return displacementXPlan;
+		case FFT_DISPLACEMENT_Z:	return displacementZPlan;
+		case FFT_SLOPE_X:			return normalXPlan;
+		case FFT_SLOPE_Z:			return normalZPlan;
+		case FFT_JACOBIAN_XX:		return jacobianXXPlan;
+		case FFT_JACOBIAN_ZZ:		return jacobianZZPlan;
+		default:					return jacobianXZPlan;
+		}
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::Reset( const OceanSettings& settings, u32 new_index, WorkerPool* pool )
+	{
+		ASSERT(new_index < k_MaxOceanCascades, "Cascade index out of range.");
+		const CascadeSettings& cascade = settings.cascades[new_index];
+		bool has_next = (new_index + 1 < std::min(settings.cascadeCount, k_MaxOceanCascades));
+
+		workerPool = pool;
+		timings = Timings();
+
+		// Patch and band, converted to simulation units.
+		u32 new_resolution = GetFFTSize(cascade.resolution);
+		T new_min_wavelength = cascade.minWavelength / k_OceanWorldScale;
+		if(cascade.minWavelength == 0.0f && has_next)
+			new_min_wavelength = settings.cascades[new_index + 1].patchSize / k_OceanWorldScale;
+		T new_max_wavelength = cascade.maxWavelength / k_OceanWorldScale;
+		T new_loop_period = settings.loop ? settings.loopPeriod : 0.0f;
+		T new_W = static_cast<T>(settings.W) * static_cast<T>(k_Pi / 180.0); // Convert to radians.
+		u32 new_plan_threads = GetFFTWThreadCount<T>(*pool);
+
+		// Only what depends on the settings that changed is redone. The arrays and plans depend on the size, the transformed
+		// fields and how they are planned, the wave vectors on the patch, the dispersion on the depth and the loop,
+		// h0 on the spectrum and the seed. The rest is read every frame and applies as is.
+		bool reallocate = fftFieldCount == 0 || new_resolution != M || settings.spectralNormals != spectralNormals || settings.jacobianFoam != jacobianFoam
+			|| settings.batchedFFT != batchedFFT || settings.planningMode != planningMode || settings.planningTimeLimit != planningTimeLimit || new_plan_threads != planThreadCount;
+		bool rebuild_wave_vectors = reallocate || cascade.patchSize != patchSize;
+		bool rebuild_dispersion = rebuild_wave_vectors || settings.depth != depth || new_loop_period != loopPeriod;
+		bool regenerate_spectrum = rebuild_wave_vectors || settings.seed != seed || new_index != index || settings.V != V || settings.l != l || settings.A != A || new_W != W
+			|| settings.windAlignment != windAlignment || settings.dampReflections != dampReflections || new_min_wavelength != minWavelength || new_max_wavelength != maxWavelength;
+		bool select_active_bins = regenerate_spectrum || settings.pruneThreshold != pruneThreshold;
+
+		seed = settings.seed;
+		index = new_index;
+
+		V = settings.V;
+		L = V * V / k_Gravity;
+		l = settings.l;
+		A = settings.A;
+		W = new_W;
+		WX = cos(W);
+		WZ = -sin(W);
+		windAlignment = settings.windAlignment;
+		dampReflections = settings.dampReflections;
+		depth = settings.depth;
+		chopAmount = settings.chopAmount;
+		pruneThreshold = settings.pruneThreshold;
+
+		foamFader = settings.foamFader;
+		foamSlopeRatio = settings.foamSlopeRatio;
+		jacobianFoam = settings.jacobianFoam;
+		foamJacobianLimit = settings.foamJacobianLimit;
+
+		batchedFFT = settings.batchedFFT;
+		spectralNormals = settings.spectralNormals;
+		planningMode = settings.planningMode;
+		planningTimeLimit = settings.planningTimeLimit;
+		planThreadCount = new_plan_threads;
+
+		kernels = &SpectrumKernelsT<T>::Get(settings.simdLevel);
+
+		M = N = new_resolution;
+		patchSize = cascade.patchSize;
+		LX = LZ = patchSize / k_OceanWorldScale;
+		minWavelength = new_min_wavelength;
+		maxWavelength = new_max_wavelength;
+
+		updateInterval = (cascade.updateRate > 0.0f) ? 1.0f / cascade.updateRate : 0.0f;
+		loopPeriod = new_loop_period;
+
+		// Simulated again even when nothing changed, so the new settings show on the next frame.
+		updated = false;
+
+		if(reallocate)
+			AllocateFields();
+
+		StageClock::time_point stage_start = StageClock::now();
+		if(rebuild_wave_vectors)
+			ComputeWaveVectors();
+		if(rebuild_dispersion)
+			ComputeDispersion();
+		if(regenerate_spectrum)
+			GenerateSpectrum();
+		if(select_active_bins)
+			SelectActiveBins();
+		timings.spectrum += LapSeconds(stage_start);
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::AllocateFields()
+	{
+		// Slopes are only transformed when the normals come from them, the Jacobian when the foam does.
+		// The transformed fields are packed at the front of FFTIn and FFTOut so one plan can do them all.
+		bool field_enabled[FFT_FIELD_COUNT] = { true, true, true, spectralNormals, spectralNormals, jacobianFoam, jacobianFoam, jacobianFoam };
+
+		fftFieldCount = 0;
+		for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+		{
+			fftFieldSlot[f] = field_enabled[f] ? static_cast<int>(fftFieldCount++) : -1;
+		}
+
+		// FFTW Inputs allocation. Its content doesn't matter, measuring plans overwrites it and it is refilled every frame.
+		FFTIn.ResizeComplex(M, 1 + N / 2, fftFieldCount);
+
+		// FFTW Outputs allocation. Each field is a view on its slice of FFTOut.
+		FFTOut.resize(fftFieldCount, M, N);
+
+		MatrixT* field_outputs[FFT_FIELD_COUNT] = { &displacementY, &displacementX, &displacementZ, &normalX, &normalZ, &jacobianXX, &jacobianZZ, &jacobianXZ };
+		for(u32 f = 0; f < FFT_FIELD_COUNT; ++f)
+		{
+			if(fftFieldSlot[f] >= 0)
+				field_outputs[f]->reference(FFTOut(fftFieldSlot[f], blitz::Range::all(), blitz::Range::all()));
+			else
+				field_outputs[f]->free();
+		}
+
+		if(spectralNormals)
+		{
+			slopeX.reference(normalX);
+			slopeZ.reference(normalZ);
+			normalArray.free();
+			faceNormals.free();
+		}
+		else
+		{
+			slopeX.resize(M, N);
+			slopeZ.resize(M, N);
+			slopeX = 0.0f;
+			slopeZ = 0.0f;
+			normalArray.resize(M, N);
+			normalArray = Vector3T(T(0), T(1), T(0));
+			faceNormals.resize(M, N, 2);
+		}
+
+		foamArray.resize(M, N);
+		foamArray = 0.0f;
+
+		// Bounds pyramid, halved down to a single tile.
+		boundsLevels.clear();
+		BoundsLevel level = { 0, (M + BOUNDS_TILE_SIZE - 1) / BOUNDS_TILE_SIZE, (N + BOUNDS_TILE_SIZE - 1) / BOUNDS_TILE_SIZE, BOUNDS_TILE_SIZE };
+		boundsLevels.push_back(level);
+		while(level.rows > 1 || level.cols > 1)
+		{
+			level.offset += level.rows * level.cols;
+			level.rows = (level.rows + 1) / 2;
+			level.cols = (level.cols + 1) / 2;
+			level.tileSize *= 2;
+			boundsLevels.push_back(level);
+		}
+		boundsPyramid.assign(level.offset + 1, DisplacementBoundsT<T>());
+		boundsColumns.assign(6 * N * std::min(workerPool->GetThreadCount(), boundsLevels[0].rows), T(0));
+
+		// Initialize FFTW plans.
+		StageClock::time_point stage_start = StageClock::now();
+		DestroyPlans();
+		CreatePlans();
+		timings.planning += LapSeconds(stage_start);
+
+		// Initialize matrices needed.
+		k.resize(M, 1 + N / 2);
+		kInverse.resize(M, 1 + N / 2);
+		h0.ResizeComplex(M, 1 + N / 2, 1);
+		h0Minus.ResizeComplex(M, 1 + N / 2, 1);
+		kx.resize(M);
+		kz.resize(N);
+		omega.resize(M, 1 + N / 2);
+		phase.ResizeComplex(M, 1 + N / 2, 1);
+		phaseStep.ResizeComplex(M, 1 + N / 2, 1);
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::ComputeWaveVectors()
+	{
+		// Pre-compute k vectors (directions).
+		// +ve components
+		for(int i = 0; i <= M / 2; ++i)
+		{
+			kx(i) = 2.0f * k_Pi * i / LX;
+		}
+
+		// -ve components
+		for(int i = M - 1, ii = 0; i > M / 2; --i, ++ii)
+		{
+			kx(i) = -2.0f * k_Pi * ii / LX;
+		}
+
+		// +ve components
+		for(int i = 0; i <= N / 2; ++i)
+		{
+			kz(i) = 2.0f * k_Pi * i / LZ;
+		}
+
+		// -ve components
+		for(int i = N - 1, ii = 0; i > N / 2; --i, ++ii)
+		{
+			kz(i) = -2.0f * k_Pi * ii / LZ;
+		}
+
+		// Pre-compute the k matrix (magnitude of k vectors)
+		for(int i = 0; i < M; ++i)
+		{
+			for(int j = 0; j <= N / 2; ++j) // Note <= _N/2 here, see the fftw notes about complex->real fft storage.
+			{
+				k(i, j) = sqrt(kx(i) * kx(i) + kz(j) * kz(j));
+				kInverse(i, j) = (k(i, j) == T(0)) ? T(0) : T(1) / k(i, j);
+			}
+		}
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::ComputeDispersion()
+	{
+		// Dispersion only depends on k and depth, so it is tabulated once.
+		maxOmega = 0.0f;
+		for(int i = 0; i < M; ++i)
+		{
+			for(int j = 0; j <= N / 2; ++j)
+			{
+				omega(i, j) = Omega(k(i, j));
+				maxOmega = std::max(maxOmega, omega(i, j));
+			}
+		}
+
+		// The phases were advanced with the old frequencies.
+		phaseValid = false;
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::GenerateSpectrum()
+	{
+		// The random numbers of bin (i, j) are drawn from counter (i, j), so the rows can be split between the threads
+		// and the same seed gives the same h0 whatever the thread count.
+		Philox4x32 random(seed, index);
+
+		// Pre-compute hTilda0.
+		workerPool->ParallelFor(0, M, [&](int row_begin, int row_end)
+		{
+			for(int i = row_begin; i < row_end; ++i)
+			{
+				for(int j = 0; j <= N / 2; ++j)
+				{
+					T r1, r2;
+					random.GaussianPair(static_cast<u32>(i), static_cast<u32>(j), r1, r2);
+					T h0_amplitude = sqrt(Ph(kx(i), kz(j)) / 2.0f);
+					T h0_minus_amplitude = sqrt(Ph(-kx(i), -kz(j)) / 2.0f);
+
+					h0.Re(0, i)[j] = r1 * h0_amplitude;
+					h0.Im(0, i)[j] = r2 * h0_amplitude;
+					h0Minus.Re(0, i)[j] = r1 * h0_minus_amplitude;
+					h0Minus.Im(0, i)[j] = r2 * h0_minus_amplitude;
+				}
+			}
+		});
+	}
+
+	template <typename T>
+	void OceanCascadeT<T>::SelectActiveBins()
+	{
+		const u32 num_bins = N / 2 + 1;
+
+		// Energy of a bin in the field. The columns with a mirror image in the other half of the spectrum count twice.
+		std::function<double (int, u32)> bin_energy = [&](int i, u32 j) -> double
+		{
+			double weight = (j == 0 || 2 * j == N) ? 1.0 : 2.0;
+			return weight * weight * (Sqr<double>(h0.Re(0, i)[j]) + Sqr<double>(h0.Im(0, i)[j]) + Sqr<double>(h0Minus.Re(0, i)[j]) + Sqr<double>(h0Minus.Im(0, i)[j]));
+		};
+
+		double total_energy = 0.0;
+		double max_energy = 0.0;
+		for(int i = 0; i < M; ++i)
+		{
+			for(u32 j = 0; j < num_bins; ++j)
+			{
+				double energy = bin_energy(i, j);
+				total_energy += energy;
+				max_energy = std::max(max_energy, energy);
+			}
+		}
+
+		const double limit = pruneThreshold * max_energy;
+
+		activeSpans.clear();
+		activeRowSpans.resize(M + 1);
+		activeBinCount = 0;
+		double kept_energy = 0.0;
+		for(int i = 0; i < M; ++i)
+		{
+			const u32 row_spans = static_cast<u32>(activeSpans.size());
+			activeRowSpans[i] = row_spans;
+			for(u32 j = 0; j < num_bins; ++j)
+			{
+				if(bin_energy(i, j) <= limit)
+					continue;
+
+				if(activeSpans.size() > row_spans && j - activeSpans.back().end < ACTIVE_SPAN_MIN_GAP)
+				{
+					activeSpans.back().end = j + 1;
+				}
+				else
+				{
+					BinSpan span = { j, j + 1 };
+					activeSpans.push_back(span);
+				}
+			}
+
+			// The bins merged into the spans are evolved too.
+			for(u32 s = row_spans; s < activeSpans.size(); ++s)
+			{
+				for(u32 j = activeSpans[s].begin; j < activeSpans[s].end; ++j)
+					kept_energy += bin_energy(i, j);
+				activeBinCount += activeSpans[s].end - activeSpans[s].begin;
+			}
+		}
+		activeRowSpans[M] = static_cast<u32>(activeSpans.size());
+
+		prunedEnergyFraction = (total_energy > 0.0) ? std::max(1.0 - kept_energy / total_energy, 0.0) : 0.0;
+
+		// The bins that just became active were not advanced.
+		phaseValid = false;
+	}
+
+	template class OceanCascadeT<float>;
+	template class OceanCascadeT<double>;
+
+	template void OceanCascadeT<float>::PackTexels<float>(float* displacement_texels, float* slope_texels) const;
+	template void OceanCascadeT<float>::PackTexels<Half>(Half* displacement_texels, Half* slope_texels) const;
+	template void OceanCascadeT<double>::PackTexels<float>(float* displacement_texels, float* slope_texels) const;
+	template void OceanCascadeT<double>::PackTexels<Half>(Half* displacement_texels, Half* slope_texels) const;
+}
\ No newline at end of file
@@ -0,0 +1,501 @@
+#pragma once
+#include "Types.h"
+#include "FFTWisdomCache.h"
+#include "Half.h"
+#include "SpectrumKernels.h"
+#include "SpectrumPlanes.h"
+#include "WorkerPool.h"
+
+#include <complex>
+#include <vector>
+
+#include <fftw3.h>
+#include <blitz/array.h>
+#include <glm/glm.hpp>
+
+namespace acqua
+{
+	// Type definitions.
+	typedef float							Real;
+	typedef std::complex<Real>				ComplexReal;
+	typedef blitz::Array<Real, 1>			VectorReal;
+	typedef blitz::Array<Real, 2>			MatrixReal;
+	typedef blitz::Array<glm::vec3, 2>		Vector3Array;
+	typedef blitz::Array<ComplexReal, 2>	MatrixComplex;
+	typedef blitz::Array<Real, 3>			ArrayReal3;
+	typedef blitz::Array<glm::vec3, 3>		Vector3Array3;
+
+	// useful constants.
+	const float k_Gravity = 9.81f;
+	const double k_Pi = 3.14159265358979323846264338327950288;
+
+	const ComplexReal k_Minus_i(0,-1);
+	const ComplexReal k_Plus_i(0,1);
+
+	const u32 k_MaxOceanCascades = 4;
+
+	// World units per simulation unit. Also the spacing of the render grid.
+	const Real k_OceanWorldScale = 10.0f;
+
+	// Applied to the chop displacements when they move the vertices.
+	const Real k_HorizontalDisplacementScale = 0.8f;
+
+	// One patch of the ocean. The cascades are tiled independently and summed.
+	struct CascadeSettings
+	{
+		Real patchSize; // Side of the patch in world units.
+		u32 resolution; // FFT size, M = N. Rounded to the nearest size FFTW transforms quickly, see GetFFTSize.
+
+		// Band of wavelengths, in world units, this cascade simulates. The ones outside are left to the other cascades.
+		// A 0 minWavelength stops at the patch size of the next cascade, a 0 maxWavelength keeps the longest waves.
+		Real minWavelength;
+		Real maxWavelength;
+
+		Real updateRate; // Simulations per second. 0 simulates every frame.
+
+		CascadeSettings() : patchSize(128 * k_OceanWorldScale), resolution(128), minWavelength(0.0f), maxWavelength(0.0f), updateRate(0.0f)
+		{
+
+		}
+	};
+
+	// Nearest even size with no prime factor above 7, which FFTW has fast codelets for (128, 192, 200, 384...).
+	// Powers of 2 are the fastest per bin, the others fill in the 4x steps between them.
+	u32 GetFFTSize(u32 resolution);
+
+	// Ocean Settings
+	struct OceanSettings
+	{
+		Real V;
+		Real l;
+		Real A;
+		Real W;
+		Real windAlignment;
+		u32 seed; // Of the random numbers the spectrum is drawn from. Cascade c uses it with c as a second key.
+
+		Real dampReflections;
+		Real depth;
+
+		Real chopAmount;
+
+		// Bins with less energy than this fraction of the strongest one are left out of the evolution and the FFT inputs.
+		// 0 only leaves out the bins with none. See OceanCascadeT::GetPrunedEnergyFraction for what it costs.
+		Real pruneThreshold;
+
+		Real foamSlopeRatio; //Decides the slope ratio to start the foam;
+		Real foamFader;	//Decides how much the foam increases and decreases over frames.
+		bool jacobianFoam; // Foam from the Jacobian of the chop displacement, transformed from the spectrum, instead of finite differences.
+		Real foamJacobianLimit; // Jacobian under which foam builds up. 1 is an undisturbed surface, 0 a fold.
+
+		bool batchedFFT; // Transform all the fields with a single multi-transform plan instead of one plan per field.
+		bool spectralNormals; // Normals from the FFT of the slopes instead of the displaced triangles.
+		FFTPlanningMode planningMode; // Measured modes load and save FFTW wisdom on disk.
+		Real planningTimeLimit; // Seconds FFTW may spend measuring one plan when the wisdom is cold.
+
+		u32 threadCount; // Threads used by the simulation loops and FFTW. 0 uses every hardware thread.
+		SIMDLevel simdLevel; // Highest instruction set the spectrum kernels may use. Clamped to what the CPU supports.
+
+		u32 cascadeCount; // Up to k_MaxOceanCascades.
+		CascadeSettings cascades[k_MaxOceanCascades]; // From the largest patch to the smallest.
+
+		bool displacementMaps; // Upload the cascades as float textures sampled by the shaders, instead of displacing the vertices on the CPU.
+		bool asyncSimulation; // Simulate on a thread of its own while the previous frame is rendered.
+
+		// Looping. The dispersion is quantised to multiples of 2 pi / loopPeriod so the ocean repeats exactly,
+		// then loopFrameCount frames of one period are simulated up front and played back.
+		bool loop;
+		Real loopPeriod; // Seconds.
+		u32 loopFrameCount; // Memory grows with it, at 24 bytes per texel of every cascade, 12 with half texels (see OceanTexel).
+		bool loopInterpolate; // Blend between frames instead of holding each one.
+
+		// Sequence baked by OceanBakeTool (see OceanBake.h), played back instead of simulating. Empty simulates.
+		// Its cascades replace the ones above and it loops like a precomputed period, with loopInterpolate.
+		String playbackFile;
+		u32 playbackReadAhead; // Frames read from disk ahead of the one presented.
+
+		OceanSettings() : V(4.0f), l(2.0f), A(1.0f), W(2.0f), windAlignment(2.0f), seed(1), dampReflections(0.5f), depth(200.0f), chopAmount(0.5f), pruneThreshold(1e-6f), foamSlopeRatio(0.07f), foamFader(0.1f), jacobianFoam(true), foamJacobianLimit(0.75f), batchedFFT(true), spectralNormals(true), planningMode(FFT_PLAN_MEASURE), planningTimeLimit(1.0f), threadCount(0), simdLevel(SIMD_AVX2), cascadeCount(1), displacementMaps(true), asyncSimulation(true), loop(false), loopPeriod(20.0f), loopFrameCount(64), loopInterpolate(true), playbackReadAhead(8)
+		{
+			// Smaller patches for when more cascades are enabled. Each one adds detail eight times finer.
+			for(u32 c = 1; c < k_MaxOceanCascades; ++c)
+			{
+				cascades[c].patchSize = cascades[c - 1].patchSize / 8.0f;
+				cascades[c].resolution = 64;
+			}
+		}
+	};
+
+	// Seconds spent in each stage of a cascade, summed since the last Reset or ResetTimings.
+	struct CascadeTimings
+	{
+		double spectrum;	// Reset. Wave vectors, dispersion and h0.
+		double planning;	// Reset. FFTW plans.
+		double evolution;	// Simulate. Phases and the FFT inputs.
+		double fft;
+		double normals;		// Slopes from the displaced triangles, without spectral normals.
+		double foam;
+		double bounds;		// Min/max pyramid of the displacements.
+		u32 simulations;
+
+		CascadeTimings() : spectrum(0.0), planning(0.0), evolution(0.0), fft(0.0), normals(0.0), foam(0.0), bounds(0.0), simulations(0) {}
+	};
+
+	// Bytes held by each stage of a cascade.
+	struct CascadeMemory
+	{
+		size_t spectrum;	// Wave vectors, dispersion, h0 and the active bins.
+		size_t evolution;	// Phases and their rotations.
+		size_t fft;			// Inputs and outputs of the transforms, which hold the displacements, slopes and Jacobian.
+		size_t outputs;		// Foam, the bounds pyramid, and the slopes and normals of the displaced triangles without spectral normals.
+
+		CascadeMemory() : spectrum(0), evolution(0), fft(0), outputs(0) {}
+
+		size_t GetTotal() const { return spectrum + evolution + fft + outputs; }
+	};
+
+	// One wave of the spectrum of a cascade, bin (i, j) of the half spectrum the FFTs read. Its height at time t
+	// and position x, in simulation units, is weight * Re(hTilda * e^(i f.x)), with hTilda = h0 * e^(i omega t)
+	// + conj(h0Minus * e^(i omega t)). The columns j = 0 and N/2 have no mirror image and weigh 1, the others 2.
+	// f is where the transform puts the bin. It is k except on the rows of negative kx, where the table of wave
+	// vectors is one step behind the FFT's frequencies.
+	template <typename T>
+	struct SpectrumBinT
+	{
+		T kx; // Wave vector of the spectrum, dispersion and chop.
+		T kz;
+		T fx; // Frequency of the transform.
+		T fz;
+		T k;
+		T omega;
+		T h0Re;
+		T h0Im;
+		T h0MinusRe;
+		T h0MinusIm;
+		T weight;
+	};
+
+	// Conservative bounds of the displaced surface over a region of a cascade, in world units. The horizontal displacements
+	// are the ones applied to the vertices, already scaled by k_HorizontalDisplacementScale.
+	template <typename T>
+	struct DisplacementBoundsT
+	{
+		T minX, maxX;
+		T minY, maxY;
+		T minZ, maxZ;
+	};
+
+	// One FFT patch of the ocean, simulated with Tessendorf's algorithm.
+	// Produces displacements, slopes and foam per texel, in world units, to be sampled with wrapping.
+	// T is the precision of the simulation and of its outputs, float or double. Double is for validation runs,
+	// its kernels are the scalar ones (see SpectrumKernelsT).
+	template <typename T>
+	class OceanCascadeT
+	{
+	public:
+		typedef T Scalar;
+		typedef CascadeTimings Timings;
+
+		typedef blitz::Array<T, 1>		VectorT;
+		typedef blitz::Array<T, 2>		MatrixT;
+		typedef blitz::Array<T, 3>		Array3T;
+		typedef glm::detail::tvec3<T, glm::defaultp>	Vector3T;
+		typedef blitz::Array<Vector3T, 2>	Vector3ArrayT;
+		typedef blitz::Array<Vector3T, 3>	Vector3Array3T;
+
+	private:
+		typedef typename FFTW<T>::Plan FFTPlan;
+
+		// How the phases of the spectrum are brought to the simulation time.
+		enum PhaseUpdate
+		{
+			PHASE_KEEP,			// Same time as last frame.
+			PHASE_STEP,			// Same dt as the cached rotations, one complex multiply per bin.
+			PHASE_REBUILD_STEP,	// New dt, rotations rebuilt with a polynomial then applied.
+			PHASE_RESYNC		// Time went backwards or jumped, phases evaluated exactly.
+		};
+
+		// Fields produced by the inverse FFTs. Each transformed one is a complex field of FFTIn.
+		enum FFTField
+		{
+			FFT_DISPLACEMENT_Y,
+			FFT_DISPLACEMENT_X,
+			FFT_DISPLACEMENT_Z,
+			FFT_SLOPE_X,
+			FFT_SLOPE_Z,
+			FFT_JACOBIAN_XX,
+			FFT_JACOBIAN_ZZ,
+			FFT_JACOBIAN_XZ,
+			FFT_FIELD_COUNT
+		};
+
+	public:
+		OceanCascadeT(void);
+		~OceanCascadeT(void);
+
+		// Applies the settings of cascades[index]. Only reallocates, replans, or regenerates the spectrum when
+		// the settings those depend on changed, the chop, foam and update rate apply without any of it.
+		void Reset(const OceanSettings& settings, u32 index, WorkerPool* pool);
+
+		// Whether the update rate asks for a new simulation at time t.
+		bool NeedsUpdate(T t) const;
+
+		// Simulates time t. Heights are multiplied by scale.
+		void Simulate(T t, T scale);
+
+		// Accessors.
+		u32 GetM() const { return M; }
+		u32 GetN() const { return N; }
+		T GetPatchSize() const { return patchSize; }
+		T GetLastUpdateTime() const { return lastUpdateTime; } // Time of the outputs.
+
+		const Timings& GetTimings() const { return timings; }
+		CascadeMemory GetMemory() const;
+		void ResetTimings() { timings = Timings(); }
+
+		// Outputs, (M, N) each, in world units. The horizontal displacements are scaled by k_HorizontalDisplacementScale when they are applied.
+		const MatrixT& GetDisplacementX() const { return displacementX; }
+		const MatrixT& GetDisplacementY() const { return displacementY; }
+		const MatrixT& GetDisplacementZ() const { return displacementZ; }
+		const MatrixT& GetSlopeX() const { return slopeX; }
+		const MatrixT& GetSlopeZ() const { return slopeZ; }
+		const MatrixT& GetFoam() const { return foamArray; }
+
+		// Min/max pyramid of the displacements, rebuilt by every simulation. Level 0 has tiles of a few texels a side, each
+		// level above merges 2x2 tiles of the one below, and the last level is a single tile over the whole patch.
+		// Tile (r, c) of a level with tiles of s texels bounds texels [r s, (r + 1) s] x [c s, (c + 1) s], wrapping. The last
+		// row and column are those of the next tiles, so the bounds hold for the triangles between the texels too.
+		u32 GetBoundsLevelCount() const { return static_cast<u32>(boundsLevels.size()); }
+		u32 GetBoundsRows(u32 level) const { return boundsLevels[level].rows; }
+		u32 GetBoundsCols(u32 level) const { return boundsLevels[level].cols; }
+		u32 GetBoundsTileSize(u32 level) const { return boundsLevels[level].tileSize; } // In texels.
+		const DisplacementBoundsT<T>& GetDisplacementBounds(u32 level, u32 row, u32 col) const { return boundsPyramid[boundsLevels[level].offset + row * boundsLevels[level].cols + col]; }
+		const DisplacementBoundsT<T>& GetPatchBounds() const { return boundsPyramid.back(); }
+
+		// The spectrum, bins (i, j) with i < M and j <= N / 2. Kept since the last Reset, whether it was simulated or not.
+		SpectrumBinT<T> GetSpectrumBin(u32 i, u32 j) const;
+		T GetChopAmount() const { return chopAmount; }
+
+		// Bins evolved every frame, out of M * (N/2+1), and the fraction of the energy of the spectrum in the others.
+		u32 GetActiveBinCount() const { return activeBinCount; }
+		double GetPrunedEnergyFraction() const { return prunedEnergyFraction; }
+		u32 GetFFTFieldCount() const { return fftFieldCount; } // Fields transformed every frame.
+
+		// Writes the outputs as the texels of the displacement maps, (N, M, 4) displacements with the foam in w and (N, M, 2) slopes.
+		// Texel is float or Half (see Half.h), the conversion is chosen at compile time.
+		template <typename Texel>
+		void PackTexels(Texel* displacement_texels, Texel* slope_texels) const;
+
+	private:
+		OceanCascadeT(const OceanCascadeT&);
+		OceanCascadeT& operator=(const OceanCascadeT&);
+
+		// Ocean simulation methods.
+		T Ph(T k_x, T k_z) const; // Phillips spectrum.
+
+		T Wavelength(T k_) const
+		{
+			return 2.0f * k_Pi / k_;
+		}
+
+		T Omega(T k_) const
+		{
+			T omega_ = sqrt(k_Gravity * k_ * tanh(k_ * depth) );
+
+			// Multiples of the base frequency of the loop, so every wave is back in phase after loopPeriod.
+			if(loopPeriod > 0.0f)
+			{
+				T omega_0 = 2.0f * k_Pi / loopPeriod;
+				omega_ = floor(omega_ / omega_0) * omega_0;
+			}
+
+			return omega_;
+		}
+
+		// Stages of Reset, each run when the settings it depends on changed.
+		void AllocateFields(); // Arrays and FFTW plans, for the size and the transformed fields.
+		void ComputeWaveVectors(); // kx, kz and k, for the patch.
+		void ComputeDispersion(); // omega, for the depth and the loop period.
+		void GenerateSpectrum(); // h0 and h0Minus, for the spectrum and the seed.
+		void SelectActiveBins(); // activeSpans, for the spectrum and the prune threshold.
+
+		// Zeroes bins [begin, end) of row i in the inputs of every transformed field.
+		void ClearInputs(int i, u32 begin, u32 end);
+
+		// Chooses how to advance the phases to time t and prepares the members it needs.
+		PhaseUpdate PreparePhaseUpdate(T t, u32& halvings);
+
+		// Passes of Simulate after the FFTs.
+		void ComputeTriangleSlopes();
+		void AccumulateFoam(T scale);
+		void BuildBoundsPyramid();
+
+		// FFTW plans management.
+		void CreatePlans();
+		void DestroyPlans();
+		FFTPlan& GetFieldPlan(FFTField field); // FFTPlan of a single field, used when batchedFFT is off.
+
+	private:
+		// Dimensions of the grid.
+		u32 M;
+		u32 N;
+
+		// Spatial size of the grid.
+		T LX;
+		T LZ;
+		T patchSize; // LX in world units.
+
+		// Band of wavelengths kept in h0, in simulation units. 0 is no limit.
+		T minWavelength;
+		T maxWavelength;
+
+		T updateInterval; // Seconds between two simulations. 0 simulates every frame.
+		T loopPeriod; // Period the dispersion is quantised to. 0 doesn't quantise.
+		T lastUpdateTime;
+		bool updated; // False until the first simulation after a reset.
+
+		// Simulation.
+		T V;	// Speed of the waves.
+		T L; // Largest wave length at velocity V.
+		T l; // Shortest wave length. Used for pruning out very small waves.
+		T A; // Amplitude (approximate wave height).
+
+		// wind.
+		T W; // Wind direction in radians.
+		T WX; T WZ; // Wind directions.
+		T windAlignment; // How close waves travel in the direction of wind.
+
+		T dampReflections; // Damps out the negative direction waves.
+		T depth; // Depth of the ocean.
+
+		T chopAmount; // Amount of chop displacement that is applied to the input points.
+
+		// Foam.
+		T foamSlopeRatio; //Decides the slope ratio to start the foam;
+		T foamFader;	//Decides how much the foam increases and decreases over frames.
+		bool jacobianFoam;
+		T foamJacobianLimit;
+		MatrixT foamArray; // Foam per texel. (M, N)
+
+		u32 seed; // Of the random numbers h0 is generated from.
+		u32 index; // Of the cascade, the second key of the random numbers.
+
+		// Direction vectors per grid point.
+		VectorT kx; VectorT kz;
+		MatrixT k; // Matrix of their magnitudes.
+		MatrixT kInverse; // 1 / k, 0 at k = 0, so the input kernels neither divide nor branch on the DC bin.
+
+		// Complex spectra are split in real and imaginary planes (see SpectrumPlanes) for the SIMD kernels.
+		// Only the half spectrum the c2r transforms read is kept, they mirror it into the other half.
+		SpectrumPlanesT<T> h0; // (M, N/2+1)
+		SpectrumPlanesT<T> h0Minus; // (M, N/2+1)
+
+		// Runs of bins [begin, end) of a row with energy above the prune threshold. Runs separated by a few bins are merged,
+		// the kernels are faster on long runs.
+		struct BinSpan
+		{
+			u32 begin;
+			u32 end;
+		};
+
+		T pruneThreshold;
+		std::vector<BinSpan> activeSpans; // Sorted by row.
+		std::vector<u32> activeRowSpans; // (M + 1) First span of each row, and the end of the last row's.
+		u32 activeBinCount;
+		double prunedEnergyFraction;
+
+		// Time evolution. hTilda = h0 * phase + conj(h0Minus) * conj(phase), with phase = e^(i omega t).
+		MatrixT omega; // Dispersion per bin, computed once per reset.
+		T maxOmega;
+		SpectrumPlanesT<T> phase; // (M, N/2+1)
+		SpectrumPlanesT<T> phaseStep; // e^(i omega phaseStepDelta), advances phase by one step.
+		T phaseTime; // Time the phases correspond to.
+		T phaseStepDelta; // dt phaseStep was built for. 0 when it has never been built.
+		u32 phaseStepCount; // Steps since the phases were last renormalised.
+		bool phaseValid; // False after a reset, the phases need an exact evaluation.
+
+		// FFT related members.
+		SpectrumPlanesT<T> FFTIn; // Input to the plans. (M, N/2+1), one complex field per transformed FFTField.
+		Array3T FFTOut; // Output of the plans. (fftFieldCount, M, N), one contiguous slice per transformed field.
+
+		const SpectrumKernelsT<T>* kernels; // Row kernels for the instruction set in use.
+
+		u32 fftFieldCount; // Number of fields transformed every frame.
+		int fftFieldSlot[FFT_FIELD_COUNT]; // Field index in FFTIn and slice of FFTOut of each field, -1 when it isn't transformed.
+		bool batchedFFT;
+		bool spectralNormals;
+
+		FFTPlanningMode planningMode;
+		T planningTimeLimit;
+		u32 planThreadCount; // Threads the plans were made for.
+
+		FFTPlan batchedPlan; // Transforms all the fields at once.
+
+		// Per field plans, used when batchedFFT is off.
+		FFTPlan displacementYPlan;
+		MatrixT displacementY; // Output for the above plan. Slice of FFTOut.
+
+		FFTPlan displacementXPlan;
+		MatrixT displacementX;
+
+		FFTPlan displacementZPlan;
+		MatrixT displacementZ;
+
+		FFTPlan normalXPlan;
+		MatrixT normalX; // dY/dx in world units.
+
+		FFTPlan normalZPlan;
+		MatrixT normalZ; // dY/dz in world units.
+
+		// Derivatives of the rendered horizontal displacement, in world units.
+		FFTPlan jacobianXXPlan;
+		MatrixT jacobianXX;
+
+		FFTPlan jacobianZZPlan;
+		MatrixT jacobianZZ;
+
+		FFTPlan jacobianXZPlan;
+		MatrixT jacobianXZ; // Geometric mean of dDx/dz and dDz/dx, which only differ by the aspect of a texel.
+
+		// Slopes of the surface, from the FFTs or from the displaced triangles. References normalX/Z in the first case.
+		MatrixT slopeX;
+		MatrixT slopeZ;
+
+		// Levels of the bounds pyramid, finest first, stored one after the other in boundsPyramid.
+		struct BoundsLevel
+		{
+			u32 offset;
+			u32 rows;
+			u32 cols;
+			u32 tileSize;
+		};
+
+		std::vector<BoundsLevel> boundsLevels;
+		std::vector< DisplacementBoundsT<T> > boundsPyramid; // Tiles of each level, row by row.
+		std::vector<T> boundsColumns; // Scratch of the finest level, min and max of x, y and z per column of texels, one set per thread.
+
+		Vector3ArrayT normalArray; // Smoothed triangle normals. (M, N) Only used without spectral normals.
+		Vector3Array3T faceNormals; // Normals of the two triangles of each quad. (M, N, 2) Only used without spectral normals.
+
+		// Threads running the simulation. Owned by the component.
+		WorkerPool* workerPool;
+
+		Timings timings;
+	};
+
+	typedef OceanCascadeT<float> OceanCascadeFloat;
+	typedef OceanCascadeT<double> OceanCascadeDouble;
+
+	// Precision the demo and the tools simulate in. Building with ACQUA_DOUBLE_SIMULATION makes them all run in double.
+#if defined(ACQUA_DOUBLE_SIMULATION)
+	typedef OceanCascadeDouble OceanCascade;
+#else
+	typedef OceanCascadeFloat OceanCascade;
+#endif
+
+	// Storage of the texels the cascades are packed to, for the displacement maps, the loops and the baked sequences.
+	// Building with ACQUA_HALF_TEXELS stores them in half floats, which halves their memory and upload bandwidth.
+#if defined(ACQUA_HALF_TEXELS)
+	typedef Half OceanTexel;
+#else
+	typedef float OceanTexel;
+#endif
+}
\ No newline at end of file
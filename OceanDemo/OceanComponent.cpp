@@ -1,9 +1,12 @@
 #include "OceanComponent.h"
+#include "DebugUtil.h"
 
 #include "GameObject.h"
 #include "GraphicsContext.h"
 #include "Math.h"
+#include "Shader.h"
 
+#include <algorithm>
 #include <random>
 #include <cmath>
 #include "SFML\Graphics\Image.hpp"
@@ -16,13 +19,56 @@ namespace acqua
 	// utilities.
 	template <typename T> static inline T Sqr(T x) { return x*x; }
 	template <typename T> static inline T Lerp(T a, T b, T t) { return a + (b - a) * t; }
-	template <typename T> static inline T Catrom(T p0, T p1, T p2, T p3, T t)
+
+	// Texels and weights of a bilinear sample of a field that tiles every (M, N) texels.
+	struct BilinearTap
 	{
-		return	0.5 * ((2 * p1) +
-				(-p0 + p2) * t +
-				(2 * p0 - 5 * p1 + 4 * p2 - p3) * t * t +
-				(-p0 + 3 * p1- 3 * p2 + p3) * t * t * t);
-	}
+		int x0, x1;
+		int y0, y1;
+		Real fx, fy;
+
+		BilinearTap(Real u, Real v, int M, int N)
+		{
+			Real fu = floor(u);
+			Real fv = floor(v);
+			fx = u - fu;
+			fy = v - fv;
+
+			x0 = static_cast<int>(fu) % M;
+			x0 = x0 < 0 ? x0 + M : x0;
+			x1 = (x0 + 1 == M) ? 0 : x0 + 1;
+
+			y0 = static_cast<int>(fv) % N;
+			y0 = y0 < 0 ? y0 + N : y0;
+			y1 = (y0 + 1 == N) ? 0 : y0 + 1;
+		}
+
+		// Channel of interleaved texels, with rows of M texels.
+		Real Sample(const OceanTexel* texels, int M, int channels, int channel) const
+		{
+			const OceanTexel* row0 = texels + y0 * M * channels + channel;
+			const OceanTexel* row1 = texels + y1 * M * channels + channel;
+			return Lerp(Lerp(LoadTexel(row0[x0 * channels]), LoadTexel(row0[x1 * channels]), fx), Lerp(LoadTexel(row1[x0 * channels]), LoadTexel(row1[x1 * channels]), fx), fy);
+		}
+	};
+
+	// Formats of the displacement maps the texels are uploaded to as they are.
+	template <typename Texel>
+	struct DisplacementMapFormats;
+
+	template <>
+	struct DisplacementMapFormats<float>
+	{
+		static const TextureFormats::List displacement = TextureFormats::RGBA32F;
+		static const TextureFormats::List slope = TextureFormats::RG32F;
+	};
+
+	template <>
+	struct DisplacementMapFormats<Half>
+	{
+		static const TextureFormats::List displacement = TextureFormats::RGBA16F;
+		static const TextureFormats::List slope = TextureFormats::RG16F;
+	};
 
 	OceanComponent::OceanComponent( void ) : Component(CT_OCEANCOMPONENT)
 		, vertices(NULL)
@@ -30,56 +76,76 @@ namespace acqua
 		, indices(NULL)
 		, indexCount(0)
 		, simulationTime(0.0f)
-		, M(128)
-		, N(128)
-		, V(2.0f)
-		, L( V * V / k_Gravity )
-		, l(2.0f)
-		, A(1.0f)
-		, W(4.0f)
-		, WX(cos(W)), WZ(-sin(W))
-		, windAlignment(2.0f)
-		, dampReflections(0.5f)
-		, depth(200.0f)
-		, chopAmount(0.5f)
-		, foamSlopeRatio(0.07f)
-		, foamFader(0.1f)
-	{
-		seed = time(NULL);
-
-		//TODO: Look up references for this values.
-		const Real dx = 1.0f;
-		const Real dz = 1.0f;
-		LX = M * dx;
-		LZ = N * dz;
+		, fixedStep(0.0f)
+		, timeSinceFixedUpdate(0.0f)
+		, gridWidth(0)
+		, gridHeight(0)
+		, cascadeCount(0)
+		, displacementMaps(false)
+		, verticesDisplaced(false)
+		, asyncSimulation(false)
+		, looping(false)
+		, loopInterpolate(false)
+		, loopPeriod(0.0f)
+		, sequenceIndex(~0u)
+		, playing(false)
+		, requestedTime(0.0f)
+		, simulationPending(false)
+		, stopSimulation(false)
+		, graphicsContext(NULL)
+	{
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			displacementTextures[c][0] = displacementTextures[c][1] = 0;
+			slopeTextures[c][0] = slopeTextures[c][1] = 0;
+			currentMap[c] = 0;
+			mapWidth[c] = mapHeight[c] = 0;
+			presentedVersion[c] = ~0u;
+			presentedTime[c][0] = presentedTime[c][1] = 0.0f;
+			cascadeBlend[c] = 1.0f;
+		}
 	}
 
 	OceanComponent::~OceanComponent( void )
 	{
-		fftwf_destroy_plan(displacementYPlan);
-		fftwf_destroy_plan(displacementXPlan);
-		fftwf_destroy_plan(displacementZPlan);
+		StopSimulationThread();
+		DestroyDisplacementMaps();
 
-		fftwf_destroy_plan(normalXPlan);
-		fftwf_destroy_plan(normalZPlan);
+		delete [] vertices;
+		delete [] indices;
 	}
 
 	bool OceanComponent::Init( GameObject* o )
 	{
 		bool result = Component::Init(o);
 
+		graphicsContext = o->GetScene().GetGraphicsContext();
+		
+		// Also builds the mesh, at the size of the first cascade.
+		ResetOcean(OceanSettings());
+		result &= (geometry != NULL);
+
+		result &= o->AddComponent("GeometryRenderer");
+		GeometryRenderer* geometry_render = o->GetComponent<GeometryRenderer>();
+		if(geometry_render == NULL)
+			return false;
+
+		geometry_render->SetGeometry(geometry);
+
+		return result;
+	}
+
+	void OceanComponent::BuildMesh( u32 grid_width, u32 grid_height )
+	{
 		// Create vertex definition.
 		VertexLayoutAttrib vertex_attribs[] = 
 		{
 			{3, 0},
 			{3, sizeof(glm::vec3)},
-			{3, 2 * sizeof(glm::vec3)},
-			{2, 3 * sizeof(glm::vec3)},
-			{1, 3 * sizeof(glm::vec3) + sizeof(glm::vec2)}
+			{2, 2 * sizeof(glm::vec3)},
+			{1, 2 * sizeof(glm::vec3) + sizeof(glm::vec2)}
 		};
 		u32 num_vertex_attribs = sizeof(vertex_attribs) / sizeof(VertexLayoutAttrib);
-		
-		ResetOcean(OceanSettings());
 
 #pragma region OldMeshCode
 		//const u32	N_plus_1 = (N * GRID_MULTIPLIER) + 1;
@@ -130,16 +196,16 @@ namespace acqua
 		//}
 #pragma endregion
 
-		u32 map_width  = M * GRID_MULTIPLIER;
-		u32 map_height = N * GRID_MULTIPLIER;
-
-		float terrain_width = SEGMENT_WIDTH * (map_width - 1);
-		float terrain_height = SEGMENT_WIDTH * (map_height - 1);
+		gridWidth  = grid_width;
+		gridHeight = grid_height;
 
-		float half_terrain_width = terrain_width * 0.5f;
-		float half_terrain_height = terrain_height * 0.5f;
+		u32 map_width  = gridWidth;
+		u32 map_height = gridHeight;
 
+		delete [] vertices;
+		delete [] indices;
 		vertices = new VertexOcean[map_width * map_height];
+		vertexCount = 0;
 
 		for(u32 j = 0; j < map_height; ++j)
 		{
@@ -147,19 +213,12 @@ namespace acqua
 			{
 				u32 index = i + (j * map_width);
 				// Generate geometry information.
-				// Texture coordinates.
-				float u = i / static_cast<float>(map_width - 1);
-				float v = j / static_cast<float>(map_height - 1);
-
-				float x = (u * terrain_width) - half_terrain_width;
-				float y = 0.0f;
-				float z = (v * terrain_height) - half_terrain_height;
-
-				vertices[index].originalPosition = vertices[index].position = glm::vec3(x, y, z);
+				vertices[index].position = GetGridPosition(i, j);
 				vertices[index].normal = glm::vec3(0.0f, 1.0f, 0.0f);
 				
-				u = i / (float)(map_width - 1);//(i % M) / static_cast<float>(N - 1);
-				v = j / (float)(map_height - 1);//(j % N) / static_cast<float>(M - 1);
+				// Texture coordinates.
+				float u = i / (float)(map_width - 1);//(i % M) / static_cast<float>(N - 1);
+				float v = j / (float)(map_height - 1);//(j % N) / static_cast<float>(M - 1);
 				vertices[index].texcoords = glm::vec2(u, v);
 
 				vertices[index].foamAmount = 0.0f;
@@ -189,32 +248,70 @@ namespace acqua
 		}
 		indexCount = index - 1;
 
-		// We need geometry.
-		geometry = std::make_shared<Geometry>();
-		result &= geometry->Load(o->GetScene().GetGraphicsContext(), vertices, vertexCount, indices, indexCount, vertex_attribs, num_vertex_attribs);
+		// We need geometry. It is loaded again in place, so the renderer keeps drawing the same one.
+		if(geometry == NULL)
+			geometry = std::make_shared<Geometry>();
 
-		result &= o->AddComponent("GeometryRenderer");
-		GeometryRenderer* geometry_render = o->GetComponent<GeometryRenderer>();
-		if(geometry_render == NULL)
-			return false;
+		bool loaded = geometry->Load(graphicsContext, vertices, vertexCount, indices, indexCount, vertex_attribs, num_vertex_attribs);
+		ASSERT(loaded, "The ocean mesh couldn't be loaded.");
+		verticesDisplaced = false;
+	}
 
-		geometry_render->SetGeometry(geometry);
+	glm::vec3 OceanComponent::GetGridPosition( u32 i, u32 j ) const
+	{
+		// The grid is centred on the game object.
+		float terrain_width = SEGMENT_WIDTH * (gridWidth - 1);
+		float terrain_height = SEGMENT_WIDTH * (gridHeight - 1);
 
-		return result;
+		float u = i / static_cast<float>(gridWidth - 1);
+		float v = j / static_cast<float>(gridHeight - 1);
+
+		return glm::vec3((u * terrain_width) - terrain_width * 0.5f, 0.0f, (v * terrain_height) - terrain_height * 0.5f);
 	}
 
 	void OceanComponent::FixedUpdate( float fixed_delta_time )
 	{
+		const float scale = 1.0f / (GRID_MULTIPLIER * SEGMENT_WIDTH);
+
+		fixedStep = fixed_delta_time;
+		timeSinceFixedUpdate -= fixed_delta_time;
 
+		if(looping || playing)
+		{
+			// Nothing to simulate, the sequence is played back from the time.
+		}
+		else if(asyncSimulation)
+		{
+			// Ask for this step's time. Steps requested while the thread is busy collapse into the latest one.
+			{
+				std::lock_guard<std::mutex> lock(simulationMutex);
+				requestedTime = simulationTime;
+				simulationPending = true;
+			}
+			simulationRequested.notify_one();
+		}
+		else
+		{
+			SimulateOceanFFT(simulationTime, scale);
+		}
+
+		if(buoyancy.GetBodyCount() > 0)
+		{
+			OceanQuerySurface surface;
+			GetQuerySurface(surface);
+
+			WorkerPool& pool = (asyncSimulation || playing) ? presentPool : simulation.GetWorkerPool();
+			buoyancy.Step(surface, fixed_delta_time, &pool);
+		}
+
+		simulationTime += fixed_delta_time;
 	}
 
 	void OceanComponent::Update( float delta_time )
 	{
-		SimulateOceanFFT(simulationTime, 1.0f / (GRID_MULTIPLIER * SEGMENT_WIDTH));
-
-		geometry->UpdateVertexData(vertices, 0);
+		timeSinceFixedUpdate = glm::clamp(timeSinceFixedUpdate + delta_time, 0.0f, fixedStep);
 
-		simulationTime += delta_time;
+		PresentFrame();
 	}
 
 	void OceanComponent::Draw( float delta_time )
@@ -222,346 +319,608 @@ namespace acqua
 
 	}
 
-	acqua::Real OceanComponent::Ph(Real kx_,Real kz_ ) const
+	void OceanComponent::SimulateOceanFFT( float t, float scale )
 	{
-		Real k2 = kx_*kx_ + kz_*kz_;
+		simulation.Simulate(t, scale);
+
+		PackFrame(frames.GetBack(), t);
+		frames.Publish();
+	}
 
-		if (k2 == 0.0)
+	void OceanComponent::PackFrame( OceanFrame& frame, Real t )
+	{
+		frame.time = t;
+
+		for(u32 c = 0; c < cascadeCount; ++c)
 		{
-			return 0.0; // no DC component
+			// The slot may still hold this output from two frames ago.
+			const OceanCascade& cascade = simulation.GetCascade(c);
+			if(frame.version[c] == simulation.GetSimulationCount(c))
+				continue;
+			frame.version[c] = simulation.GetSimulationCount(c);
+			frame.cascadeTime[c] = cascade.GetLastUpdateTime();
+
+			cascade.PackTexels(&frame.displacement[c][0], &frame.slope[c][0]);
 		}
+	}
 
-		// damp out the waves going in the direction opposite the wind
-		float tmp = (WX * kx_  + WZ * kz_)/sqrt(k2);
-		if (tmp < 0) 
+	void OceanComponent::BakeLoop( u32 frame_count )
+	{
+		const float scale = 1.0f / (GRID_MULTIPLIER * SEGMENT_WIDTH);
+		const Real step = loopPeriod / frame_count;
+
+		loopFrames.resize(frame_count);
+		for(u32 f = 0; f < frame_count; ++f)
+		{
+			ResetFrame(loopFrames[f], true);
+		}
+
+		// The spectrum repeats after a period but the foam builds up over time, so a first period lets it settle
+		// and the recorded one leads back into its first frame.
+		for(u32 f = 0; f < 2 * frame_count; ++f)
 		{
-			tmp *= dampReflections;
+			Real t = f * step;
+			simulation.SimulateAll(t, scale);
+
+			if(f < frame_count)
+				continue;
+
+			OceanFrame& frame = loopFrames[f - frame_count];
+			PackFrame(frame, t - loopPeriod);
+			for(u32 c = 0; c < cascadeCount; ++c)
+			{
+				frame.cascadeTime[c] = frame.time;
+			}
 		}
 
-		return A * exp( -1.0f / (k2*Sqr(L))) * exp(-k2 * Sqr(l)) * pow(fabs(tmp),windAlignment) / (k2*k2);
+		size_t loop_bytes = 0;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			loop_bytes += (loopFrames[0].displacement[c].size() + loopFrames[0].slope[c].size()) * sizeof(OceanTexel);
+		}
+		statistics.loopMegabytes = static_cast<float>(loop_bytes * frame_count) / (1024.0f * 1024.0f);
 	}
 
-	void OceanComponent::SimulateOceanFFT( float t, float scale )
+	void OceanComponent::PresentSimulation( u32 c, const CascadeTexels& texels, bool first, bool persistent )
 	{
-		// Compute a new hTilda.
-		for(int i = 0; i < M; ++i)
+		if(displacementMaps && graphicsContext != NULL)
 		{
-			// Note the <= _N/2 here. See the fftw docs about
-			// the mechanics of the complex->real fft storage
-			for(int j = 0; j <= N / 2; ++j)
+			// Straight from the texels, so a baked sequence goes from the file mapping to the driver.
+			currentMap[c] = first ? 0 : 1 - currentMap[c];
+			graphicsContext->UploadTextureData(displacementTextures[c][currentMap[c]], 0, 0, texels.displacement);
+			graphicsContext->UploadTextureData(slopeTextures[c][currentMap[c]], 0, 0, texels.slope);
+			if(first)
 			{
-				Real omega_k = Omega(k(i,j));
-				hTilda(i, j) =	h0(i, j) * exp(ComplexReal(0, omega_k * t)) +
-								std::conj(h0Minus(i, j)) * exp(ComplexReal(0, -omega_k * t));
+				graphicsContext->UploadTextureData(displacementTextures[c][1], 0, 0, texels.displacement);
+				graphicsContext->UploadTextureData(slopeTextures[c][1], 0, 0, texels.slope);
 			}
 		}
 
+		// The queries read the texels in every mode.
+		if(persistent)
+		{
+			presentedTexels[c][0] = first ? texels : presentedTexels[c][1];
+			presentedTexels[c][1] = texels;
+		}
+		else
+		{
+			const size_t texel_count = static_cast<size_t>(cascadeLayout[c].M) * cascadeLayout[c].N;
 
-		FFTIn = scale * hTilda;
-
-		// Get y displacement_img.
-		fftwf_execute(displacementYPlan);
-
-		// x displacement_img
-		for (int i = 0 ; i  < M ; ++i)
-		{   
-			for (int j  = 0 ; j  <= N / 2 ; ++j)
-			{     
-				FFTIn(i,j) = -scale * chopAmount * k_Minus_i * 
-					hTilda(i,j) * (k(i,j) == 0.0 ? ComplexReal(0,0) : kx(i) / k(i,j)) ;   
+			previousFrame.displacement[c].swap(currentFrame.displacement[c]);
+			previousFrame.slope[c].swap(currentFrame.slope[c]);
+			currentFrame.displacement[c].assign(texels.displacement, texels.displacement + texel_count * 4);
+			currentFrame.slope[c].assign(texels.slope, texels.slope + texel_count * 2);
+			if(first)
+			{
+				previousFrame.displacement[c] = currentFrame.displacement[c];
+				previousFrame.slope[c] = currentFrame.slope[c];
 			}
+
+			presentedTexels[c][0] = CascadeTexels(&previousFrame.displacement[c][0], &previousFrame.slope[c][0]);
+			presentedTexels[c][1] = CascadeTexels(&currentFrame.displacement[c][0], &currentFrame.slope[c][0]);
 		}
-		fftwf_execute(displacementXPlan);
+	}
 
-		// z displacement_img
-		for (int i = 0 ; i  < M ; ++i)
-		{   
-			for (int j  = 0 ; j  <= N / 2 ; ++j) 
-			{                    
-				FFTIn(i,j) = -scale * chopAmount * k_Minus_i * 
-					hTilda(i,j) * (k(i,j) == 0.0 ? ComplexReal(0,0) : kz(j) / k(i,j)) ;
-			}
-		} 
-		fftwf_execute(displacementZPlan);
+	bool OceanComponent::PresentLatestSimulation()
+	{
+		bool new_frame = frames.Consume();
 
+		statistics.droppedFrames = frames.GetDroppedCount();
+		statistics.staleFrames = frames.GetStaleCount();
 
-		// Normals
-		/*for(int i = 0; i < M; ++i)
+		// Keep the last two simulations of each cascade. The front frame goes back to the simulation thread at the next
+		// Consume, so it is copied or uploaded right away.
+		bool changed = false;
+		if(new_frame)
 		{
-			for(int j = 0; j < N / 2; ++j)
+			const OceanFrame& frame = frames.GetFront();
+			for(u32 c = 0; c < cascadeCount; ++c)
 			{
-				FFTIn(i,j) = -k_Plus_i * hTilda(i, j) * kx(i);
+				if(frame.version[c] == ~0u || frame.version[c] == presentedVersion[c])
+					continue;
+
+				// Right after a reset both simulations are the first one.
+				bool first = (presentedVersion[c] == ~0u);
+				presentedVersion[c] = frame.version[c];
+				presentedTime[c][0] = first ? frame.cascadeTime[c] : presentedTime[c][1];
+				presentedTime[c][1] = frame.cascadeTime[c];
+
+				PresentSimulation(c, CascadeTexels(&frame.displacement[c][0], &frame.slope[c][0]), first, false);
+				changed = true;
 			}
 		}
 
-		fftwf_execute(normalXPlan);
+		// Show the simulation one step behind the last one requested, between the last two steps. The asynchronous
+		// simulation publishes each step a frame later, so it's shown a step further behind.
+		Real latency = (asyncSimulation ? 3.0f : 2.0f) * fixedStep;
+		Real present_time = simulationTime - latency + timeSinceFixedUpdate;
 
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			Real span = presentedTime[c][1] - presentedTime[c][0];
+			Real blend = (span > 0.0f) ? glm::clamp((present_time - presentedTime[c][0]) / span, 0.0f, 1.0f) : 1.0f;
 
-		for(int i = 0; i < M; ++i)
+			changed |= (blend != cascadeBlend[c]);
+			cascadeBlend[c] = blend;
+		}
+
+		return changed;
+	}
+
+	bool OceanComponent::PresentSequence()
+	{
+		// Position in the sequence. Frame f holds the time f * duration / frame_count.
+		const u32 frame_count = playing ? player.GetHeader().frameCount : static_cast<u32>(loopFrames.size());
+		const Real duration = playing ? frame_count * player.GetHeader().frameStep : loopPeriod;
+		Real present_time = simulationTime - fixedStep + timeSinceFixedUpdate;
+		Real cycle = fmod(present_time, duration);
+		cycle = cycle < 0.0f ? cycle + duration : cycle;
+
+		Real position = cycle / duration * frame_count;
+		u32 index = std::min(static_cast<u32>(position), frame_count - 1);
+		u32 next = (index + 1) % frame_count;
+
+		// Playing forward only needs the next frame, anything else starts over from the pair.
+		bool changed = false;
+		if(index != sequenceIndex)
 		{
-			for(int j = 0; j < N / 2; ++j)
+			bool consecutive = (sequenceIndex != ~0u) && (index == (sequenceIndex + 1) % frame_count);
+			for(u32 c = 0; c < cascadeCount; ++c)
 			{
-				FFTIn(i,j) = -k_Plus_i * hTilda(i, j) * kz(i);
+				if(!consecutive)
+					PresentSimulation(c, GetSequenceTexels(index, c), true, true);
+				PresentSimulation(c, GetSequenceTexels(next, c), false, true);
 			}
+			sequenceIndex = index;
+			changed = true;
+
+			if(playing)
+				player.ReadAhead(next);
 		}
 
-		fftwf_execute(normalZPlan);*/
-/*
-		sf::Image displacement_img;
-		displacement_img.create(M * GRID_MULTIPLIER, N * GRID_MULTIPLIER);*/
+		Real blend = loopInterpolate ? (position - index) : 0.0f;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			changed |= (blend != cascadeBlend[c]);
+			cascadeBlend[c] = blend;
+		}
+
+		return changed;
+	}
 
-		int x = 0;
-		int y = 0;
-		u32 grid_width = M * GRID_MULTIPLIER;
-		for(int i = 0; i < M; ++i)
+	OceanComponent::CascadeTexels OceanComponent::GetSequenceTexels( u32 frame, u32 c ) const
+	{
+		if(playing)
+			return CascadeTexels(player.GetDisplacement(frame, c), player.GetSlope(frame, c));
+
+		return CascadeTexels(&loopFrames[frame].displacement[c][0], &loopFrames[frame].slope[c][0]);
+	}
+
+	void OceanComponent::PresentFrame()
+	{
+		bool changed = (looping || playing) ? PresentSequence() : PresentLatestSimulation();
+
+		if(displacementMaps)
 		{
-			for(int j = 0; j < N; ++j)
+			// The shaders displace the grid, so it has to be flat. Only happens once after switching mode.
+			if(verticesDisplaced)
 			{
-				u32 index = i + j * grid_width;
-				normalArray(i, j) = glm::normalize(vertices[index].normal);
+				for(u32 v = 0; v < vertexCount; ++v)
+				{
+					vertices[v].position = GetGridPosition(v % gridWidth, v / gridWidth);
+					vertices[v].normal = glm::vec3(0.0f, 1.0f, 0.0f);
+					vertices[v].foamAmount = 0.0f;
+				}
+				geometry->UpdateVertexData(vertices, 0);
+				verticesDisplaced = false;
 			}
 		}
-		for(int i = 0; i < M; ++i)
+		else if(changed)
 		{
-			for(int j = 0; j < N; ++j)
+			// Nothing was presented since the last reset.
+			for(u32 c = 0; c < cascadeCount; ++c)
 			{
-				u32 index = i + j * grid_width;
+				if(presentedTexels[c][1].displacement == NULL)
+					return;
+			}
 
-				u32 index_plus_width = index + grid_width;
-				u32 index_plus_one = index + 1;
+			WorkerPool& pool = (asyncSimulation || playing) ? presentPool : simulation.GetWorkerPool();
 
-				int i_plus_one = (i + 1);
-				i_plus_one = i_plus_one >= M ? 0 : i_plus_one;
-				int j_plus_one = (j + 1);
-				j_plus_one = j_plus_one >= N ? 0 : j_plus_one;
+			// Blend the texels, then displace with the blend. Far fewer texels than vertices.
+			for(u32 c = 0; c < cascadeCount; ++c)
+			{
+				const float blend = cascadeBlend[c];
+				const OceanTexel* previous_displacement = presentedTexels[c][0].displacement;
+				const OceanTexel* current_displacement = presentedTexels[c][1].displacement;
+				const OceanTexel* previous_slope = presentedTexels[c][0].slope;
+				const OceanTexel* current_slope = presentedTexels[c][1].slope;
+				OceanTexel* blended_displacement = &blendedFrame.displacement[c][0];
+				OceanTexel* blended_slope = &blendedFrame.slope[c][0];
+				const int texel_count = static_cast<int>(cascadeLayout[c].M * cascadeLayout[c].N);
+
+				pool.ParallelFor(0, texel_count, [&](int texel_begin, int texel_end)
+				{
+					for(int i = texel_begin * 4; i < texel_end * 4; ++i)
+						StoreTexel(blended_displacement[i], Lerp(LoadTexel(previous_displacement[i]), LoadTexel(current_displacement[i]), blend));
 
-				glm::vec3 v0 = vertices[index].originalPosition + glm::vec3(displacementX(i,j) * 0.8f, displacementY(i,j), 0.8f * displacementZ(i,j));
-				glm::vec3 v1 = vertices[index_plus_width].originalPosition + glm::vec3(0.8f * displacementX(i,j_plus_one), displacementY(i,j_plus_one), 0.8f * displacementZ(i,j_plus_one));
-				glm::vec3 v2 = vertices[index_plus_one].originalPosition + glm::vec3(0.8f * displacementX(i_plus_one,j), displacementY(i_plus_one,j), 0.8f *  displacementZ(i_plus_one,j));
-				glm::vec3 normal = glm::normalize( glm::cross( v1 - v0, v2 - v0 ) );
+					for(int i = texel_begin * 2; i < texel_end * 2; ++i)
+						StoreTexel(blended_slope[i], Lerp(LoadTexel(previous_slope[i]), LoadTexel(current_slope[i]), blend));
+				});
+			}
 
-				normalArray(i, j) += normal;
-				normalArray(i, j_plus_one) += normal;
-				normalArray(i_plus_one, j) += normal;
+			DisplaceVertices(blendedFrame);
+			geometry->UpdateVertexData(vertices, 0);
+			verticesDisplaced = true;
+		}
+	}
 
-				//second tri.
-				glm::vec3 v3 = vertices[index_plus_width + 1].originalPosition + glm::vec3(0.8f * displacementX(i_plus_one,j_plus_one), displacementY(i_plus_one, j_plus_one), 0.8f * displacementZ(i_plus_one, j_plus_one));
-				normal = glm::normalize( glm::cross( v1 - v3, v1 - v2 ) );
+	bool OceanComponent::GetQuerySurface( OceanQuerySurface& surface ) const
+	{
+		// The grid is centred on the game object, with texel centre (0, 0) of every cascade at its first vertex.
+		const glm::vec3& position = GetGameObject().GetTransform().GetPosition();
+		surface = OceanQuerySurface();
+		surface.originX = position.x - SEGMENT_WIDTH * (gridWidth - 1) * 0.5f;
+		surface.originY = position.y;
+		surface.originZ = position.z - SEGMENT_WIDTH * (gridHeight - 1) * 0.5f;
+
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			if(presentedTexels[c][1].displacement == NULL)
+				return false;
+		}
 
-				normalArray(i, j_plus_one) += normal;
-				normalArray(i_plus_one, j) += normal;
-				normalArray(i_plus_one, j_plus_one) += normal;
-			}
+		surface.cascadeCount = cascadeCount;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			OceanQueryCascade& cascade = surface.cascades[c];
+			cascade.displacement[0] = presentedTexels[c][0].displacement;
+			cascade.displacement[1] = presentedTexels[c][1].displacement;
+			cascade.slope[0] = presentedTexels[c][0].slope;
+			cascade.slope[1] = presentedTexels[c][1].slope;
+			cascade.blend = cascadeBlend[c];
+			cascade.M = cascadeLayout[c].M;
+			cascade.N = cascadeLayout[c].N;
+			cascade.texelsPerUnitX = cascadeLayout[c].M / cascadeLayout[c].patchSizeX;
+			cascade.texelsPerUnitZ = cascadeLayout[c].N / cascadeLayout[c].patchSizeZ;
 		}
 
+		return true;
+	}
+
+	void OceanComponent::QuerySurface( u32 count, const Real* x, const Real* z, const OceanQueryResults& results, const OceanQueryOptions& options )
+	{
+		OceanQuerySurface surface;
+		GetQuerySurface(surface);
+
+		WorkerPool& pool = (asyncSimulation || playing) ? presentPool : simulation.GetWorkerPool();
+		QueryOceanSurface(surface, count, x, z, results, options, &pool);
+	}
 
-		for(int i = 0; i < M * GRID_MULTIPLIER; ++i)
+	void OceanComponent::DisplaceVertices( const OceanFrame& frame )
+	{
+		// Texels of each cascade per vertex of the grid.
+		Real texel_scale_x[k_MaxOceanCascades];
+		Real texel_scale_z[k_MaxOceanCascades];
+		for(u32 c = 0; c < cascadeCount; ++c)
 		{
-			for(int j = 0; j < N * GRID_MULTIPLIER; ++j)
-			{
-				int x = i % M;
-				int y = j % N;
-				u32 index = i + j * M * GRID_MULTIPLIER;
-				vertices[index].position = vertices[index].originalPosition + glm::vec3(0.8f * displacementX(x, y), displacementY(x, y), 0.8f * displacementZ(x, y));
-				
-				vertices[index].normal.y = 1.0f/scale;
-				vertices[index].normal = normalArray(x, y);//glm::normalize(vertices[index].normal);
-				
-				int x_minus_1 = (x - 1) % N;
-				int y_minus_1 = (y - 1) % M;
-				
-				int x_plus_1 = (x + 1) % N;
-				int y_plus_1 = (y + 1) % M;
+			texel_scale_x[c] = SEGMENT_WIDTH * cascadeLayout[c].M / cascadeLayout[c].patchSizeX;
+			texel_scale_z[c] = SEGMENT_WIDTH * cascadeLayout[c].N / cascadeLayout[c].patchSizeZ;
+		}
 
-				float foam_add = -foamFader;
-				//if(x_minus_1 >= 0 || y_minus_1 >= 0)
+		// Sum the cascades over the whole grid. Every vertex only depends on itself and the simulation output.
+		WorkerPool& pool = (asyncSimulation || playing) ? presentPool : simulation.GetWorkerPool();
+		pool.ParallelFor(0, gridHeight, [&](int row_begin, int row_end)
+		{
+			for(int j = row_begin; j < row_end; ++j)
+			{
+				for(int i = 0; i < gridWidth; ++i)
 				{
-					float jxx = scale * (displacementX(x, y) - displacementX(x_minus_1, y));
-					//float jxz = scale * (displacementX(x, y) - displacementX(x, y_minus_1));
-					//float jzx = scale * (displacementZ(x, y) - displacementZ(x_minus_1, y));
-					float jzz = scale * (displacementZ(x, y) - displacementZ(x, y_minus_1));
+					glm::vec3 displacement(0.0f, 0.0f, 0.0f);
+					Real slope_x = 0.0f;
+					Real slope_z = 0.0f;
+					Real foam = 0.0f;
 
-					
-
-					float j = jxx < jzz ? jxx : jzz;
-					if(j < -foamSlopeRatio)
+					for(u32 c = 0; c < cascadeCount; ++c)
 					{
-						foam_add *= -1;
+						const int M = static_cast<int>(cascadeLayout[c].M);
+						const OceanTexel* displacement_texels = &frame.displacement[c][0];
+						const OceanTexel* slope_texels = &frame.slope[c][0];
+						BilinearTap tap(i * texel_scale_x[c], j * texel_scale_z[c], M, cascadeLayout[c].N);
+
+						displacement.x += tap.Sample(displacement_texels, M, 4, 0);
+						displacement.y += tap.Sample(displacement_texels, M, 4, 1);
+						displacement.z += tap.Sample(displacement_texels, M, 4, 2);
+						foam += tap.Sample(displacement_texels, M, 4, 3);
+
+						slope_x += tap.Sample(slope_texels, M, 2, 0);
+						slope_z += tap.Sample(slope_texels, M, 2, 1);
 					}
+
+					// The normal of the height field y = h(x, z) is (-dh/dx, 1, -dh/dz).
+					u32 index = i + j * gridWidth;
+					vertices[index].position = GetGridPosition(i, j) + displacement;
+					vertices[index].normal = glm::normalize(glm::vec3(-slope_x, 1.0f, -slope_z));
+					vertices[index].foamAmount = std::min(foam, 1.0f);
 				}
-				vertices[index].foamAmount = glm::clamp(vertices[index].foamAmount + foam_add, 0.0f, 1.0f);
-
-				/*glm::vec2 foam_vec = glm::vec2(-normalX(x, y), -normalZ(x, y));
-				float foam =  foam_vec.x > foam_vec.y ? foam_vec.x : foam_vec.y;
-				float foam_add = foam > 100.0f ? +0.001f : -0.001f;
-				vertices[index].foamAmount = glm::clamp(vertices[index].foamAmount + foam_add, 0.0f, 1.0f);*/
-
-				//float height = displacementY(x, y) / A;
-				//sf::Uint8 height_c = static_cast<sf::Uint8>(height * 255);
-				//sf::Color c(height_c,height_c,height_c,255);
-				/*sf::Color c(static_cast<sf::Uint8>((vertices[index].normal.x * 255)),
-					static_cast<sf::Uint8>((vertices[index].normal.y * 255)),
-					static_cast<sf::Uint8>((vertices[index].normal.z * 255)));
-				*///displacement_img.setPixel(i,j, c);
 			}
+		});
+	}
+
+	void OceanComponent::ResetFrame( OceanFrame& frame, bool used ) const
+	{
+		frame.time = 0.0f;
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			size_t texel_count = (used && c < cascadeCount) ? static_cast<size_t>(cascadeLayout[c].M) * cascadeLayout[c].N : 0;
+			frame.cascadeTime[c] = 0.0f;
+			frame.version[c] = ~0u;
+			if(texel_count == 0)
+			{
+				std::vector<OceanTexel>().swap(frame.displacement[c]);
+				std::vector<OceanTexel>().swap(frame.slope[c]);
+				continue;
+			}
+
+			frame.displacement[c].assign(texel_count * 4, OceanTexel());
+			frame.slope[c].assign(texel_count * 2, OceanTexel());
 		}
+	}
 
-		//int x = 0;
-		//int y = 0;
-		//u32 grid_width = M * GRID_MULTIPLIER;
-		//for(int i = 0; i < M; ++i)
-		//{
-		//	for(int j = 0; j < N; ++j)
-		//	{
-		//		u32 index = i + j * grid_width;
+	size_t OceanComponent::GetFrameBytes( const OceanFrame& frame )
+	{
+		size_t bytes = 0;
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			bytes += (frame.displacement[c].capacity() + frame.slope[c].capacity()) * sizeof(OceanTexel);
+		}
+		return bytes;
+	}
 
-		//		u32 index_plus_width = index + grid_width;
-		//		u32 index_plus_one = index + 1;
+	OceanComponent::MemoryReport OceanComponent::GetMemoryReport() const
+	{
+		MemoryReport report;
+		report.simulation = simulation.GetMemory();
 
-		//		// first triangle.
-		//		VertexOcean& v0 = vertices[index];
-		//		VertexOcean& v1 = vertices[index_plus_width];
-		//		VertexOcean& v2 = vertices[index_plus_one];
+		// The slots of the triple buffer are written by the simulation thread, they are the size of the presented copies.
+		report.frames = (frames.GetSlotCount() + 1) * GetFrameBytes(currentFrame) + GetFrameBytes(previousFrame) + GetFrameBytes(blendedFrame);
 
-		//		glm::vec3 normal = glm::normalize( glm::cross( v1.position - v0.position, v2.position - v0.position ) );
+		for(size_t f = 0; f < loopFrames.size(); ++f)
+		{
+			report.loop += GetFrameBytes(loopFrames[f]);
+		}
 
-		//		v0.normal += normal;
-		//		v1.normal += normal;
-		//		v2.normal += normal;
+		report.mesh = vertexCount * sizeof(VertexOcean) + (indices != NULL ? sizeof(u32) * (gridWidth - 1) * (gridHeight - 1) * 6 : 0);
+		report.buoyancy = buoyancy.GetMemoryBytes();
+		return report;
+	}
 
-		//		//second tri.
-		//		VertexOcean& v3 = vertices[index_plus_width + 1];
-		//		normal = glm::normalize( glm::cross( v1.position - v3.position, v1.position - v2.position ) );
+	void OceanComponent::StartSimulationThread()
+	{
+		stopSimulation = false;
+		simulationPending = false;
+		simulationThread = std::thread(&OceanComponent::SimulationLoop, this);
+	}
 
-		//		v1.normal += normal;
-		//		v2.normal += normal;
-		//		v3.normal += normal;
-		//	}
-		//}
+	void OceanComponent::StopSimulationThread()
+	{
+		if(!simulationThread.joinable())
+			return;
 
-		
-		// Generate normals.
-		/*for ( unsigned int i = 0; i < indexCount; i += 3 )
 		{
-			glm::vec3 v0 = vertices[ indices[i + 0] ].position;
-			glm::vec3 v1 = vertices[ indices[i + 1] ].position;
-			glm::vec3 v2 = vertices[ indices[i + 2] ].position;
+			std::lock_guard<std::mutex> lock(simulationMutex);
+			stopSimulation = true;
+		}
+		simulationRequested.notify_one();
+		simulationThread.join();
+	}
+
+	void OceanComponent::SimulationLoop()
+	{
+		const float scale = 1.0f / (GRID_MULTIPLIER * SEGMENT_WIDTH);
+
+		for(;;)
+		{
+			Real t = 0.0f;
+			{
+				std::unique_lock<std::mutex> lock(simulationMutex);
+				while(!simulationPending && !stopSimulation)
+					simulationRequested.wait(lock);
 
-			glm::vec3 normal = glm::normalize( glm::cross( v1 - v0, v2 - v0 ) );
+				if(stopSimulation)
+					return;
 
-			vertices[ indices[i + 0] ].normal += normal;
-			vertices[ indices[i + 1] ].normal += normal;
-			vertices[ indices[i + 2] ].normal += normal;
-		}*/
-		
+				// Requests made while simulating collapse into the latest one.
+				t = requestedTime;
+				simulationPending = false;
+			}
+
+			SimulateOceanFFT(t, scale);
+		}
 	}
 
-	void OceanComponent::ResetOcean( const OceanSettings& settings )
+	void OceanComponent::BindDisplacementMaps( GraphicsContext& graphics_context, ShaderProgram& shader_program ) const
 	{
+		shader_program.SetUniform("useDisplacementMaps", displacementMaps ? 1.0 : 0.0);
+		if(!displacementMaps)
+			return;
 
-		V = settings.V;
-		L = V * V / k_Gravity;
-		l = settings.l;
-		A = settings.A;
-		W = settings.W * 0.0174532925f; // Convert to radians.
-		WX = cos(W); 
-		WZ = -sin(W);
-		windAlignment = settings.windAlignment;
-		dampReflections = settings.dampReflections;
-		depth = settings.depth;
-		chopAmount = settings.chopAmount;
-
-		foamFader = settings.foamFader;
-		foamSlopeRatio = settings.foamSlopeRatio;
+		// Texture coordinates of the undisplaced grid. Vertex (i, j) samples the centre of texel (i, j) * SEGMENT_WIDTH * (M, N) / patchSize,
+		// the same texels the vertices are displaced with on the CPU.
+		const Real half_width = SEGMENT_WIDTH * (gridWidth - 1) * 0.5f;
+		const Real half_height = SEGMENT_WIDTH * (gridHeight - 1) * 0.5f;
 
-		// FFTW Inputs allocation.
-		FFTIn.resize(M, 1 + N / 2);
-		hTilda.resize(M, 1 + N / 2);
+		glm::vec4 mappings[k_MaxOceanCascades];
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			const CascadeLayout& layout = cascadeLayout[c];
+			Real inv_patch_x = 1.0f / layout.patchSizeX;
+			Real inv_patch_z = 1.0f / layout.patchSizeZ;
+			mappings[c] = glm::vec4(inv_patch_x, inv_patch_z, half_width * inv_patch_x + 0.5f / layout.M, half_height * inv_patch_z + 0.5f / layout.N);
+
+			// Current maps, then the previous ones.
+			u32 current = currentMap[c];
+			graphics_context.UseTexture(k_OceanMapTextureSlot + c, displacementTextures[c][current]);
+			graphics_context.UseTexture(k_OceanMapTextureSlot + k_MaxOceanCascades + c, slopeTextures[c][current]);
+			graphics_context.UseTexture(k_OceanMapTextureSlot + 2 * k_MaxOceanCascades + c, displacementTextures[c][1 - current]);
+			graphics_context.UseTexture(k_OceanMapTextureSlot + 3 * k_MaxOceanCascades + c, slopeTextures[c][1 - current]);
+		}
 
-		// Initialize FFTW plans.
-		displacementY.resize(M, N);
-		displacementX.resize(M, N);
-		displacementZ.resize(M, N);
+		shader_program.SetUniform("oceanCascadeCount", cascadeCount);
+		shader_program.SetUniformFromArray("oceanCascadeMapping", (void*)&mappings[0].x, cascadeCount, false);
+		shader_program.SetUniformFromArray("oceanCascadeBlend", (void*)&cascadeBlend[0], cascadeCount, false);
+	}
 
-		normalX.resize(M, N);
-		normalZ.resize(M, N);
-		normalArray.resize(M, N);
+	void OceanComponent::CreateDisplacementMaps()
+	{
+		if(graphicsContext == NULL)
+			return;
 
-		fftwf_destroy_plan(displacementYPlan);
-		fftwf_destroy_plan(displacementXPlan);
-		fftwf_destroy_plan(displacementZPlan);
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			u32 width = (c < cascadeCount) ? cascadeLayout[c].M : 0;
+			u32 height = (c < cascadeCount) ? cascadeLayout[c].N : 0;
 
-		displacementYPlan = fftwf_plan_dft_c2r_2d(M, N, reinterpret_cast<fftwf_complex*>(FFTIn.data()), reinterpret_cast<Real*>(displacementY.data()), FFTW_ESTIMATE);
-		displacementXPlan = fftwf_plan_dft_c2r_2d(M,N, reinterpret_cast<fftwf_complex*>(FFTIn.data()), reinterpret_cast<Real*>(displacementX.data()), FFTW_ESTIMATE);
-		displacementZPlan = fftwf_plan_dft_c2r_2d(M,N, reinterpret_cast<fftwf_complex*>(FFTIn.data()), reinterpret_cast<Real*>(displacementZ.data()), FFTW_ESTIMATE);
+			if(width == mapWidth[c] && height == mapHeight[c])
+				continue;
 
-		fftwf_destroy_plan(normalXPlan);
-		fftwf_destroy_plan(normalZPlan);
+			mapWidth[c] = width;
+			mapHeight[c] = height;
 
-		normalXPlan = fftwf_plan_dft_c2r_2d(M,N, reinterpret_cast<fftwf_complex*>(FFTIn.data()), reinterpret_cast<Real*>(normalX.data()), FFTW_ESTIMATE);
-		normalZPlan = fftwf_plan_dft_c2r_2d(M,N, reinterpret_cast<fftwf_complex*>(FFTIn.data()), reinterpret_cast<Real*>(normalZ.data()), FFTW_ESTIMATE);
+			for(u32 m = 0; m < 2; ++m)
+			{
+				graphicsContext->DestroyTexture(displacementTextures[c][m]);
+				graphicsContext->DestroyTexture(slopeTextures[c][m]);
+				displacementTextures[c][m] = slopeTextures[c][m] = 0;
 
-		// Initialize matrices needed.
-		k.resize(M, 1 + N / 2);
-		h0.resize(M, N);
-		h0Minus.resize(M, N);
-		kx.resize(M);
-		kz.resize(N);
+				if(width == 0)
+					continue;
 
-		// Pre-compute k vectors (directions).
-		// +ve components
-		for(int i = 0; i <= M / 2; ++i)
-		{
-			kx(i) = 2.0f * k_Pi * i / LX;
+				displacementTextures[c][m] = graphicsContext->CreateTexture(TextureTypes::Tex2D, width, height, 1, DisplacementMapFormats<OceanTexel>::displacement, false, false, false, false);
+				slopeTextures[c][m] = graphicsContext->CreateTexture(TextureTypes::Tex2D, width, height, 1, DisplacementMapFormats<OceanTexel>::slope, false, false, false, false);
+			}
 		}
+	}
 
-		// -ve components
-		for(int i = M - 1, ii = 0; i > M / 2; --i, ++ii)
-		{
-			kx(i) = -2.0f * k_Pi * ii / LX;
-		}
+	void OceanComponent::DestroyDisplacementMaps()
+	{
+		if(graphicsContext == NULL)
+			return;
 
-		// +ve components
-		for(int i = 0; i <= N / 2; ++i)
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
 		{
-			kz(i) = 2.0f * k_Pi * i / LZ;
+			for(u32 m = 0; m < 2; ++m)
+			{
+				graphicsContext->DestroyTexture(displacementTextures[c][m]);
+				graphicsContext->DestroyTexture(slopeTextures[c][m]);
+				displacementTextures[c][m] = slopeTextures[c][m] = 0;
+			}
+			mapWidth[c] = mapHeight[c] = 0;
 		}
+	}
+
+	void OceanComponent::ResetOcean( const OceanSettings& settings )
+	{
+		// The simulation thread owns the cascades while it runs.
+		StopSimulationThread();
 
-		// -ve components
-		for(int i = N - 1, ii = 0; i > N / 2; --i, ++ii)
+		// A baked sequence replaces the cascades, with the sizes it was baked at. Simulate if it can't be opened.
+		playing = !settings.playbackFile.empty() && player.Open(settings.playbackFile, settings.playbackReadAhead);
+		if(!playing)
+			player.Close();
+
+		if(playing)
 		{
-			kz(i) = -2.0f * k_Pi * ii / LZ;
+			const OceanBakeHeader& header = player.GetHeader();
+			cascadeCount = header.cascadeCount;
+			for(u32 c = 0; c < cascadeCount; ++c)
+			{
+				cascadeLayout[c].M = header.M[c];
+				cascadeLayout[c].N = header.N[c];
+				cascadeLayout[c].patchSizeX = header.LX[c];
+				cascadeLayout[c].patchSizeZ = header.LZ[c];
+			}
 		}
-
-		// Pre-compute the k matrix (magnitude of k vectors)
-		for(int i = 0; i < M; ++i)
+		else
 		{
-			for(int j = 0; j <= N / 2; ++j) // Note <= _N/2 here, see the fftw notes about complex->real fft storage.
+			simulation.Reset(settings);
+			cascadeCount = simulation.GetCascadeCount();
+			for(u32 c = 0; c < cascadeCount; ++c)
 			{
-				k(i, j) = sqrt(kx(i) * kx(i) + kz(j) * kz(j));
+				const OceanCascade& cascade = simulation.GetCascade(c);
+				cascadeLayout[c].M = cascade.GetM();
+				cascadeLayout[c].N = cascade.GetN();
+				cascadeLayout[c].patchSizeX = cascadeLayout[c].patchSizeZ = cascade.GetPatchSize();
 			}
 		}
 
-		// DEBUG: Want to look at the wavelengths of the components ?
-		//for (int i = 0 ; i < M ; ++i)
-		//std::cout << "kx[" << i << "]=" << kx(i) << " wl=" << Wavelength(kx(i)) << " factor = " << Ph(kx(i),kx(i)) << std::endl ;
-
-		Imath::Rand32 rand(seed);
-
-		// Pre-compute hTilda0.
-		for(int i = 0; i < M; ++i)
+		// The render grid follows the resolution of the first cascade.
+		u32 grid_width = cascadeLayout[0].M * GRID_MULTIPLIER;
+		u32 grid_height = cascadeLayout[0].N * GRID_MULTIPLIER;
+		if(grid_width != gridWidth || grid_height != gridHeight)
+			BuildMesh(grid_width, grid_height);
+
+		// Empty frames sized for the new cascades. The frames of the live simulation are freed when a sequence plays back,
+		// the blend when the shaders displace the grid.
+		looping = settings.loop && !playing;
+		bool live = !looping && !playing;
+		frames.Reset();
+		for(u32 f = 0; f < frames.GetSlotCount(); ++f)
 		{
-			for(int j = 0; j < N; ++j)
-			{
-				Real r1 = Imath::gaussRand(rand);
-				Real r2 = Imath::gaussRand(rand);
-				ComplexReal h = ComplexReal(r1, r2) * float(sqrt(Ph(kx(i), kz(j)) / 2.0f));
-				h0(i, j) = h;
-				h0Minus(i, j) = ComplexReal(r1, r2) * float(sqrt(Ph(-kx(i), -kz(j)) / 2.0f));
+			ResetFrame(frames.GetSlot(f), live);
+		}
+		ResetFrame(previousFrame, live);
+		ResetFrame(currentFrame, live);
+		ResetFrame(blendedFrame, !settings.displacementMaps);
+		statistics = Statistics();
+		statistics.playbackFrames = playing ? player.GetHeader().frameCount : 0;
 
-				//std::cout << "h0("<<i<<", "<<j<<") = " << h0(i,j).real() << " - " << h0(i,j).imag() << std::endl;
-			}
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+		{
+			presentedTexels[c][0] = presentedTexels[c][1] = CascadeTexels();
+			presentedVersion[c] = ~0u;
+			presentedTime[c][0] = presentedTime[c][1] = 0.0f;
+			cascadeBlend[c] = 1.0f;
 		}
+
+		// The maps are filled by the next simulation, which follows every reset as the cascades start out of date.
+		displacementMaps = settings.displacementMaps;
+		if(displacementMaps)
+			CreateDisplacementMaps();
+		else
+			DestroyDisplacementMaps();
+
+		// A loop is simulated once here and only played back afterwards.
+		loopInterpolate = settings.loopInterpolate;
+		loopPeriod = settings.loopPeriod;
+		sequenceIndex = ~0u;
+		loopFrames.clear();
+		if(looping)
+			BakeLoop(std::max(settings.loopFrameCount, 2u));
+
+		asyncSimulation = settings.asyncSimulation && !looping && !playing;
+		presentPool.SetThreadCount((asyncSimulation || playing) ? settings.threadCount : 1);
+		if(asyncSimulation)
+			StartSimulationThread();
 	}
 
 }
@@ -1,56 +1,31 @@
 #pragma once
+#include "BuoyancySystem.h"
 #include "Component.h"
 #include "Types.h"
 #include "Geometry.h"
+#include "OceanBake.h"
+#include "OceanCascade.h"
+#include "OceanQuery.h"
+#include "OceanSimulation.h"
+#include "TripleBuffer.h"
+#include "WorkerPool.h"
 
-#include <complex>
-
-#include <fftw3.h>
-#include <blitz/array.h>
 #include <glm/glm.hpp>
-#include <ImathRandom.h>
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace acqua
 {
-	// Type definitions.
-	typedef float							Real;
-	typedef std::complex<Real>				ComplexReal;
-	typedef blitz::Array<Real, 1>			VectorReal;
-	typedef blitz::Array<Real, 2>			MatrixReal;
-	typedef blitz::Array<glm::vec3, 2>		Vector3Array;
-	typedef blitz::Array<ComplexReal, 2>	MatrixComplex;
-
-	// useful constants.
-	const float k_Gravity = 9.81f;
-	const double k_Pi = 3.14159265358979323846264338327950288;
-
-	const ComplexReal k_Minus_i(0,-1);
-	const ComplexReal k_Plus_i(0,1);
-
-	// Ocean Settings
-	struct OceanSettings
-	{
-		Real V;
-		Real l;
-		Real A;
-		Real W;
-		Real windAlignment;
-
-		Real dampReflections;
-		Real depth;
-
-		Real chopAmount;
+	// Forward declarations.
+	class GraphicsContext;
+	class ShaderProgram;
 
-		Real foamSlopeRatio; //Decides the slope ratio to start the foam;
-		Real foamFader;	//Decides how much the foam increases and decreases over frames.
-
-		OceanSettings() : V(4.0f), l(2.0f), A(1.0f), W(2.0f), windAlignment(2.0f), dampReflections(0.5f), depth(200.0f), chopAmount(0.5f), foamSlopeRatio(0.07f), foamFader(0.1f)
-		{
-
-		}
-	};
+	// First texture unit of the displacement maps. The ocean shaders bind the slope maps after them.
+	const u32 k_OceanMapTextureSlot = 6;
 
 	// Simulate an ocean using Tessendorf's algorithm and FFT.
 	class OceanComponent : public Component
@@ -58,16 +33,72 @@ namespace acqua
 	private:
 		//typedef fftw_complex complex;
 
+		// The undisplaced position of a vertex is recomputed from its index, see GetGridPosition.
 		struct VertexOcean
 		{
 			glm::vec3	position; 
 			glm::vec3	normal;
-			glm::vec3	originalPosition;
 			glm::vec2	texcoords;
 			Real		foamAmount;
 		};
 
+		// Output of every cascade at one simulation time, packed as the texels of the displacement maps.
+		struct OceanFrame
+		{
+			Real time;
+			Real cascadeTime[k_MaxOceanCascades]; // Time each cascade was last simulated at. Can be older than time with update rates.
+			u32 version[k_MaxOceanCascades]; // Simulation of each cascade the texels come from. ~0 when they're empty.
+			std::vector<OceanTexel> displacement[k_MaxOceanCascades]; // (N, M, 4). Displacement in xyz, foam in w.
+			std::vector<OceanTexel> slope[k_MaxOceanCascades]; // (N, M, 2). dh/dx, dh/dz.
+		};
+
+		// Texels of one cascade at one simulation, laid out like in OceanFrame.
+		struct CascadeTexels
+		{
+			const OceanTexel* displacement;
+			const OceanTexel* slope;
+
+			CascadeTexels() : displacement(NULL), slope(NULL) {}
+			CascadeTexels(const OceanTexel* displacement_texels, const OceanTexel* slope_texels) : displacement(displacement_texels), slope(slope_texels) {}
+		};
+
+		// Size of a presented cascade, from the cascade itself or from the baked sequence.
+		struct CascadeLayout
+		{
+			u32 M;
+			u32 N;
+			Real patchSizeX; // World units.
+			Real patchSizeZ;
+
+			CascadeLayout() : M(0), N(0), patchSizeX(0.0f), patchSizeZ(0.0f) {}
+		};
+
 	public:
+		// Handoff between the simulation and the frame loop.
+		struct Statistics
+		{
+			u32 droppedFrames; // Simulated but replaced by a newer frame before being shown.
+			u32 staleFrames; // Updates that found no new simulation and kept showing the last one.
+			float loopMegabytes; // Memory held by the frames of the loop.
+			u32 playbackFrames; // Frames of the baked sequence played back. 0 when simulating.
+
+			Statistics() : droppedFrames(0), staleFrames(0), loopMegabytes(0.0f), playbackFrames(0) {}
+		};
+
+		// Bytes held by the ocean on the CPU, by subsystem.
+		struct MemoryReport
+		{
+			CascadeMemory simulation; // Summed over the cascades. Left over from the last simulation when a baked sequence plays back.
+			size_t frames; // Texels handed over by the simulation, the copies presented and the blend of the displaced vertices.
+			size_t loop; // Texels of the frames of the loop. A baked sequence is mapped from its file instead.
+			size_t mesh; // Vertices and indices of the render grid.
+			size_t buoyancy; // Bodies, probes and their queries.
+
+			MemoryReport() : frames(0), loop(0), mesh(0), buoyancy(0) {}
+
+			size_t GetTotal() const { return simulation.GetTotal() + frames + loop + mesh + buoyancy; }
+		};
+
 		OceanComponent(void);
 		~OceanComponent(void);
 
@@ -82,22 +113,75 @@ namespace acqua
 		// Public interface
 		void ResetOcean(const OceanSettings& settings);
 
+		// Binds the displacement maps and sets the uniforms the ocean shaders tile them with.
+		void BindDisplacementMaps(GraphicsContext& graphics_context, ShaderProgram& shader_program) const;
+
+		const Statistics& GetStatistics() const { return statistics; }
+		MemoryReport GetMemoryReport() const;
+
+		// The surface shown at the present time, in world space. Only the position of the game object moves it.
+		// It reads the presented texels in place, so it holds until the next Update. False, and flat, before
+		// the first simulation is presented.
+		bool GetQuerySurface(OceanQuerySurface& surface) const;
+
+		// Samples the surface shown at the present time at the world positions (x[i], z[i]), see QueryOceanSurface.
+		// From the frame loop, between Updates. Uses the threads of the frame loop.
+		void QuerySurface(u32 count, const Real* x, const Real* z, const OceanQueryResults& results, const OceanQueryOptions& options = OceanQueryOptions());
+
+		// Bodies floating on the ocean, stepped with the fixed updates on the surface shown at the time.
+		BuoyancySystem& GetBuoyancy() { return buoyancy; }
+		const BuoyancySystem& GetBuoyancy() const { return buoyancy; }
+
 	private:
-		// Ocean simulation methods.
-		Real Ph(Real k_x, Real k_z) const; // Phillips spectrum.
-		
-		Real Wavelength(Real k_) const
-		{
-			return 2.0f * k_Pi / k_;
-		}
+		// Builds the render grid and loads it into the geometry, replacing the previous one.
+		void BuildMesh(u32 grid_width, u32 grid_height);
 
-		Real Omega(Real k_) const
-		{
-			return sqrt(k_Gravity * k_ * tanh(k_ * depth) );
-		}
+		// Undisplaced position of vertex (i, j) of the render grid, in object space.
+		glm::vec3 GetGridPosition(u32 i, u32 j) const;
 
+		// Simulates the cascades due at time t and publishes their outputs as a new frame.
+		// Runs on the simulation thread when the simulation is asynchronous.
 		void SimulateOceanFFT(float t, float scale);
 
+		// Writes the outputs of the cascades at time t to frame, skipping the ones it already holds.
+		void PackFrame(OceanFrame& frame, Real t);
+
+		// Simulates one period of the loop into frame_count frames.
+		void BakeLoop(u32 frame_count);
+
+		// Shows the cascades interpolated between their last two simulations, on the vertices or through the displacement maps.
+		void PresentFrame();
+
+		// Pick the two simulations to show and the blend between them. True when what is shown changed.
+		bool PresentLatestSimulation(); // From the latest published frame.
+		bool PresentSequence(); // From the loop or the baked sequence, at the present time.
+
+		// Texels of cascade c in frame of the loop or the baked sequence.
+		CascadeTexels GetSequenceTexels(u32 frame, u32 c) const;
+
+		// Makes texels the current simulation of cascade c, and the current one the previous. The first one after a reset is both.
+		// Persistent texels outlive the presentation and are read in place, the others are copied.
+		void PresentSimulation(u32 c, const CascadeTexels& texels, bool first, bool persistent);
+
+		// Writes the sum of the cascades in frame to the vertices.
+		void DisplaceVertices(const OceanFrame& frame);
+
+		// Sizes the texels of frame for the presented cascades and marks them empty. Frees them instead when the mode
+		// doesn't use the frame.
+		void ResetFrame(OceanFrame& frame, bool used) const;
+
+		// Bytes of texels in frame.
+		static size_t GetFrameBytes(const OceanFrame& frame);
+
+		// Asynchronous simulation.
+		void StartSimulationThread();
+		void StopSimulationThread();
+		void SimulationLoop();
+
+		// Creates the displacement maps at the size of the presented cascades, when it changed.
+		void CreateDisplacementMaps();
+		void DestroyDisplacementMaps();
+
 	private:
 		
 		/*
@@ -133,65 +217,72 @@ namespace acqua
 		// Ocean simulation members.
 		
 		Real simulationTime;
-		int seed; // Random seed.
-
-		// Dimensions of the grid.
-		u32 M;
-		u32 N;
-
-		// Spatial size of the grid.
-		Real LX;
-		Real LZ;
-
-		// Simulation.
-		Real V;	// Speed of the waves.
-		Real L; // Largest wave length at velocity V.
-		Real l; // Shortest wave length. Used for pruning out very small waves.
-		Real A; // Amplitude (approximate wave height). 
-		
-		// wind.
-		Real W; // Wind direction in radians.
-		Real WX; Real WZ; // Wind directions.
-		Real windAlignment; // How close waves travel in the direction of wind.
-		
-		Real dampReflections; // Damps out the negative direction waves. 
-		Real depth; // Depth of the ocean.
-
-		Real chopAmount; // Amount of chop displacement that is applied to the input points.
-		
-		// Rendering.
-		Real foamSlopeRatio; //Decides the slope ratio to start the foam;
-		Real foamFader;	//Decides how much the foam increases and decreases over frames.
-
-		// Direction vectors per grid point.
-		VectorReal kx; VectorReal kz;
-		MatrixReal k; // Matrix of their magnitudes.
-
-		MatrixComplex h0;
-		MatrixComplex h0Minus;
-
-		// FFT related members.
-		MatrixComplex FFTIn; // Input to the plans.
-		MatrixComplex hTilda;
-
-		fftwf_plan displacementYPlan;
-		MatrixReal displacementY; // Output for the above plan.
-
-		fftwf_plan displacementXPlan;
-		MatrixReal displacementX;
-
-		fftwf_plan displacementZPlan;
-		MatrixReal displacementZ;
-
-		fftwf_plan normalXPlan;
-		MatrixReal normalX;
-
-		fftwf_plan normalZPlan;
-		MatrixReal normalZ;
 
-		Vector3Array normalArray;
+		// Render grid, in vertices.
+		u32 gridWidth;
+		u32 gridHeight;
+
+		// Cascades of the ocean and the threads simulating them.
+		OceanSimulation simulation;
+		CascadeLayout cascadeLayout[k_MaxOceanCascades]; // Of the cascades, or of the baked sequence when playing one back.
+		u32 cascadeCount;
+
+		// Looping playback. Every cascade repeats after loopPeriod, so one period is simulated and played back.
+		bool looping;
+		bool loopInterpolate; // Blend between frames of the loop instead of holding each one.
+		Real loopPeriod;
+		std::vector<OceanFrame> loopFrames;
+		u32 sequenceIndex; // Frame of the loop or the baked sequence presented as the previous simulation. ~0 before the first.
+
+		// Playback of a baked sequence, streamed from the file mapping in place of the loop.
+		bool playing;
+		OceanBakePlayer player;
+
+		// Fixed steps. The simulation advances in FixedUpdate and Update interpolates between the last two steps.
+		Real fixedStep; // Last fixed_delta_time, 0 until the first FixedUpdate.
+		Real timeSinceFixedUpdate; // Part of a step elapsed since the last FixedUpdate, like the accumulator of the frame loop.
+
+		// Last two presented simulations of each cascade, the current one [1] and the one before [0].
+		u32 presentedVersion[k_MaxOceanCascades];
+		Real presentedTime[k_MaxOceanCascades][2];
+		Real cascadeBlend[k_MaxOceanCascades]; // Weight of the current simulation.
+
+		// Texels of the presented simulations, for the vertices displaced on the CPU and the queries. They point at the
+		// loop or the baked sequence, or at copies of the simulation frames, which go back to the simulation thread.
+		CascadeTexels presentedTexels[k_MaxOceanCascades][2];
+		OceanFrame previousFrame;
+		OceanFrame currentFrame;
+		OceanFrame blendedFrame;
+
+		// Displacement maps, two pairs per cascade for the presented simulations, (M, N) texels each.
+		bool displacementMaps;
+		bool verticesDisplaced; // The vertex buffer holds displaced vertices and needs restoring before the maps are used.
+		u32 displacementTextures[k_MaxOceanCascades][2]; // RGBA32F, or RGBA16F with half texels. Displacement in xyz, foam in w.
+		u32 slopeTextures[k_MaxOceanCascades][2]; // RG32F, or RG16F with half texels. dh/dx, dh/dz.
+		u32 currentMap[k_MaxOceanCascades]; // Which of the two pairs holds the current simulation.
+		u32 mapWidth[k_MaxOceanCascades];
+		u32 mapHeight[k_MaxOceanCascades];
+
+		// Frames from the simulation to the frame loop. The simulation and the back frame belong to the simulation thread while it runs.
+		TripleBuffer<OceanFrame> frames;
+		Statistics statistics;
+
+		// Simulation thread. Simulates the requested time while the frame loop presents the previous frame.
+		bool asyncSimulation;
+		std::thread simulationThread;
+		std::mutex simulationMutex;
+		std::condition_variable simulationRequested;
+		Real requestedTime; // Protected by simulationMutex, like the two flags below.
+		bool simulationPending;
+		bool stopSimulation;
+
+		// Threads of the frame loop, used to displace the vertices when the simulation threads are busy or unused.
+		WorkerPool presentPool;
+
+		BuoyancySystem buoyancy;
 
 		// Engine related members.
+		GraphicsContext* graphicsContext;
 		std::shared_ptr<Geometry> geometry;
 	};
 
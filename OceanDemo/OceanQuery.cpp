@@ -0,0 +1,275 @@
+#include "OceanQuery.h"
+#include "DebugUtil.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define ACQUA_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+namespace acqua
+{
+	// Batches below this count are sampled on the calling thread.
+	static const u32 k_MinParallelBatches = 64;
+
+	// One value per position of a batch, in an SSE register when the build has them.
+	// Arguments go by reference, 32 bit MSVC can't pass aligned types by value.
+	struct QueryLanes
+	{
+#if defined(ACQUA_SSE2)
+		__m128 v;
+
+		QueryLanes() {}
+		explicit QueryLanes(float value) : v(_mm_set1_ps(value)) {}
+		explicit QueryLanes(__m128 value) : v(value) {}
+
+		static QueryLanes Load(const float* values) { return QueryLanes(_mm_loadu_ps(values)); }
+		void Store(float* values) const { _mm_storeu_ps(values, v); }
+
+		QueryLanes operator+(const QueryLanes& b) const { return QueryLanes(_mm_add_ps(v, b.v)); }
+		QueryLanes operator-(const QueryLanes& b) const { return QueryLanes(_mm_sub_ps(v, b.v)); }
+		QueryLanes operator*(const QueryLanes& b) const { return QueryLanes(_mm_mul_ps(v, b.v)); }
+		QueryLanes operator/(const QueryLanes& b) const { return QueryLanes(_mm_div_ps(v, b.v)); }
+
+		// Exact for the texel coordinates, well within the range of an int.
+		QueryLanes Floor() const
+		{
+			__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+			return QueryLanes(_mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f))));
+		}
+
+		QueryLanes Sqrt() const { return QueryLanes(_mm_sqrt_ps(v)); }
+#else
+		float v[k_OceanQueryBatchSize];
+
+		QueryLanes() {}
+		explicit QueryLanes(float value) { for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) v[l] = value; }
+
+		static QueryLanes Load(const float* values) { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = values[l]; return r; }
+		void Store(float* values) const { for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) values[l] = v[l]; }
+
+		QueryLanes operator+(const QueryLanes& b) const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = v[l] + b.v[l]; return r; }
+		QueryLanes operator-(const QueryLanes& b) const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = v[l] - b.v[l]; return r; }
+		QueryLanes operator*(const QueryLanes& b) const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = v[l] * b.v[l]; return r; }
+		QueryLanes operator/(const QueryLanes& b) const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = v[l] / b.v[l]; return r; }
+
+		QueryLanes Floor() const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = floor(v[l]); return r; }
+		QueryLanes Sqrt() const { QueryLanes r; for(u32 l = 0; l < k_OceanQueryBatchSize; ++l) r.v[l] = sqrt(v[l]); return r; }
+#endif
+	};
+
+	template <typename T> static inline T Lerp(const T& a, const T& b, const T& t) { return a + (b - a) * t; }
+	template <typename T> static inline T Catrom(const T& p0, const T& p1, const T& p2, const T& p3, const T& t)
+	{
+		return	T(0.5f) * ((T(2.0f) * p1) +
+				(p2 - p0) * t +
+				(T(2.0f) * p0 - T(5.0f) * p1 + T(4.0f) * p2 - p3) * t * t +
+				(T(3.0f) * (p1 - p2) + p3 - p0) * t * t * t);
+	}
+
+	// Filter over Taps texels along an axis, at the fraction t past the second one.
+	template <u32 Taps>
+	struct TapFilter;
+
+	template <>
+	struct TapFilter<2>
+	{
+		static QueryLanes Apply(const QueryLanes* values, const QueryLanes& t) { return Lerp(values[0], values[1], t); }
+	};
+
+	template <>
+	struct TapFilter<4>
+	{
+		static QueryLanes Apply(const QueryLanes* values, const QueryLanes& t) { return Catrom(values[0], values[1], values[2], values[3], t); }
+	};
+
+	// Texels a batch reads from one cascade, Taps by Taps, and where between them each position is.
+	template <u32 Taps>
+	struct BatchTaps
+	{
+		int texel[Taps][Taps][k_OceanQueryBatchSize]; // [row][column][lane].
+		QueryLanes fx;
+		QueryLanes fz;
+	};
+
+	// Texels of the taps along an axis of size texels, wrapped around, and the fraction past the second one.
+	template <u32 Taps>
+	static void AxisTaps(const QueryLanes& u, int size, int taps[Taps][k_OceanQueryBatchSize], QueryLanes& fraction)
+	{
+		QueryLanes wrapped = u - QueryLanes(static_cast<float>(size)) * (u * QueryLanes(1.0f / size)).Floor();
+		QueryLanes texel = wrapped.Floor();
+		fraction = wrapped - texel;
+
+		float first[k_OceanQueryBatchSize];
+		texel.Store(first);
+
+		// Bilinear taps are the texel and the next one, Catmull-Rom ones start a texel before. Rounding can leave
+		// the wrapped coordinate at size, which is texel 0 again.
+		const int start = (Taps == 4) ? -1 : 0;
+		for(u32 l = 0; l < k_OceanQueryBatchSize; ++l)
+		{
+			int texel_index = static_cast<int>(first[l]);
+			int t0 = (texel_index >= size ? texel_index - size : texel_index) + start;
+			for(u32 t = 0; t < Taps; ++t)
+			{
+				int tap = t0 + static_cast<int>(t);
+				taps[t][l] = tap < 0 ? tap + size : (tap >= size ? tap - size : tap);
+			}
+		}
+	}
+
+	template <u32 Taps>
+	static void ComputeTaps(const OceanQuerySurface& surface, const OceanQueryCascade& cascade, const QueryLanes& x, const QueryLanes& z, BatchTaps<Taps>& taps)
+	{
+		int columns[Taps][k_OceanQueryBatchSize];
+		int rows[Taps][k_OceanQueryBatchSize];
+		AxisTaps<Taps>((x - QueryLanes(surface.originX)) * QueryLanes(cascade.texelsPerUnitX), static_cast<int>(cascade.M), columns, taps.fx);
+		AxisTaps<Taps>((z - QueryLanes(surface.originZ)) * QueryLanes(cascade.texelsPerUnitZ), static_cast<int>(cascade.N), rows, taps.fz);
+
+		for(u32 r = 0; r < Taps; ++r)
+			for(u32 c = 0; c < Taps; ++c)
+				for(u32 l = 0; l < k_OceanQueryBatchSize; ++l)
+					taps.texel[r][c][l] = rows[r][l] * static_cast<int>(cascade.M) + columns[c][l];
+	}
+
+	// Channel of texels interleaved by Channels, filtered at the taps. Rows first, then across them.
+	template <u32 Taps, u32 Channels>
+	static QueryLanes FilterChannel(const OceanTexel* texels, u32 channel, const BatchTaps<Taps>& taps)
+	{
+		const OceanTexel* first = texels + channel;
+
+		QueryLanes rows[Taps];
+		for(u32 r = 0; r < Taps; ++r)
+		{
+			QueryLanes values[Taps];
+			for(u32 c = 0; c < Taps; ++c)
+			{
+				float gathered[k_OceanQueryBatchSize];
+				for(u32 l = 0; l < k_OceanQueryBatchSize; ++l)
+					gathered[l] = LoadTexel(first[taps.texel[r][c][l] * Channels]);
+				values[c] = QueryLanes::Load(gathered);
+			}
+
+			rows[r] = TapFilter<Taps>::Apply(values, taps.fx);
+		}
+
+		return TapFilter<Taps>::Apply(rows, taps.fz);
+	}
+
+	// Channel of a cascade, blended between its two simulations like the vertices are.
+	template <u32 Taps, u32 Channels>
+	static QueryLanes SampleChannel(const OceanTexel* const texels[2], Real blend, u32 channel, const BatchTaps<Taps>& taps)
+	{
+		QueryLanes current = FilterChannel<Taps, Channels>(texels[1], channel, taps);
+		if(blend >= 1.0f || texels[0] == texels[1])
+			return current;
+
+		return Lerp(FilterChannel<Taps, Channels>(texels[0], channel, taps), current, QueryLanes(blend));
+	}
+
+	// Up to a batch of positions starting at first.
+	template <u32 Taps>
+	static void QueryBatch(const OceanQuerySurface& surface, u32 first, u32 count, const Real* x, const Real* z, const OceanQueryResults& results, const OceanQueryOptions& options)
+	{
+		// The last position fills the missing lanes.
+		float lane_x[k_OceanQueryBatchSize];
+		float lane_z[k_OceanQueryBatchSize];
+		for(u32 l = 0; l < k_OceanQueryBatchSize; ++l)
+		{
+			u32 i = first + std::min(l, count - 1);
+			lane_x[l] = x[i];
+			lane_z[l] = z[i];
+		}
+
+		const QueryLanes target_x = QueryLanes::Load(lane_x);
+		const QueryLanes target_z = QueryLanes::Load(lane_z);
+		QueryLanes sample_x = target_x;
+		QueryLanes sample_z = target_z;
+
+		BatchTaps<Taps> taps;
+		for(u32 iteration = 0; iteration < options.inversionIterations && surface.cascadeCount > 0; ++iteration)
+		{
+			QueryLanes displacement_x(0.0f);
+			QueryLanes displacement_z(0.0f);
+			for(u32 c = 0; c < surface.cascadeCount; ++c)
+			{
+				const OceanQueryCascade& cascade = surface.cascades[c];
+				ComputeTaps(surface, cascade, sample_x, sample_z, taps);
+				displacement_x = displacement_x + SampleChannel<Taps, 4>(cascade.displacement, cascade.blend, 0, taps);
+				displacement_z = displacement_z + SampleChannel<Taps, 4>(cascade.displacement, cascade.blend, 2, taps);
+			}
+
+			sample_x = target_x - displacement_x;
+			sample_z = target_z - displacement_z;
+		}
+
+		const bool need_displacement = results.height != NULL || results.displacementX != NULL || results.displacementY != NULL || results.displacementZ != NULL;
+		const bool need_normal = results.normalX != NULL || results.normalY != NULL || results.normalZ != NULL;
+
+		QueryLanes displacement[3] = { QueryLanes(0.0f), QueryLanes(0.0f), QueryLanes(0.0f) };
+		QueryLanes slope[2] = { QueryLanes(0.0f), QueryLanes(0.0f) };
+		for(u32 c = 0; c < surface.cascadeCount; ++c)
+		{
+			const OceanQueryCascade& cascade = surface.cascades[c];
+			ComputeTaps(surface, cascade, sample_x, sample_z, taps);
+
+			for(u32 d = 0; d < 3 && need_displacement; ++d)
+				displacement[d] = displacement[d] + SampleChannel<Taps, 4>(cascade.displacement, cascade.blend, d, taps);
+
+			for(u32 s = 0; s < 2 && need_normal; ++s)
+				slope[s] = slope[s] + SampleChannel<Taps, 2>(cascade.slope, cascade.blend, s, taps);
+		}
+
+		// The normal of the height field y = h(x, z) is (-dh/dx, 1, -dh/dz).
+		const QueryLanes zero(0.0f);
+		const QueryLanes one(1.0f);
+		QueryLanes inverse_length = one / (slope[0] * slope[0] + slope[1] * slope[1] + one).Sqrt();
+
+		float values[7][k_OceanQueryBatchSize];
+		(displacement[1] + QueryLanes(surface.originY)).Store(values[0]);
+		displacement[0].Store(values[1]);
+		displacement[1].Store(values[2]);
+		displacement[2].Store(values[3]);
+		((zero - slope[0]) * inverse_length).Store(values[4]);
+		inverse_length.Store(values[5]);
+		((zero - slope[1]) * inverse_length).Store(values[6]);
+
+		Real* const outputs[7] = { results.height, results.displacementX, results.displacementY, results.displacementZ, results.normalX, results.normalY, results.normalZ };
+		for(u32 o = 0; o < 7; ++o)
+		{
+			if(outputs[o] == NULL)
+				continue;
+
+			for(u32 l = 0; l < count; ++l)
+				outputs[o][first + l] = values[o][l];
+		}
+	}
+
+	void QueryOceanSurface(const OceanQuerySurface& surface, u32 count, const Real* x, const Real* z, const OceanQueryResults& results, const OceanQueryOptions& options, WorkerPool* pool)
+	{
+		ASSERT(surface.cascadeCount <= k_MaxOceanCascades, "Too many cascades in the query surface.");
+		if(count == 0)
+			return;
+
+		const int batch_count = static_cast<int>((count + k_OceanQueryBatchSize - 1) / k_OceanQueryBatchSize);
+		WorkerPool::RangeFunction query_batches = [&](int batch_begin, int batch_end)
+		{
+			for(int b = batch_begin; b < batch_end; ++b)
+			{
+				u32 first = static_cast<u32>(b) * k_OceanQueryBatchSize;
+				u32 lanes = std::min(k_OceanQueryBatchSize, count - first);
+				if(options.filter == QUERY_FILTER_CATMULL_ROM)
+					QueryBatch<4>(surface, first, lanes, x, z, results, options);
+				else
+					QueryBatch<2>(surface, first, lanes, x, z, results, options);
+			}
+		};
+
+		if(pool != NULL && batch_count >= static_cast<int>(k_MinParallelBatches))
+			pool->ParallelFor(0, batch_count, query_batches);
+		else
+			query_batches(0, batch_count);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "OceanCascade.h"
+#include "Types.h"
+#include "WorkerPool.h"
+
+namespace acqua
+{
+	// Reconstruction of the texels between their centres.
+	enum OceanQueryFilter
+	{
+		QUERY_FILTER_BILINEAR,		// 2x2 texels, like the vertices and the displacement maps.
+		QUERY_FILTER_CATMULL_ROM,	// 4x4 texels, smooth between texels. Four times the reads.
+	};
+
+	// One presented cascade, the blend of its last two simulations. Laid out like OceanFrame.
+	struct OceanQueryCascade
+	{
+		const OceanTexel* displacement[2];	// Previous and current simulation, (N, M, 4). Displacement in xyz, foam in w.
+		const OceanTexel* slope[2];			// (N, M, 2). dh/dx, dh/dz.
+		Real blend;							// Weight of the current simulation.
+		u32 M;
+		u32 N;
+		Real texelsPerUnitX;				// Texel coordinates per unit of the query space, M / patch size.
+		Real texelsPerUnitZ;
+	};
+
+	// Displaced surface of the sum of the cascades. Texel centre (0, 0) of every cascade is at (originX, originZ)
+	// of the query space, and the undisplaced surface at height originY.
+	struct OceanQuerySurface
+	{
+		u32 cascadeCount;
+		OceanQueryCascade cascades[k_MaxOceanCascades];
+		Real originX;
+		Real originY;
+		Real originZ;
+
+		OceanQuerySurface() : cascadeCount(0), originX(0.0f), originY(0.0f), originZ(0.0f) {}
+	};
+
+	// Outputs of a query, one value per position in each array. NULL arrays aren't computed.
+	struct OceanQueryResults
+	{
+		Real* height;			// Height of the surface above the position.
+		Real* displacementX;	// Displacement of the surface point above the position, from its undisplaced point.
+		Real* displacementY;
+		Real* displacementZ;
+		Real* normalX;			// Unit normal of the surface there.
+		Real* normalY;
+		Real* normalZ;
+
+		OceanQueryResults() : height(NULL), displacementX(NULL), displacementY(NULL), displacementZ(NULL), normalX(NULL), normalY(NULL), normalZ(NULL) {}
+	};
+
+	struct OceanQueryOptions
+	{
+		OceanQueryFilter filter;
+
+		// The chop moves the surface sideways, so the point above (x, z) is displaced from somewhere else.
+		// Each iteration moves the guess by the displacement found at the previous one, p = (x, z) - D(p).
+		// 0 samples at (x, z) itself, which is off by the chop.
+		u32 inversionIterations;
+
+		OceanQueryOptions() : filter(QUERY_FILTER_BILINEAR), inversionIterations(4) {}
+	};
+
+	// Positions per SIMD batch. Counts needn't be multiples of it.
+	const u32 k_OceanQueryBatchSize = 4;
+
+	// Samples surface at the count positions (x[i], z[i]) of the query space. Batches are spread over pool when
+	// there are enough of them, pool can be NULL. The surface texels must stay valid until it returns.
+	void QueryOceanSurface(const OceanQuerySurface& surface, u32 count, const Real* x, const Real* z, const OceanQueryResults& results, const OceanQueryOptions& options, WorkerPool* pool);
+}
@@ -0,0 +1,122 @@
+#include "OceanSimulation.h"
+
+#include <algorithm>
+
+namespace acqua
+{
+	template <typename T>
+	OceanSimulationT<T>::OceanSimulationT( void ) :
+		cascadeCount(0)
+	{
+		for(u32 c = 0; c < k_MaxOceanCascades; ++c)
+			simulationCount[c] = 0;
+	}
+
+	template <typename T>
+	OceanSimulationT<T>::~OceanSimulationT( void )
+	{
+	}
+
+	template <typename T>
+	void OceanSimulationT<T>::Reset( const OceanSettings& settings )
+	{
+		workerPool.SetThreadCount(settings.threadCount);
+
+		cascadeCount = std::min(std::max(settings.cascadeCount, 1u), k_MaxOceanCascades);
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			cascades[c].Reset(settings, c, &workerPool);
+			simulationCount[c] = 0;
+		}
+	}
+
+	template <typename T>
+	bool OceanSimulationT<T>::Simulate( Real t, Real scale )
+	{
+		// Each cascade runs at its own rate and keeps its last output in between.
+		bool simulated = false;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			if(cascades[c].NeedsUpdate(t))
+			{
+				cascades[c].Simulate(t, scale);
+				++simulationCount[c];
+				simulated = true;
+			}
+		}
+
+		return simulated;
+	}
+
+	template <typename T>
+	void OceanSimulationT<T>::SimulateAll( Real t, Real scale )
+	{
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			cascades[c].Simulate(t, scale);
+			++simulationCount[c];
+		}
+	}
+
+	template <typename T>
+	CascadeTimings OceanSimulationT<T>::GetTimings() const
+	{
+		CascadeTimings total;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			const CascadeTimings& timings = cascades[c].GetTimings();
+			total.spectrum += timings.spectrum;
+			total.planning += timings.planning;
+			total.evolution += timings.evolution;
+			total.fft += timings.fft;
+			total.normals += timings.normals;
+			total.foam += timings.foam;
+			total.bounds += timings.bounds;
+			total.simulations += timings.simulations;
+		}
+
+		return total;
+	}
+
+	template <typename T>
+	void OceanSimulationT<T>::ResetTimings()
+	{
+		for(u32 c = 0; c < cascadeCount; ++c)
+			cascades[c].ResetTimings();
+	}
+
+	template <typename T>
+	DisplacementBoundsT<T> OceanSimulationT<T>::GetBounds() const
+	{
+		// The cascades are summed, and so are their bounds.
+		DisplacementBoundsT<T> total = DisplacementBoundsT<T>();
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			const DisplacementBoundsT<T>& bounds = cascades[c].GetPatchBounds();
+			total.minX += bounds.minX; total.maxX += bounds.maxX;
+			total.minY += bounds.minY; total.maxY += bounds.maxY;
+			total.minZ += bounds.minZ; total.maxZ += bounds.maxZ;
+		}
+
+		return total;
+	}
+
+	template <typename T>
+	CascadeMemory OceanSimulationT<T>::GetMemory() const
+	{
+		CascadeMemory total;
+		for(u32 c = 0; c < cascadeCount; ++c)
+		{
+			CascadeMemory memory = cascades[c].GetMemory();
+			total.spectrum += memory.spectrum;
+			total.evolution += memory.evolution;
+			total.fft += memory.fft;
+			total.outputs += memory.outputs;
+		}
+
+		return total;
+	}
+
+	template class OceanSimulationT<float>;
+	template class OceanSimulationT<double>;
+}
\ No newline at end of file
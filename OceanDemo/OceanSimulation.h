@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Types.h"
+#include "OceanCascade.h"
+#include "WorkerPool.h"
+
+namespace acqua
+{
+	// The cascades of an ocean and the threads simulating them, with nothing to render them.
+	// OceanComponent presents its outputs, the tools and benchmarks run it on its own.
+	// T is the precision of the cascades, see OceanCascadeT.
+	template <typename T>
+	class OceanSimulationT
+	{
+	public:
+		OceanSimulationT(void);
+		~OceanSimulationT(void);
+
+		// Applies the settings to the cascades and the threads.
+		void Reset(const OceanSettings& settings);
+
+		// Simulates the cascades due at time t, following their update rates. Heights are multiplied by scale.
+		// False when none of them was.
+		bool Simulate(Real t, Real scale);
+
+		// Simulates every cascade at time t, regardless of the update rates.
+		void SimulateAll(Real t, Real scale);
+
+		u32 GetCascadeCount() const { return cascadeCount; }
+		const OceanCascadeT<T>& GetCascade(u32 c) const { return cascades[c]; }
+
+		// Simulations of cascade c since the last reset. Tells its outputs apart.
+		u32 GetSimulationCount(u32 c) const { return simulationCount[c]; }
+
+		// Stage timings summed over the cascades.
+		CascadeTimings GetTimings() const;
+		void ResetTimings();
+
+		// Bounds of the displacements of the summed cascades anywhere on the ocean, from the pyramids of their last simulations.
+		// See OceanCascadeT::GetBoundsLevelCount for the bounds of smaller regions.
+		DisplacementBoundsT<T> GetBounds() const;
+
+		// Bytes held by the cascades, by stage.
+		CascadeMemory GetMemory() const;
+
+		WorkerPool& GetWorkerPool() { return workerPool; }
+
+	private:
+		OceanSimulationT(const OceanSimulationT&);
+		OceanSimulationT& operator=(const OceanSimulationT&);
+
+	private:
+		// Patches of the ocean, summed when sampled.
+		OceanCascadeT<T> cascades[k_MaxOceanCascades];
+		u32 cascadeCount;
+		u32 simulationCount[k_MaxOceanCascades];
+
+		// Threads running the simulation.
+		WorkerPool workerPool;
+	};
+
+	typedef OceanSimulationT<OceanCascade::Scalar> OceanSimulation;
+}
\ No newline at end of file
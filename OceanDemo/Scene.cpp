@@ -244,6 +244,11 @@ namespace acqua
 					ShaderProgram& shader_prog = graphicsContext->GetShaderProgram(graphicsContext->GetCurrentShaderProgram());
 					shader_prog.SetUniformFromArray("modelMatrix", (void*)glm::value_ptr(model_matrix), 1, false);
 
+					// Simulation output, when the shaders displace the grid.
+					const OceanComponent* ocean = ocean_renderer->GetGameObject().GetComponent<OceanComponent>();
+					if(ocean != NULL)
+						ocean->BindDisplacementMaps(*graphicsContext, shader_prog);
+
 					// Render foam buffer first.
 					graphicsContext->SetRenderBuffer(foamBuffer);
 					graphicsContext->SetClearColour(glm::vec4(0.0f));
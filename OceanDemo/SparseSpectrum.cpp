@@ -0,0 +1,344 @@
+#include "SparseSpectrum.h"
+#include "DebugUtil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <utility>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define ACQUA_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+namespace acqua
+{
+	// Waves per SIMD register. The wave arrays are padded to a multiple of it.
+	static const u32 k_WaveLanes = 4;
+
+	// Waves added into each partial sum of Evaluate, one per lane.
+#if defined(ACQUA_SSE2)
+	static const u32 k_SumLanes = k_WaveLanes;
+#else
+	static const u32 k_SumLanes = 1;
+#endif
+
+	// Points below this count are evaluated on the calling thread.
+	static const int k_MinParallelPoints = 64;
+
+	// Operations of the cost model. A wave at a point is the phase, its sine and cosine, and the three sums, 4 waves to
+	// an SSE2 register. Simulating a bin is the phase step, the evolution and the inputs of each field, and a real 2D FFT
+	// of size n takes about 2.5 n log2(n). The cost of a point is calibrated on SimulationBenchmark --waves, where the
+	// break even matches the measured one from 64 to 256. Larger grids simulate slower than the model, memory bound,
+	// so it errs towards simulating there.
+	static const double k_PointFlopsPerWave = 21.0;
+	static const double k_TimeFlopsPerWave = 30.0;
+	static const double k_EvolutionFlopsPerBin = 16.0;
+	static const double k_InputFlopsPerBinField = 4.0;
+	static const double k_PackFlopsPerTexel = 6.0;
+
+	// Points are placed in the patch in fixed point, 2^32 steps across it. The phase of a wave at a point is then the
+	// product of its cycles and the position, modulo 2^32, exact in integers however large the patch and the frequency.
+	static const double k_PatchSteps = 4294967296.0;
+	static const float k_RadiansPerStep = 1.4629180792671596e-9f; // 2 pi / 2^32.
+
+	// Rounding of the evaluation, in units of the amplitude of a wave. Placing a point rounds it by half a step, which
+	// moves the phase by half a step per cycle. Converting the phase to radians, its sine and cosine and the products
+	// with hTilda and the chop are a few float roundings each, 16 ulps of 1 covers them all.
+	static const double k_FloatEpsilon = 5.9604644775390625e-8; // 2^-24.
+	static const double k_PositionRoundingPerCycle = 3.14159265358979 / k_PatchSteps;
+	static const double k_WaveRounding = 16.0 * k_FloatEpsilon;
+
+	static inline double Sqr(double value)
+	{
+		return value * value;
+	}
+
+	SparseSpectrum::SparseSpectrum( void ) : componentCount(0), patchSize(1.0f)
+	{
+		bounds.componentCount = bounds.binCount = 0;
+		bounds.energyFraction = 1.0;
+		bounds.maxHeightError = bounds.rmsHeightError = bounds.maxHorizontalError = 0.0f;
+		bounds.roundingHeightError = bounds.roundingHorizontalError = 0.0f;
+	}
+
+	// Fixed point position of x in the patch, see k_PatchSteps.
+	static inline u32 GetPatchPosition(Real x, double inverse_patch)
+	{
+		double position = x * inverse_patch;
+		position -= floor(position);
+
+		// A position rounded up to the whole patch wraps to 0.
+		return static_cast<u32>(static_cast<u64>(position * k_PatchSteps + 0.5));
+	}
+
+	// Cycles of the wave of row i over the patch, the upper half of the rows being the negative frequencies.
+	static inline i32 GetRowCycles(u32 i, u32 M)
+	{
+		return (2 * i <= M) ? static_cast<i32>(i) : static_cast<i32>(i) - static_cast<i32>(M);
+	}
+
+	SparseSpectrum::~SparseSpectrum( void )
+	{
+	}
+
+	template <typename T>
+	void SparseSpectrum::Build( const OceanCascadeT<T>& cascade, u32 max_components, Real scale )
+	{
+		const u32 M = cascade.GetM();
+		const u32 num_bins = cascade.GetN() / 2 + 1;
+		const double horizontal_scale = k_HorizontalDisplacementScale * cascade.GetChopAmount();
+
+		// The mean square of a wave over space and time is weight^2 (|h0|^2 + |h0Minus|^2) / 2, its energy.
+		std::vector<std::pair<double, u32> > energies;
+		double total_energy = 0.0;
+		for(u32 i = 0; i < M; ++i)
+		{
+			for(u32 j = 0; j < num_bins; ++j)
+			{
+				SpectrumBinT<T> bin = cascade.GetSpectrumBin(i, j);
+				double energy = 0.5 * bin.weight * bin.weight * (Sqr(bin.h0Re) + Sqr(bin.h0Im) + Sqr(bin.h0MinusRe) + Sqr(bin.h0MinusIm));
+				if(energy <= 0.0)
+					continue;
+
+				energies.push_back(std::make_pair(energy, i * num_bins + j));
+				total_energy += energy;
+			}
+		}
+
+		componentCount = std::min(max_components, static_cast<u32>(energies.size()));
+		std::nth_element(energies.begin(), energies.begin() + componentCount, energies.end(), std::greater<std::pair<double, u32> >());
+
+		// Whatever is dropped can at most add up in phase somewhere.
+		double dropped_energy = 0.0;
+		double dropped_amplitude = 0.0;
+		double dropped_horizontal = 0.0;
+		for(size_t e = componentCount; e < energies.size(); ++e)
+		{
+			SpectrumBinT<T> bin = cascade.GetSpectrumBin(energies[e].second / num_bins, energies[e].second % num_bins);
+			double amplitude = bin.weight * (sqrt(Sqr(bin.h0Re) + Sqr(bin.h0Im)) + sqrt(Sqr(bin.h0MinusRe) + Sqr(bin.h0MinusIm)));
+			dropped_energy += energies[e].first;
+			dropped_amplitude += amplitude;
+			dropped_horizontal += amplitude * std::max(fabs(static_cast<double>(bin.kx)), fabs(static_cast<double>(bin.kz))) / bin.k;
+		}
+
+		// The waves kept are off by their rounding, and each partial sum by one rounding of the sum so far per wave added.
+		const u32 padded_count = (componentCount + k_WaveLanes - 1) / k_WaveLanes * k_WaveLanes;
+		const double sum_rounding = (padded_count / k_SumLanes + k_SumLanes) * k_FloatEpsilon;
+		double rounding_height = 0.0;
+		double rounding_horizontal = 0.0;
+		for(u32 c = 0; c < componentCount; ++c)
+		{
+			u32 i = energies[c].second / num_bins;
+			u32 j = energies[c].second % num_bins;
+			SpectrumBinT<T> bin = cascade.GetSpectrumBin(i, j);
+			double amplitude = bin.weight * (sqrt(Sqr(bin.h0Re) + Sqr(bin.h0Im)) + sqrt(Sqr(bin.h0MinusRe) + Sqr(bin.h0MinusIm)));
+			double cycles = abs(GetRowCycles(i, M)) + j;
+			double rounding = amplitude * (k_WaveRounding + sum_rounding + cycles * k_PositionRoundingPerCycle);
+			rounding_height += rounding;
+			rounding_horizontal += rounding * std::max(fabs(static_cast<double>(bin.kx)), fabs(static_cast<double>(bin.kz))) / bin.k;
+		}
+
+		bounds.componentCount = componentCount;
+		bounds.binCount = static_cast<u32>(energies.size());
+		bounds.energyFraction = (total_energy > 0.0) ? 1.0 - dropped_energy / total_energy : 1.0;
+		bounds.roundingHeightError = static_cast<Real>(scale * rounding_height);
+		bounds.roundingHorizontalError = static_cast<Real>(scale * horizontal_scale * rounding_horizontal);
+		bounds.maxHeightError = static_cast<Real>(scale * (dropped_amplitude + rounding_height));
+		bounds.rmsHeightError = static_cast<Real>(scale * sqrt(dropped_energy));
+		bounds.maxHorizontalError = static_cast<Real>(scale * horizontal_scale * (dropped_horizontal + rounding_horizontal));
+
+		// Silent waves fill the last register.
+		std::vector<Real>* arrays[] = { &chopX, &chopZ, &omega, &h0Re, &h0Im, &h0MinusRe, &h0MinusIm, &hRe, &hIm };
+		for(size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); ++a)
+			arrays[a]->assign(padded_count, 0.0f);
+		cyclesX.assign(padded_count, 0);
+		cyclesZ.assign(padded_count, 0);
+
+		patchSize = static_cast<Real>(cascade.GetPatchSize());
+		for(u32 c = 0; c < componentCount; ++c)
+		{
+			u32 i = energies[c].second / num_bins;
+			u32 j = energies[c].second % num_bins;
+			SpectrumBinT<T> bin = cascade.GetSpectrumBin(i, j);
+
+			// The frequencies of the transform, bin.fx and bin.fz, in cycles over the patch.
+			cyclesX[c] = GetRowCycles(i, M);
+			cyclesZ[c] = static_cast<i32>(j);
+			chopX[c] = static_cast<Real>(horizontal_scale * bin.kx / bin.k);
+			chopZ[c] = static_cast<Real>(horizontal_scale * bin.kz / bin.k);
+			omega[c] = static_cast<Real>(bin.omega);
+			h0Re[c] = static_cast<Real>(scale * bin.weight * bin.h0Re);
+			h0Im[c] = static_cast<Real>(scale * bin.weight * bin.h0Im);
+			h0MinusRe[c] = static_cast<Real>(scale * bin.weight * bin.h0MinusRe);
+			h0MinusIm[c] = static_cast<Real>(scale * bin.weight * bin.h0MinusIm);
+		}
+
+		SetTime(0.0f);
+	}
+
+	void SparseSpectrum::SetTime( Real t )
+	{
+		// hTilda = h0 * phase + conj(h0Minus * phase), like the spectrum input kernels. In double, omega t grows large.
+		for(u32 c = 0; c < componentCount; ++c)
+		{
+			double angle = static_cast<double>(omega[c]) * t;
+			Real cos_angle = static_cast<Real>(cos(angle));
+			Real sin_angle = static_cast<Real>(sin(angle));
+
+			hRe[c] = cos_angle * (h0Re[c] + h0MinusRe[c]) - sin_angle * (h0Im[c] + h0MinusIm[c]);
+			hIm[c] = sin_angle * (h0Re[c] - h0MinusRe[c]) + cos_angle * (h0Im[c] - h0MinusIm[c]);
+		}
+	}
+
+#if defined(ACQUA_SSE2)
+	// Sine and cosine of 4 angles in [-pi, pi]. Reduced to [-pi/4, pi/4] around the nearest multiple of pi/2 in three
+	// steps (Cody and Waite), then the minimax polynomials of Cephes' sinf and cosf. A couple of ulps of 1.
+	static inline void SinCos(__m128 angle, __m128& sin_out, __m128& cos_out)
+	{
+		__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(0.63661977236758134f))); // Rounded angle / (pi / 2).
+		__m128 q = _mm_cvtepi32_ps(quadrant);
+
+		__m128 x = _mm_sub_ps(angle, _mm_mul_ps(q, _mm_set1_ps(1.5703125f)));
+		x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(4.837512969970703125e-4f)));
+		x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(7.54978995489188216e-8f)));
+		__m128 z = _mm_mul_ps(x, x);
+
+		__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+		s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+		s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+		__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+		c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+		c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+		// Odd quadrants swap the two, quadrants 2 and 3 negate the sine, 1 and 2 the cosine.
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+		__m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+		__m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+		sin_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sin_sign);
+		cos_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cos_sign);
+	}
+
+	// Low 32 bits of the products of the lanes, _mm_mullo_epi32 being SSE4.1.
+	static inline __m128i MultiplyLow(__m128i a, __m128i b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	static inline Real HorizontalSum(__m128 v)
+	{
+		__m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+	}
+#endif
+
+	void SparseSpectrum::Evaluate( u32 count, const Real* x, const Real* z, Real* height, Real* displacement_x, Real* displacement_z, WorkerPool* pool ) const
+	{
+		if(count == 0 || componentCount == 0)
+			return;
+
+		const u32 padded_count = static_cast<u32>(cyclesX.size());
+		const double inverse_patch = 1.0 / patchSize;
+
+		WorkerPool::RangeFunction evaluate_points = [&](int point_begin, int point_end)
+		{
+			for(int p = point_begin; p < point_end; ++p)
+			{
+				u32 px = GetPatchPosition(x[p], inverse_patch);
+				u32 pz = GetPatchPosition(z[p], inverse_patch);
+
+#if defined(ACQUA_SSE2)
+				const __m128i point_x = _mm_set1_epi32(static_cast<int>(px));
+				const __m128i point_z = _mm_set1_epi32(static_cast<int>(pz));
+				__m128 sum_y = _mm_setzero_ps();
+				__m128 sum_x = _mm_setzero_ps();
+				__m128 sum_z = _mm_setzero_ps();
+				for(u32 c = 0; c < padded_count; c += k_WaveLanes)
+				{
+					// The phase in steps wraps around in the integers, as a signed step count it is in [-pi, pi).
+					__m128i steps = _mm_add_epi32(MultiplyLow(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&cyclesX[c])), point_x),
+						MultiplyLow(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&cyclesZ[c])), point_z));
+					__m128 angle = _mm_mul_ps(_mm_cvtepi32_ps(steps), _mm_set1_ps(k_RadiansPerStep));
+					__m128 s, co;
+					SinCos(angle, s, co);
+
+					// h e^(i angle), the height is its real part and the chop -k / |k| times its imaginary part.
+					__m128 h_re = _mm_loadu_ps(&hRe[c]);
+					__m128 h_im = _mm_loadu_ps(&hIm[c]);
+					__m128 wave_re = _mm_sub_ps(_mm_mul_ps(h_re, co), _mm_mul_ps(h_im, s));
+					__m128 wave_im = _mm_add_ps(_mm_mul_ps(h_re, s), _mm_mul_ps(h_im, co));
+
+					sum_y = _mm_add_ps(sum_y, wave_re);
+					sum_x = _mm_sub_ps(sum_x, _mm_mul_ps(_mm_loadu_ps(&chopX[c]), wave_im));
+					sum_z = _mm_sub_ps(sum_z, _mm_mul_ps(_mm_loadu_ps(&chopZ[c]), wave_im));
+				}
+
+				Real y_value = HorizontalSum(sum_y);
+				Real x_value = HorizontalSum(sum_x);
+				Real z_value = HorizontalSum(sum_z);
+#else
+				Real y_value = 0.0f;
+				Real x_value = 0.0f;
+				Real z_value = 0.0f;
+				for(u32 c = 0; c < padded_count; ++c)
+				{
+					i32 steps = static_cast<i32>(static_cast<u32>(cyclesX[c]) * px + static_cast<u32>(cyclesZ[c]) * pz);
+					Real angle = static_cast<Real>(steps) * k_RadiansPerStep;
+					Real s = sin(angle);
+					Real co = cos(angle);
+
+					Real wave_re = hRe[c] * co - hIm[c] * s;
+					Real wave_im = hRe[c] * s + hIm[c] * co;
+
+					y_value += wave_re;
+					x_value -= chopX[c] * wave_im;
+					z_value -= chopZ[c] * wave_im;
+				}
+#endif
+
+				if(height != NULL)
+					height[p] += y_value;
+				if(displacement_x != NULL)
+					displacement_x[p] += x_value;
+				if(displacement_z != NULL)
+					displacement_z[p] += z_value;
+			}
+		};
+
+		if(pool != NULL && count >= static_cast<u32>(k_MinParallelPoints))
+			pool->ParallelFor(0, static_cast<int>(count), evaluate_points);
+		else
+			evaluate_points(0, static_cast<int>(count));
+	}
+
+	double SparseSpectrum::EstimateEvaluationFlops( u32 point_count ) const
+	{
+		return static_cast<double>(componentCount) * (k_TimeFlopsPerWave + k_PointFlopsPerWave * point_count);
+	}
+
+	double SparseSpectrum::EstimateSimulationFlops( u32 M, u32 N, u32 fft_fields )
+	{
+		double bins = static_cast<double>(M) * (N / 2 + 1);
+		double texels = static_cast<double>(M) * N;
+		double fft = 2.5 * texels * log(texels) / log(2.0);
+		return bins * (k_EvolutionFlopsPerBin + k_InputFlopsPerBinField * fft_fields) + fft_fields * fft + texels * k_PackFlopsPerTexel;
+	}
+
+	u32 SparseSpectrum::GetBreakEvenPointCount( u32 M, u32 N, u32 fft_fields ) const
+	{
+		if(componentCount == 0)
+			return ~0u;
+
+		double per_point = k_PointFlopsPerWave * componentCount;
+		double budget = EstimateSimulationFlops(M, N, fft_fields) - k_TimeFlopsPerWave * componentCount;
+		return (budget > 0.0) ? static_cast<u32>(std::min(budget / per_point, 4294967295.0)) : 0;
+	}
+
+	template void SparseSpectrum::Build<float>(const OceanCascadeT<float>& cascade, u32 max_components, Real scale);
+	template void SparseSpectrum::Build<double>(const OceanCascadeT<double>& cascade, u32 max_components, Real scale);
+}
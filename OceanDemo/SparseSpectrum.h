@@ -0,0 +1,86 @@
+#pragma once
+
+#include "OceanCascade.h"
+#include "Types.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+namespace acqua
+{
+	// The spectrum of a cascade cut down to its most energetic waves, summed directly at arbitrary points.
+	// For the few hundred heights a headless node needs, this is far cheaper than simulating the whole grid: the
+	// cascade only has to be Reset (cheaply with FFT_PLAN_ESTIMATE) to build the spectrum, and is never simulated.
+	//
+	// The outputs are those of the cascade, the texels of PackTexels: heights and horizontal displacements at the
+	// undisplaced point (x, z) of the patch, in world units from texel (0, 0), displacements already scaled by
+	// k_HorizontalDisplacementScale. With every wave kept they match the FFT up to the rounding of both, and every
+	// point of the plane is valid, not only the texel centres.
+	class SparseSpectrum
+	{
+	public:
+		// What the cut costs in accuracy. The bounds hold at every point and time.
+		struct ErrorBounds
+		{
+			u32 componentCount;			// Waves kept.
+			u32 binCount;				// Waves with any energy in the full spectrum.
+			double energyFraction;		// Of the spectrum's energy kept, 1 with every wave.
+			Real maxHeightError;		// Sum of the amplitudes dropped and of the rounding, in world units. The height is never further off.
+			Real rmsHeightError;		// Root mean square of the waves dropped, over space and time.
+			Real maxHorizontalError;	// Same as maxHeightError for each horizontal displacement.
+			Real roundingHeightError;	// Worst case rounding of the phases, sines and sums of the waves kept, part of maxHeightError.
+			Real roundingHorizontalError;
+		};
+
+		SparseSpectrum(void);
+		~SparseSpectrum(void);
+
+		// Keeps the max_components waves of cascade with the most energy, weight^2 (|h0|^2 + |h0Minus|^2) with the
+		// weight of the bin in the half spectrum. scale multiplies the heights, like the scale of OceanCascadeT::Simulate.
+		template <typename T>
+		void Build(const OceanCascadeT<T>& cascade, u32 max_components, Real scale);
+
+		const ErrorBounds& GetErrorBounds() const { return bounds; }
+		u32 GetComponentCount() const { return componentCount; }
+
+		// Evolves the kept waves to time t. O(components), with a sine and cosine each.
+		void SetTime(Real t);
+
+		// Adds the waves at the count points (x[i], z[i]) to height, displacement_x and displacement_z, any of which
+		// can be NULL. Adding lets the spectra of several cascades sum into the same arrays. pool can be NULL.
+		void Evaluate(u32 count, const Real* x, const Real* z, Real* height, Real* displacement_x, Real* displacement_z, WorkerPool* pool) const;
+
+		// Cost model, in floating point operations, to pick between this and simulating the cascade.
+		// Evaluating is linear in points * components, the simulation grows with the grid and is paid once per frame
+		// whatever the number of points.
+		double EstimateEvaluationFlops(u32 point_count) const;
+		static double EstimateSimulationFlops(u32 M, u32 N, u32 fft_fields);
+
+		// Points below which evaluating is cheaper than simulating an (M, N) cascade with fft_fields transforms.
+		u32 GetBreakEvenPointCount(u32 M, u32 N, u32 fft_fields) const;
+
+	private:
+		SparseSpectrum(const SparseSpectrum&);
+		SparseSpectrum& operator=(const SparseSpectrum&);
+
+	private:
+		u32 componentCount;
+		ErrorBounds bounds;
+		Real patchSize; // Every wave repeats a whole number of times over it.
+
+		// One entry per wave, padded with silent ones to a multiple of the SIMD width.
+		std::vector<i32> cyclesX; // Periods of the wave over the patch, the frequency of its bin in the transform.
+		std::vector<i32> cyclesZ;
+		std::vector<Real> chopX; // Horizontal displacement per unit of height, i * chop * k / |k| without the i.
+		std::vector<Real> chopZ;
+		std::vector<Real> omega;
+		std::vector<Real> h0Re; // Times the weight of the bin and the scale.
+		std::vector<Real> h0Im;
+		std::vector<Real> h0MinusRe;
+		std::vector<Real> h0MinusIm;
+
+		// hTilda at the time of the last SetTime.
+		std::vector<Real> hRe;
+		std::vector<Real> hIm;
+	};
+}
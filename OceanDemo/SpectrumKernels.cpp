@@ -0,0 +1,406 @@
+#include "SpectrumKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define ACQUA_X86 1
+#endif
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define ACQUA_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#if defined(ACQUA_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#include <immintrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+namespace acqua
+{
+	// CPU features.
+
+#if defined(ACQUA_X86)
+	static void CPUID(int leaf, int sub_leaf, int regs[4])
+	{
+	#if defined(_MSC_VER)
+		__cpuidex(regs, leaf, sub_leaf);
+	#else
+		unsigned int a = 0, b = 0, c = 0, d = 0;
+		__cpuid_count(leaf, sub_leaf, a, b, c, d);
+		regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+	#endif
+	}
+
+	static unsigned long long XGETBV()
+	{
+	#if defined(_MSC_VER)
+		return _xgetbv(0);
+	#else
+		unsigned int eax = 0, edx = 0;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+	#endif
+	}
+#endif
+
+	SIMDLevel DetectSIMDLevel()
+	{
+		SIMDLevel level = SIMD_SCALAR;
+
+#if defined(ACQUA_X86)
+		int regs[4];
+		CPUID(0, 0, regs);
+		int max_leaf = regs[0];
+
+		CPUID(1, 0, regs);
+		bool sse2 = (regs[3] & (1 << 26)) != 0;
+		bool fma = (regs[2] & (1 << 12)) != 0;
+		bool osxsave = (regs[2] & (1 << 27)) != 0;
+		bool avx = (regs[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		if(max_leaf >= 7)
+		{
+			CPUID(7, 0, regs);
+			avx2 = (regs[1] & (1 << 5)) != 0;
+		}
+
+		// The OS must save the YMM registers too.
+		bool ymm_state = osxsave && ((XGETBV() & 0x6) == 0x6);
+
+		if(sse2 && GetSpectrumKernelsSSE2() != NULL)
+			level = SIMD_SSE2;
+
+		if(avx && avx2 && fma && ymm_state && GetSpectrumKernelsAVX2() != NULL)
+			level = SIMD_AVX2;
+#endif
+
+		return level;
+	}
+
+	const char* GetSIMDLevelName( SIMDLevel level )
+	{
+		switch(level)
+		{
+		case SIMD_SCALAR:	return "Scalar";
+		case SIMD_SSE2:		return "SSE2";
+		case SIMD_AVX2:		return "AVX2";
+		default:			return "Unknown";
+		}
+	}
+
+	// Scalar kernels. Reference for the others.
+
+	template <typename T>
+	static void RotateScalar(u32 count, T* phase_re, T* phase_im, const T* step_re, const T* step_im)
+	{
+		for(u32 n = 0; n < count; ++n)
+		{
+			T c = phase_re[n], d = phase_im[n];
+			phase_re[n] = c * step_re[n] - d * step_im[n];
+			phase_im[n] = c * step_im[n] + d * step_re[n];
+		}
+	}
+
+	template <typename T>
+	static void RenormalizeScalar(u32 count, T* phase_re, T* phase_im)
+	{
+		for(u32 n = 0; n < count; ++n)
+		{
+			T factor = T(0.5) * (T(3) - (phase_re[n] * phase_re[n] + phase_im[n] * phase_im[n]));
+			phase_re[n] *= factor;
+			phase_im[n] *= factor;
+		}
+	}
+
+	template <typename T>
+	static void BuildRotationsScalar(u32 count, const T* omega, T dt, u32 halvings, T* step_re, T* step_im)
+	{
+		T angle_scale = dt / static_cast<T>(1u << halvings);
+
+		for(u32 n = 0; n < count; ++n)
+		{
+			T a = omega[n] * angle_scale;
+			T a2 = a * a;
+
+			T c = T(1) - a2 * (T(1) / T(2)) * (T(1) - a2 * (T(1) / T(12)) * (T(1) - a2 * (T(1) / T(30))));
+			T s = a * (T(1) - a2 * (T(1) / T(6)) * (T(1) - a2 * (T(1) / T(20)) * (T(1) - a2 * (T(1) / T(42)))));
+
+			for(u32 h = 0; h < halvings; ++h)
+			{
+				T c2 = c * c - s * s;
+				s = T(2) * c * s;
+				c = c2;
+			}
+
+			step_re[n] = c;
+			step_im[n] = s;
+		}
+	}
+
+	template <typename T>
+	static void SpectrumInputsScalar(const SpectrumInputRowT<T>& row)
+	{
+		// The same for every bin of the row, the branches on them are always predicted.
+		const bool slopes = row.slopeXRe != NULL;
+		const bool jacobian = row.xxRe != NULL;
+
+		T cx = row.scale * row.chop * row.kx;
+		T cz = row.scale * row.chop;
+		T sx = row.slopeScaleX * row.kx;
+		T fx = -row.jacobianScaleXX * row.kx * row.kx;
+		T fxz = -row.jacobianScaleXZ * row.kx;
+
+		for(u32 n = 0; n < row.count; ++n)
+		{
+			// (a + ib)(c + id) + conj((e + if)(c + id)) = c(a + e) - d(b + f) + i(d(a - e) + c(b - f))
+			T a = row.h0Re[n], b = row.h0Im[n];
+			T e = row.h0MinusRe[n], f = row.h0MinusIm[n];
+			T c = row.phaseRe[n], d = row.phaseIm[n];
+
+			T h_re = c * (a + e) - d * (b + f);
+			T h_im = d * (a - e) + c * (b - f);
+
+			T inv_k = row.kInverse[n];
+			T kz = row.kz[n];
+
+			row.yRe[n] = row.scale * h_re;
+			row.yIm[n] = row.scale * h_im;
+
+			// i * h = (-h_im, h_re)
+			T dx = cx * inv_k;
+			T dz = cz * kz * inv_k;
+
+			row.xRe[n] = -dx * h_im;
+			row.xIm[n] =  dx * h_re;
+			row.zRe[n] = -dz * h_im;
+			row.zIm[n] =  dz * h_re;
+
+			if(slopes)
+			{
+				T sz = row.slopeScaleZ * kz;
+
+				row.slopeXRe[n] = -sx * h_im;
+				row.slopeXIm[n] =  sx * h_re;
+				row.slopeZRe[n] = -sz * h_im;
+				row.slopeZIm[n] =  sz * h_re;
+			}
+
+			if(jacobian)
+			{
+				T jxx = fx * inv_k;
+				T jzz = -row.jacobianScaleZZ * kz * kz * inv_k;
+				T jxz = fxz * kz * inv_k;
+
+				row.xxRe[n] = jxx * h_re;
+				row.xxIm[n] = jxx * h_im;
+				row.zzRe[n] = jzz * h_re;
+				row.zzIm[n] = jzz * h_im;
+				row.xzRe[n] = jxz * h_re;
+				row.xzIm[n] = jxz * h_im;
+			}
+		}
+	}
+
+	static const SpectrumKernels k_ScalarKernels =
+	{
+		SIMD_SCALAR,
+		RotateScalar<float>,
+		RenormalizeScalar<float>,
+		BuildRotationsScalar<float>,
+		SpectrumInputsScalar<float>
+	};
+
+	static const SpectrumKernelsT<double> k_ScalarKernelsDouble =
+	{
+		SIMD_SCALAR,
+		RotateScalar<double>,
+		RenormalizeScalar<double>,
+		BuildRotationsScalar<double>,
+		SpectrumInputsScalar<double>
+	};
+
+	// SSE2 kernels. 4 bins at a time, the remainder goes through the scalar kernels.
+
+#if defined(ACQUA_SSE2)
+	static void RotateSSE2(u32 count, float* phase_re, float* phase_im, const float* step_re, const float* step_im)
+	{
+		u32 n = 0;
+		for(; n + 4 <= count; n += 4)
+		{
+			__m128 c = _mm_loadu_ps(phase_re + n), d = _mm_loadu_ps(phase_im + n);
+			__m128 sr = _mm_loadu_ps(step_re + n), si = _mm_loadu_ps(step_im + n);
+
+			_mm_storeu_ps(phase_re + n, _mm_sub_ps(_mm_mul_ps(c, sr), _mm_mul_ps(d, si)));
+			_mm_storeu_ps(phase_im + n, _mm_add_ps(_mm_mul_ps(c, si), _mm_mul_ps(d, sr)));
+		}
+
+		RotateScalar(count - n, phase_re + n, phase_im + n, step_re + n, step_im + n);
+	}
+
+	static void RenormalizeSSE2(u32 count, float* phase_re, float* phase_im)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 three = _mm_set1_ps(3.0f);
+
+		u32 n = 0;
+		for(; n + 4 <= count; n += 4)
+		{
+			__m128 c = _mm_loadu_ps(phase_re + n), d = _mm_loadu_ps(phase_im + n);
+			__m128 norm = _mm_add_ps(_mm_mul_ps(c, c), _mm_mul_ps(d, d));
+			__m128 factor = _mm_mul_ps(half, _mm_sub_ps(three, norm));
+
+			_mm_storeu_ps(phase_re + n, _mm_mul_ps(c, factor));
+			_mm_storeu_ps(phase_im + n, _mm_mul_ps(d, factor));
+		}
+
+		RenormalizeScalar(count - n, phase_re + n, phase_im + n);
+	}
+
+	static void BuildRotationsSSE2(u32 count, const float* omega, float dt, u32 halvings, float* step_re, float* step_im)
+	{
+		const __m128 angle_scale = _mm_set1_ps(dt / static_cast<float>(1u << halvings));
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+
+		u32 n = 0;
+		for(; n + 4 <= count; n += 4)
+		{
+			__m128 a = _mm_mul_ps(_mm_loadu_ps(omega + n), angle_scale);
+			__m128 a2 = _mm_mul_ps(a, a);
+
+			__m128 c = _mm_sub_ps(one, _mm_mul_ps(a2, _mm_set1_ps(1.0f / 30.0f)));
+			c = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, _mm_set1_ps(1.0f / 12.0f)), c));
+			c = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, _mm_set1_ps(1.0f / 2.0f)), c));
+
+			__m128 s = _mm_sub_ps(one, _mm_mul_ps(a2, _mm_set1_ps(1.0f / 42.0f)));
+			s = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, _mm_set1_ps(1.0f / 20.0f)), s));
+			s = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, _mm_set1_ps(1.0f / 6.0f)), s));
+			s = _mm_mul_ps(a, s);
+
+			for(u32 h = 0; h < halvings; ++h)
+			{
+				__m128 c2 = _mm_sub_ps(_mm_mul_ps(c, c), _mm_mul_ps(s, s));
+				s = _mm_mul_ps(two, _mm_mul_ps(c, s));
+				c = c2;
+			}
+
+			_mm_storeu_ps(step_re + n, c);
+			_mm_storeu_ps(step_im + n, s);
+		}
+
+		BuildRotationsScalar(count - n, omega + n, dt, halvings, step_re + n, step_im + n);
+	}
+
+	static void SpectrumInputsSSE2(const SpectrumInputRow& row)
+	{
+		const bool slopes = row.slopeXRe != NULL;
+		const bool jacobian = row.xxRe != NULL;
+
+		const __m128 scale = _mm_set1_ps(row.scale);
+		const __m128 cx = _mm_set1_ps(row.scale * row.chop * row.kx);
+		const __m128 cz = _mm_set1_ps(row.scale * row.chop);
+		const __m128 sx = _mm_set1_ps(row.slopeScaleX * row.kx);
+		const __m128 sz = _mm_set1_ps(row.slopeScaleZ);
+		const __m128 fx = _mm_set1_ps(-row.jacobianScaleXX * row.kx * row.kx);
+		const __m128 fz = _mm_set1_ps(-row.jacobianScaleZZ);
+		const __m128 fxz = _mm_set1_ps(-row.jacobianScaleXZ * row.kx);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+
+		u32 n = 0;
+		for(; n + 4 <= row.count; n += 4)
+		{
+			__m128 a = _mm_loadu_ps(row.h0Re + n), b = _mm_loadu_ps(row.h0Im + n);
+			__m128 e = _mm_loadu_ps(row.h0MinusRe + n), f = _mm_loadu_ps(row.h0MinusIm + n);
+			__m128 c = _mm_loadu_ps(row.phaseRe + n), d = _mm_loadu_ps(row.phaseIm + n);
+
+			__m128 h_re = _mm_sub_ps(_mm_mul_ps(c, _mm_add_ps(a, e)), _mm_mul_ps(d, _mm_add_ps(b, f)));
+			__m128 h_im = _mm_add_ps(_mm_mul_ps(d, _mm_sub_ps(a, e)), _mm_mul_ps(c, _mm_sub_ps(b, f)));
+			__m128 minus_h_im = _mm_xor_ps(h_im, sign);
+
+			__m128 inv_k = _mm_loadu_ps(row.kInverse + n);
+			__m128 kz = _mm_loadu_ps(row.kz + n);
+
+			_mm_storeu_ps(row.yRe + n, _mm_mul_ps(scale, h_re));
+			_mm_storeu_ps(row.yIm + n, _mm_mul_ps(scale, h_im));
+
+			__m128 dx = _mm_mul_ps(cx, inv_k);
+			__m128 dz = _mm_mul_ps(_mm_mul_ps(cz, kz), inv_k);
+
+			_mm_storeu_ps(row.xRe + n, _mm_mul_ps(dx, minus_h_im));
+			_mm_storeu_ps(row.xIm + n, _mm_mul_ps(dx, h_re));
+			_mm_storeu_ps(row.zRe + n, _mm_mul_ps(dz, minus_h_im));
+			_mm_storeu_ps(row.zIm + n, _mm_mul_ps(dz, h_re));
+
+			if(slopes)
+			{
+				__m128 skz = _mm_mul_ps(sz, kz);
+
+				_mm_storeu_ps(row.slopeXRe + n, _mm_mul_ps(sx, minus_h_im));
+				_mm_storeu_ps(row.slopeXIm + n, _mm_mul_ps(sx, h_re));
+				_mm_storeu_ps(row.slopeZRe + n, _mm_mul_ps(skz, minus_h_im));
+				_mm_storeu_ps(row.slopeZIm + n, _mm_mul_ps(skz, h_re));
+			}
+
+			if(jacobian)
+			{
+				__m128 jxx = _mm_mul_ps(fx, inv_k);
+				__m128 jzz = _mm_mul_ps(_mm_mul_ps(fz, _mm_mul_ps(kz, kz)), inv_k);
+				__m128 jxz = _mm_mul_ps(_mm_mul_ps(fxz, kz), inv_k);
+
+				_mm_storeu_ps(row.xxRe + n, _mm_mul_ps(jxx, h_re));
+				_mm_storeu_ps(row.xxIm + n, _mm_mul_ps(jxx, h_im));
+				_mm_storeu_ps(row.zzRe + n, _mm_mul_ps(jzz, h_re));
+				_mm_storeu_ps(row.zzIm + n, _mm_mul_ps(jzz, h_im));
+				_mm_storeu_ps(row.xzRe + n, _mm_mul_ps(jxz, h_re));
+				_mm_storeu_ps(row.xzIm + n, _mm_mul_ps(jxz, h_im));
+			}
+		}
+
+		SpectrumInputsScalar(row.Tail(n));
+	}
+
+	static const SpectrumKernels k_SSE2Kernels =
+	{
+		SIMD_SSE2,
+		RotateSSE2,
+		RenormalizeSSE2,
+		BuildRotationsSSE2,
+		SpectrumInputsSSE2
+	};
+
+	const SpectrumKernels* GetSpectrumKernelsSSE2()
+	{
+		return &k_SSE2Kernels;
+	}
+#else
+	const SpectrumKernels* GetSpectrumKernelsSSE2()
+	{
+		return NULL;
+	}
+#endif
+
+	template <>
+	const SpectrumKernelsT<float>& SpectrumKernelsT<float>::Get( SIMDLevel level )
+	{
+		static const SIMDLevel supported_level = DetectSIMDLevel();
+		if(level > supported_level)
+			level = supported_level;
+
+		switch(level)
+		{
+		case SIMD_AVX2:	return *GetSpectrumKernelsAVX2();
+		case SIMD_SSE2:	return *GetSpectrumKernelsSSE2();
+		default:		return k_ScalarKernels;
+		}
+	}
+
+	template <>
+	const SpectrumKernelsT<double>& SpectrumKernelsT<double>::Get( SIMDLevel )
+	{
+		return k_ScalarKernelsDouble;
+	}
+}
\ No newline at end of file
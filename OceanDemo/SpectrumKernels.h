@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Types.h"
+
+namespace acqua
+{
+	// Instruction sets the spectrum kernels are written for.
+	enum SIMDLevel
+	{
+		SIMD_SCALAR,
+		SIMD_SSE2,
+		SIMD_AVX2,	// AVX2 and FMA.
+		SIMD_LEVEL_COUNT
+	};
+
+	// Best level supported by both this CPU and the build.
+	SIMDLevel DetectSIMDLevel();
+	const char* GetSIMDLevelName(SIMDLevel level);
+
+	// One row of bins sharing the same kx, evolved to the time of phase and turned into the FFT inputs of every field
+	// in a single pass. hTilda is never stored: each bin's h0, h0Minus and phase are read once and all the inputs are
+	// written from registers. The derivatives of the chop displacement, Jxx = dDx/dx, Jzz = dDz/dz and Jxz = dDx/dz = dDz/dx,
+	// come from D = i * k / |k| * h, so every term is a real factor times h.
+	template <typename T>
+	struct SpectrumInputRowT
+	{
+		u32			count;
+		const T*	h0Re;
+		const T*	h0Im;
+		const T*	h0MinusRe;
+		const T*	h0MinusIm;
+		const T*	phaseRe;	// e^(i omega t)
+		const T*	phaseIm;
+		const T*	kInverse;	// 1 / |k| per bin, 0 at k = 0.
+		const T*	kz;			// kz per bin.
+		T			kx;
+		T			scale;		// Applied to the height and the chop displacements.
+		T			chop;		// Applied to the chop displacements.
+		T			slopeScaleX;	// Include the height scale and the units of the derivative.
+		T			slopeScaleZ;
+		T			jacobianScaleXX;	// Include the chop amount and the units of both the displacement and the derivative.
+		T			jacobianScaleZZ;
+		T			jacobianScaleXZ;
+
+		// With h = h0 * phase + conj(h0Minus * phase):
+		T* yRe; T* yIm;	// scale * h
+		T* xRe; T* xIm;	// scale * chop * i * h * kx / |k|, 0 at k = 0
+		T* zRe; T* zIm;	// scale * chop * i * h * kz / |k|, 0 at k = 0
+
+		// NULL when the spectral slopes aren't wanted.
+		T* slopeXRe; T* slopeXIm;	// i * kx * slopeScaleX * h
+		T* slopeZRe; T* slopeZIm;	// i * kz * slopeScaleZ * h
+
+		// NULL when the Jacobian isn't wanted.
+		T* xxRe; T* xxIm;	// -jacobianScaleXX * h * kx^2 / |k|, 0 at k = 0
+		T* zzRe; T* zzIm;	// -jacobianScaleZZ * h * kz^2 / |k|, 0 at k = 0
+		T* xzRe; T* xzIm;	// -jacobianScaleXZ * h * kx * kz / |k|, 0 at k = 0
+
+		// The bins from n on, for the scalar remainder of the SIMD kernels.
+		SpectrumInputRowT Tail(u32 n) const
+		{
+			SpectrumInputRowT tail = *this;
+			tail.count = count - n;
+			tail.h0Re += n; tail.h0Im += n; tail.h0MinusRe += n; tail.h0MinusIm += n;
+			tail.phaseRe += n; tail.phaseIm += n; tail.kInverse += n; tail.kz += n;
+			tail.yRe += n; tail.yIm += n; tail.xRe += n; tail.xIm += n; tail.zRe += n; tail.zIm += n;
+			if(slopeXRe != NULL)
+			{
+				tail.slopeXRe += n; tail.slopeXIm += n; tail.slopeZRe += n; tail.slopeZIm += n;
+			}
+			if(xxRe != NULL)
+			{
+				tail.xxRe += n; tail.xxIm += n; tail.zzRe += n; tail.zzIm += n; tail.xzRe += n; tail.xzIm += n;
+			}
+			return tail;
+		}
+	};
+
+	typedef SpectrumInputRowT<float> SpectrumInputRow;
+
+	// Row kernels of the spectrum evolution, working on split real and imaginary arrays of count values.
+	// Pointers needn't be aligned, but aligned rows (see SpectrumPlanes) are faster.
+	template <typename T>
+	struct SpectrumKernelsT
+	{
+		SIMDLevel level;
+
+		// phase *= step
+		void (*rotate)(u32 count, T* phase_re, T* phase_im, const T* step_re, const T* step_im);
+
+		// phase *= (3 - |phase|^2) / 2, a Newton step towards the unit circle.
+		void (*renormalize)(u32 count, T* phase_re, T* phase_im);
+
+		// step = e^(i omega dt). Taylor series at omega dt / 2^halvings, squared back up. No transcendentals.
+		void (*buildRotations)(u32 count, const T* omega, T dt, u32 halvings, T* step_re, T* step_im);
+
+		// Evolves a row and writes the FFT inputs of all its fields, see SpectrumInputRowT.
+		void (*spectrumInputs)(const SpectrumInputRowT<T>& row);
+
+		// Kernels of the given level, or of the best supported level below it.
+		static const SpectrumKernelsT& Get(SIMDLevel level);
+	};
+
+	typedef SpectrumKernelsT<float> SpectrumKernels;
+
+	// Single precision has a set of kernels per instruction set. Double precision, for validation runs,
+	// always gets the scalar ones.
+	template <> const SpectrumKernelsT<float>& SpectrumKernelsT<float>::Get(SIMDLevel level);
+	template <> const SpectrumKernelsT<double>& SpectrumKernelsT<double>::Get(SIMDLevel level);
+
+	// Implemented in their own translation units, they return NULL when the build can't generate the instructions.
+	const SpectrumKernels* GetSpectrumKernelsSSE2();
+	const SpectrumKernels* GetSpectrumKernelsAVX2();
+}
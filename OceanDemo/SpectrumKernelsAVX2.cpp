@@ -0,0 +1,171 @@
+#include "SpectrumKernels.h"
+
+// MSVC emits AVX2 intrinsics without any flag. Other compilers need this file built with -mavx2 -mfma.
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || (defined(__AVX2__) && defined(__FMA__))
+	#define ACQUA_AVX2 1
+	#include <immintrin.h>
+#endif
+
+namespace acqua
+{
+#if defined(ACQUA_AVX2)
+	// 8 bins at a time, the remainder goes through the scalar kernels.
+
+	static void RotateAVX2(u32 count, float* phase_re, float* phase_im, const float* step_re, const float* step_im)
+	{
+		u32 n = 0;
+		for(; n + 8 <= count; n += 8)
+		{
+			__m256 c = _mm256_loadu_ps(phase_re + n), d = _mm256_loadu_ps(phase_im + n);
+			__m256 sr = _mm256_loadu_ps(step_re + n), si = _mm256_loadu_ps(step_im + n);
+
+			_mm256_storeu_ps(phase_re + n, _mm256_fmsub_ps(c, sr, _mm256_mul_ps(d, si)));
+			_mm256_storeu_ps(phase_im + n, _mm256_fmadd_ps(c, si, _mm256_mul_ps(d, sr)));
+		}
+
+		SpectrumKernels::Get(SIMD_SCALAR).rotate(count - n, phase_re + n, phase_im + n, step_re + n, step_im + n);
+	}
+
+	static void RenormalizeAVX2(u32 count, float* phase_re, float* phase_im)
+	{
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 three = _mm256_set1_ps(3.0f);
+
+		u32 n = 0;
+		for(; n + 8 <= count; n += 8)
+		{
+			__m256 c = _mm256_loadu_ps(phase_re + n), d = _mm256_loadu_ps(phase_im + n);
+			__m256 norm = _mm256_fmadd_ps(c, c, _mm256_mul_ps(d, d));
+			__m256 factor = _mm256_mul_ps(half, _mm256_sub_ps(three, norm));
+
+			_mm256_storeu_ps(phase_re + n, _mm256_mul_ps(c, factor));
+			_mm256_storeu_ps(phase_im + n, _mm256_mul_ps(d, factor));
+		}
+
+		SpectrumKernels::Get(SIMD_SCALAR).renormalize(count - n, phase_re + n, phase_im + n);
+	}
+
+	static void BuildRotationsAVX2(u32 count, const float* omega, float dt, u32 halvings, float* step_re, float* step_im)
+	{
+		const __m256 angle_scale = _mm256_set1_ps(dt / static_cast<float>(1u << halvings));
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 two = _mm256_set1_ps(2.0f);
+
+		u32 n = 0;
+		for(; n + 8 <= count; n += 8)
+		{
+			__m256 a = _mm256_mul_ps(_mm256_loadu_ps(omega + n), angle_scale);
+			__m256 a2 = _mm256_mul_ps(a, a);
+
+			// 1 - x * y written as fnmadd(x, y, 1).
+			__m256 c = _mm256_fnmadd_ps(a2, _mm256_set1_ps(1.0f / 30.0f), one);
+			c = _mm256_fnmadd_ps(_mm256_mul_ps(a2, _mm256_set1_ps(1.0f / 12.0f)), c, one);
+			c = _mm256_fnmadd_ps(_mm256_mul_ps(a2, _mm256_set1_ps(1.0f / 2.0f)), c, one);
+
+			__m256 s = _mm256_fnmadd_ps(a2, _mm256_set1_ps(1.0f / 42.0f), one);
+			s = _mm256_fnmadd_ps(_mm256_mul_ps(a2, _mm256_set1_ps(1.0f / 20.0f)), s, one);
+			s = _mm256_fnmadd_ps(_mm256_mul_ps(a2, _mm256_set1_ps(1.0f / 6.0f)), s, one);
+			s = _mm256_mul_ps(a, s);
+
+			for(u32 h = 0; h < halvings; ++h)
+			{
+				__m256 c2 = _mm256_fmsub_ps(c, c, _mm256_mul_ps(s, s));
+				s = _mm256_mul_ps(two, _mm256_mul_ps(c, s));
+				c = c2;
+			}
+
+			_mm256_storeu_ps(step_re + n, c);
+			_mm256_storeu_ps(step_im + n, s);
+		}
+
+		SpectrumKernels::Get(SIMD_SCALAR).buildRotations(count - n, omega + n, dt, halvings, step_re + n, step_im + n);
+	}
+
+	static void SpectrumInputsAVX2(const SpectrumInputRow& row)
+	{
+		const bool slopes = row.slopeXRe != NULL;
+		const bool jacobian = row.xxRe != NULL;
+
+		const __m256 scale = _mm256_set1_ps(row.scale);
+		const __m256 cx = _mm256_set1_ps(row.scale * row.chop * row.kx);
+		const __m256 cz = _mm256_set1_ps(row.scale * row.chop);
+		const __m256 sx = _mm256_set1_ps(row.slopeScaleX * row.kx);
+		const __m256 sz = _mm256_set1_ps(row.slopeScaleZ);
+		const __m256 fx = _mm256_set1_ps(-row.jacobianScaleXX * row.kx * row.kx);
+		const __m256 fz = _mm256_set1_ps(-row.jacobianScaleZZ);
+		const __m256 fxz = _mm256_set1_ps(-row.jacobianScaleXZ * row.kx);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+
+		u32 n = 0;
+		for(; n + 8 <= row.count; n += 8)
+		{
+			__m256 a = _mm256_loadu_ps(row.h0Re + n), b = _mm256_loadu_ps(row.h0Im + n);
+			__m256 e = _mm256_loadu_ps(row.h0MinusRe + n), f = _mm256_loadu_ps(row.h0MinusIm + n);
+			__m256 c = _mm256_loadu_ps(row.phaseRe + n), d = _mm256_loadu_ps(row.phaseIm + n);
+
+			__m256 h_re = _mm256_fmsub_ps(c, _mm256_add_ps(a, e), _mm256_mul_ps(d, _mm256_add_ps(b, f)));
+			__m256 h_im = _mm256_fmadd_ps(d, _mm256_sub_ps(a, e), _mm256_mul_ps(c, _mm256_sub_ps(b, f)));
+			__m256 minus_h_im = _mm256_xor_ps(h_im, sign);
+
+			__m256 inv_k = _mm256_loadu_ps(row.kInverse + n);
+			__m256 kz = _mm256_loadu_ps(row.kz + n);
+
+			_mm256_storeu_ps(row.yRe + n, _mm256_mul_ps(scale, h_re));
+			_mm256_storeu_ps(row.yIm + n, _mm256_mul_ps(scale, h_im));
+
+			__m256 dx = _mm256_mul_ps(cx, inv_k);
+			__m256 dz = _mm256_mul_ps(_mm256_mul_ps(cz, kz), inv_k);
+
+			_mm256_storeu_ps(row.xRe + n, _mm256_mul_ps(dx, minus_h_im));
+			_mm256_storeu_ps(row.xIm + n, _mm256_mul_ps(dx, h_re));
+			_mm256_storeu_ps(row.zRe + n, _mm256_mul_ps(dz, minus_h_im));
+			_mm256_storeu_ps(row.zIm + n, _mm256_mul_ps(dz, h_re));
+
+			if(slopes)
+			{
+				__m256 skz = _mm256_mul_ps(sz, kz);
+
+				_mm256_storeu_ps(row.slopeXRe + n, _mm256_mul_ps(sx, minus_h_im));
+				_mm256_storeu_ps(row.slopeXIm + n, _mm256_mul_ps(sx, h_re));
+				_mm256_storeu_ps(row.slopeZRe + n, _mm256_mul_ps(skz, minus_h_im));
+				_mm256_storeu_ps(row.slopeZIm + n, _mm256_mul_ps(skz, h_re));
+			}
+
+			if(jacobian)
+			{
+				__m256 jxx = _mm256_mul_ps(fx, inv_k);
+				__m256 jzz = _mm256_mul_ps(_mm256_mul_ps(fz, _mm256_mul_ps(kz, kz)), inv_k);
+				__m256 jxz = _mm256_mul_ps(_mm256_mul_ps(fxz, kz), inv_k);
+
+				_mm256_storeu_ps(row.xxRe + n, _mm256_mul_ps(jxx, h_re));
+				_mm256_storeu_ps(row.xxIm + n, _mm256_mul_ps(jxx, h_im));
+				_mm256_storeu_ps(row.zzRe + n, _mm256_mul_ps(jzz, h_re));
+				_mm256_storeu_ps(row.zzIm + n, _mm256_mul_ps(jzz, h_im));
+				_mm256_storeu_ps(row.xzRe + n, _mm256_mul_ps(jxz, h_re));
+				_mm256_storeu_ps(row.xzIm + n, _mm256_mul_ps(jxz, h_im));
+			}
+		}
+
+		SpectrumKernels::Get(SIMD_SCALAR).spectrumInputs(row.Tail(n));
+	}
+
+	static const SpectrumKernels k_AVX2Kernels =
+	{
+		SIMD_AVX2,
+		RotateAVX2,
+		RenormalizeAVX2,
+		BuildRotationsAVX2,
+		SpectrumInputsAVX2
+	};
+
+	const SpectrumKernels* GetSpectrumKernelsAVX2()
+	{
+		return &k_AVX2Kernels;
+	}
+#else
+	const SpectrumKernels* GetSpectrumKernelsAVX2()
+	{
+		return NULL;
+	}
+#endif
+}
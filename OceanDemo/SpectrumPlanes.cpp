@@ -0,0 +1,92 @@
+#include "SpectrumPlanes.h"
+#include "DebugUtil.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER)
+	#include <malloc.h>
+#endif
+
+namespace acqua
+{
+	void* AlignedMalloc( size_t size, size_t alignment )
+	{
+#if defined(_MSC_VER)
+		return _aligned_malloc(size, alignment);
+#else
+		void* ptr = NULL;
+		if(posix_memalign(&ptr, alignment, size) != 0)
+			return NULL;
+
+		return ptr;
+#endif
+	}
+
+	void AlignedFree( void* ptr )
+	{
+#if defined(_MSC_VER)
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+
+	template <typename T>
+	SpectrumPlanesT<T>::SpectrumPlanesT( void ) :
+		data(NULL)
+		, rows(0)
+		, cols(0)
+		, rowStride(0)
+		, planeStride(0)
+		, numPlanes(0)
+	{
+	}
+
+	template <typename T>
+	SpectrumPlanesT<T>::~SpectrumPlanesT( void )
+	{
+		AlignedFree(data);
+	}
+
+	template <typename T>
+	void SpectrumPlanesT<T>::Resize( u32 r, u32 c, u32 num_planes )
+	{
+		const u32 values_per_alignment = k_SpectrumAlignment / sizeof(T);
+
+		u32 new_row_stride = (c + values_per_alignment - 1) / values_per_alignment * values_per_alignment;
+		u32 new_plane_stride = new_row_stride * r;
+
+		// Kernels stream through many planes at once. Planes a multiple of 4 KiB apart would all map to the same
+		// cache sets, so they are staggered by a cache line.
+		if((sizeof(T) * new_plane_stride) % k_SpectrumPlaneSetSpan == 0)
+			new_plane_stride += k_SpectrumPlaneStagger / sizeof(T);
+
+		if(data != NULL && new_plane_stride * num_planes == planeStride * numPlanes)
+		{
+			// Same footprint, keep the block.
+		}
+		else
+		{
+			AlignedFree(data);
+			data = static_cast<T*>(AlignedMalloc(sizeof(T) * new_plane_stride * num_planes, k_SpectrumAlignment));
+			ASSERT(data != NULL || new_plane_stride * num_planes == 0, "Out of memory.");
+		}
+
+		rows = r;
+		cols = c;
+		rowStride = new_row_stride;
+		planeStride = new_plane_stride;
+		numPlanes = num_planes;
+	}
+
+	template <typename T>
+	void SpectrumPlanesT<T>::Zero()
+	{
+		if(data != NULL)
+			memset(data, 0, GetSizeInBytes());
+	}
+
+	template class SpectrumPlanesT<float>;
+	template class SpectrumPlanesT<double>;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Types.h"
+
+#include <cstddef>
+
+namespace acqua
+{
+	// Alignment of every row of a SpectrumPlanes, in bytes. Wide enough for AVX loads.
+	const u32 k_SpectrumAlignment = 32;
+
+	// Planes whose size is a multiple of the set span are padded by the stagger, both in bytes. See Resize.
+	const u32 k_SpectrumPlaneSetSpan = 4096;
+	const u32 k_SpectrumPlaneStagger = 64;
+
+	void* AlignedMalloc(size_t size, size_t alignment);
+	void AlignedFree(void* ptr);
+
+	// A set of 2D planes of T stored in one aligned block, all with the same padded row stride.
+	// Complex spectra are kept as structure of arrays: field f lives in plane 2f (real) and 2f+1 (imaginary),
+	// so the real planes of consecutive fields are 2 * GetPlaneStride() apart.
+	// Instantiated for T and double.
+	template <typename T>
+	class SpectrumPlanesT
+	{
+	public:
+		SpectrumPlanesT(void);
+		~SpectrumPlanesT(void);
+
+		// Reallocates num_planes planes of rows x cols values. The content is undefined.
+		void Resize(u32 rows, u32 cols, u32 num_planes);
+		void ResizeComplex(u32 rows, u32 cols, u32 num_fields) { Resize(rows, cols, 2 * num_fields); }
+		void Zero();
+
+		// Real planes.
+		T* Row(u32 plane, u32 row) { return data + plane * planeStride + row * rowStride; }
+		const T* Row(u32 plane, u32 row) const { return data + plane * planeStride + row * rowStride; }
+
+		// Complex fields.
+		T* Re(u32 field, u32 row) { return Row(2 * field, row); }
+		T* Im(u32 field, u32 row) { return Row(2 * field + 1, row); }
+		const T* Re(u32 field, u32 row) const { return Row(2 * field, row); }
+		const T* Im(u32 field, u32 row) const { return Row(2 * field + 1, row); }
+
+		// Accessors.
+		u32 GetRows() const { return rows; }
+		u32 GetCols() const { return cols; }
+		u32 GetRowStride() const { return rowStride; }		// In values.
+		u32 GetPlaneStride() const { return planeStride; }	// In values.
+		u32 GetPlaneCount() const { return numPlanes; }
+		size_t GetSizeInBytes() const { return sizeof(T) * planeStride * numPlanes; }
+
+	private:
+		SpectrumPlanesT(const SpectrumPlanesT&);
+		SpectrumPlanesT& operator=(const SpectrumPlanesT&);
+
+	private:
+		T*	data;
+
+		u32		rows;
+		u32		cols;
+		u32		rowStride;
+		u32		planeStride;
+		u32		numPlanes;
+	};
+
+	typedef SpectrumPlanesT<float> SpectrumPlanes;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Types.h"
+
+#include <atomic>
+
+namespace acqua
+{
+	// Three slots of T handed from one writer thread to one reader thread without locks.
+	// The writer fills the back slot and publishes it, the reader takes the latest published slot as its front.
+	// Neither side ever waits on the other: a slot published before the previous one was taken replaces it (dropped),
+	// and a read with nothing new keeps the slot taken last (stale).
+	template <typename T>
+	class TripleBuffer
+	{
+	public:
+		TripleBuffer(void) : back(0), front(2), middle(1), droppedCount(0), staleCount(0)
+		{
+
+		}
+
+		// Writer side.
+		T& GetBack() { return slots[back]; }
+
+		// Makes the back slot the latest one and takes the previous latest as the new back.
+		void Publish()
+		{
+			u32 previous = middle.exchange(back | k_NewFlag, std::memory_order_acq_rel);
+			back = previous & k_IndexMask;
+
+			if(previous & k_NewFlag)
+				droppedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Reader side.
+		const T& GetFront() const { return slots[front]; }
+
+		// Takes the latest published slot as the front. False when nothing was published since the last call.
+		bool Consume()
+		{
+			if((middle.load(std::memory_order_relaxed) & k_NewFlag) == 0)
+			{
+				++staleCount;
+				return false;
+			}
+
+			u32 previous = middle.exchange(front, std::memory_order_acq_rel);
+			front = previous & k_IndexMask;
+			return true;
+		}
+
+		// Slots published and replaced before being consumed. Safe to read from the reader thread.
+		u32 GetDroppedCount() const { return droppedCount.load(std::memory_order_relaxed); }
+		// Consumes that found nothing new.
+		u32 GetStaleCount() const { return staleCount; }
+
+		// Every slot, to set them up while neither thread uses the buffer.
+		T& GetSlot(u32 index) { return slots[index]; }
+		static u32 GetSlotCount() { return 3; }
+
+		// Forgets what was published and clears the counters. Only while neither thread uses the buffer.
+		void Reset()
+		{
+			back = 0;
+			front = 2;
+			middle.store(1, std::memory_order_relaxed);
+			droppedCount.store(0, std::memory_order_relaxed);
+			staleCount = 0;
+		}
+
+	private:
+		TripleBuffer(const TripleBuffer&);
+		TripleBuffer& operator=(const TripleBuffer&);
+
+		static const u32 k_IndexMask = 3;
+		static const u32 k_NewFlag = 4; // Set in middle when it holds a slot the reader hasn't taken.
+
+	private:
+		T slots[3];
+
+		u32 back;	// Owned by the writer.
+		u32 front;	// Owned by the reader.
+		std::atomic<u32> middle; // Index of the latest published slot, plus k_NewFlag.
+
+		std::atomic<u32> droppedCount;
+		u32 staleCount;
+	};
+}
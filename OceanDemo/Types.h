@@ -12,6 +12,7 @@ namespace acqua
 	typedef unsigned char	u8;
 	typedef unsigned short	u16;
 	typedef unsigned int	u32;
+	typedef unsigned long long	u64;
 	typedef	int				i32;
 
 	typedef float			real32;
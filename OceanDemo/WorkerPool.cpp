@@ -0,0 +1,160 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace acqua
+{
+	WorkerPool::WorkerPool( void ) :
+		job(NULL)
+		, jobBegin(0)
+		, jobCount(0)
+		, jobChunks(0)
+		, nextChunk(0)
+		, pendingChunks(0)
+		, generation(0)
+		, quit(false)
+	{
+	}
+
+	WorkerPool::~WorkerPool( void )
+	{
+		StopWorkers();
+	}
+
+	u32 WorkerPool::GetHardwareThreadCount()
+	{
+		u32 hardware_threads = std::thread::hardware_concurrency();
+		return hardware_threads > 0 ? hardware_threads : 1;
+	}
+
+	void WorkerPool::SetThreadCount( u32 num_threads )
+	{
+		if(num_threads == 0)
+			num_threads = GetHardwareThreadCount();
+
+		if(num_threads == GetThreadCount())
+			return;
+
+		StopWorkers();
+
+		// The calling thread is the first participant.
+		for(u32 t = 1; t < num_threads; ++t)
+		{
+			workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+		}
+	}
+
+	void WorkerPool::StopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		workAvailable.notify_all();
+
+		for(size_t t = 0; t < workers.size(); ++t)
+		{
+			workers[t].join();
+		}
+		workers.clear();
+
+		quit = false;
+	}
+
+	void WorkerPool::ParallelFor( int begin, int end, const RangeFunction& fn )
+	{
+		int count = end - begin;
+		if(count <= 0)
+			return;
+
+		int num_chunks = std::min(static_cast<int>(GetThreadCount()), count);
+		if(num_chunks == 1)
+		{
+			fn(begin, end);
+			return;
+		}
+
+		u32 job_generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			jobBegin = begin;
+			jobCount = count;
+			jobChunks = num_chunks;
+			nextChunk = 0;
+			pendingChunks = num_chunks;
+			job_generation = ++generation;
+		}
+		workAvailable.notify_all();
+
+		RunChunks(job_generation);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while(pendingChunks > 0)
+		{
+			workDone.wait(lock);
+		}
+		job = NULL;
+	}
+
+	void WorkerPool::WorkerLoop()
+	{
+		u32 seen_generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			seen_generation = generation;
+		}
+
+		for(;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while(!quit && generation == seen_generation)
+				{
+					workAvailable.wait(lock);
+				}
+
+				if(quit)
+					return;
+
+				seen_generation = generation;
+			}
+
+			RunChunks(seen_generation);
+		}
+	}
+
+	void WorkerPool::RunChunks( u32 job_generation )
+	{
+		for(;;)
+		{
+			int chunk = 0;
+			int chunk_begin = 0;
+			int chunk_end = 0;
+			const RangeFunction* fn = NULL;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				// A late worker must not take chunks of a newer job it wasn't woken for.
+				if(generation != job_generation || nextChunk >= jobChunks)
+					return;
+
+				chunk = nextChunk++;
+				chunk_begin = jobBegin + static_cast<int>((static_cast<long long>(jobCount) * chunk) / jobChunks);
+				chunk_end = jobBegin + static_cast<int>((static_cast<long long>(jobCount) * (chunk + 1)) / jobChunks);
+				fn = job;
+			}
+
+			(*fn)(chunk_begin, chunk_end);
+
+			bool finished = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished = (--pendingChunks == 0);
+			}
+
+			if(finished)
+				workDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Types.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace acqua
+{
+	// Fixed set of worker threads running data parallel loops.
+	// Ranges are cut in contiguous chunks, so as long as each index is computed independently
+	// the results don't depend on the number of threads.
+	class WorkerPool
+	{
+	public:
+		// Processes the indices [begin, end).
+		typedef std::function<void (int begin, int end)> RangeFunction;
+
+		WorkerPool(void);
+		~WorkerPool(void);
+
+		// Number of threads taking part in a loop, the calling thread included. 0 uses every hardware thread.
+		void SetThreadCount(u32 num_threads);
+		u32 GetThreadCount() const { return static_cast<u32>(workers.size()) + 1; }
+
+		// Runs fn over [begin, end) split among the threads and waits for all of them.
+		void ParallelFor(int begin, int end, const RangeFunction& fn);
+
+		static u32 GetHardwareThreadCount();
+
+	private:
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		void StopWorkers();
+		void WorkerLoop();
+
+		// Runs chunks of the job of the given generation until there are none left.
+		void RunChunks(u32 generation);
+
+	private:
+		std::vector<std::thread> workers;
+
+		std::mutex				mutex;
+		std::condition_variable	workAvailable;
+		std::condition_variable	workDone;
+
+		// Current job. Protected by mutex.
+		const RangeFunction*	job;
+		int						jobBegin;
+		int						jobCount;
+		int						jobChunks;
+		int						nextChunk;
+		int						pendingChunks;
+		u32						generation;	// Incremented for every job, wakes the workers.
+		bool					quit;
+	};
+}
@@ -0,0 +1,765 @@
+// Headless benchmark of the ocean simulation.
+// Runs OceanSimulationT, with no window or GL context, over a sweep of grid sizes, thread counts and precisions,
+// and reports the milliseconds per frame of each stage and the throughput in bins per second.
+// Then floats buoyancy probes on the float simulation of each size and reports the milliseconds per step, and times the
+// sparse spectrum against the simulation it stands in for, checking it against the texels. Last, checks the bounds
+// pyramid of small cascades, with partial tiles, against the displacements. Returns 1 when a check fails.
+//
+// Usage: SimulationBenchmark [--sizes 64,128,...] [--threads 1,2,...] [--compute float,double] [--texels float,half] [--seconds s] [--prune p] [--probes n] [--waves 64,...] [--measure] [--csv]
+//   --sizes     M = N of the grids, rounded like the cascades' (see GetFFTSize). Defaults to the powers of two from 64 to 2048.
+//   --threads   Thread counts. Defaults to the powers of two up to the hardware threads, and those.
+//   --compute   Precisions of the simulation (see OceanCascadeT). Defaults to both.
+//   --texels    Storage of the packed texels (see OceanTexel). Defaults to both.
+//   --seconds   Minimum time simulated per measurement. Defaults to 0.5.
+//   --prune     Energy threshold of the spectrum pruning (see OceanSettings::pruneThreshold). Defaults to the settings'.
+//   --probes    Buoyancy probes, 8 per body (see BuoyancySystem), also timed as a query of as many positions. Defaults to 10000, 0 skips them.
+//   --waves     Waves kept by the sparse spectrum (see SparseSpectrum), timed against simulating and packing the float cascade
+//               they come from, unpruned so it has them all, and checked against its texels. Sizes up to 256 also keep
+//               every wave. Defaults to 64,256,1024, 0 skips them.
+//   --measure   Measured FFTW plans instead of estimated ones. Slower to start, wisdom is kept on disk.
+//   --csv       Comma separated output, for tracking regressions.
+//
+// Only depends on the GL free sources of OceanDemo (the OceanCore library), FFTW and blitz++, so it builds on
+// Linux as well, for instance with the distribution's fftw3 and blitz++ packages:
+//   g++ -std=c++11 -O2 -pthread -I../OceanDemo -I../Lib/glm/include -I../Lib/Imath -c ../OceanDemo/SpectrumKernelsAVX2.cpp -mavx2 -mfma
+//   g++ -std=c++11 -O2 -pthread -I../OceanDemo -I../Lib/glm/include -I../Lib/Imath main.cpp SpectrumKernelsAVX2.o
+//       ../OceanDemo/{BuoyancySystem,FFTWisdomCache,OceanCascade,OceanQuery,OceanSimulation,SparseSpectrum,SpectrumKernels,SpectrumPlanes,WorkerPool}.cpp
+//       -lfftw3f_threads -lfftw3_threads -lfftw3f -lfftw3 -lblitz -o SimulationBenchmark
+
+#include "BuoyancySystem.h"
+#include "OceanSimulation.h"
+#include "SparseSpectrum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace acqua;
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Heights are scaled like in OceanComponent, 1 / (GRID_MULTIPLIER * SEGMENT_WIDTH).
+	const Real k_HeightScale = 1.0f / 50.0f;
+	const Real k_FrameStep = 1.0f / 60.0f;
+	const u32 k_WarmUpFrames = 3;
+	const u32 k_MinFrames = 5;
+	const u32 k_ProbesPerBody = 8;
+
+	// The sparse spectrum is timed at two point counts, the difference giving the cost per point. Its outputs are checked
+	// at up to k_SparseCheckTexels texel centres. Keeping every wave is only done up to k_MaxAllWavesSize, it gets slow.
+	const u32 k_SparsePointCounts[2] = { 64, 4096 };
+	const u32 k_SparseCheckTexels = 4096;
+	const u32 k_MaxAllWavesSize = 256;
+	const u32 k_AllWaves = ~0u;
+
+	// The bounds pyramid is checked on grids with partial tiles and odd levels, split among one thread and several.
+	const u32 k_BoundsCheckSizes[] = { 12, 20, 36, 64 };
+	const u32 k_BoundsCheckThreads[] = { 1, 3 };
+
+	// Instantiations of the simulation and of the packing, each one a separate compiled path.
+	enum ComputePrecision { COMPUTE_FLOAT, COMPUTE_DOUBLE, COMPUTE_COUNT };
+	enum TexelStorage { TEXELS_FLOAT, TEXELS_HALF, TEXELS_COUNT };
+
+	const char* const k_ComputeNames[COMPUTE_COUNT] = { "float", "double" };
+	const char* const k_TexelNames[TEXELS_COUNT] = { "float", "half" };
+
+	struct BenchmarkOptions
+	{
+		std::vector<u32> sizes;
+		std::vector<u32> threads;
+		bool compute[COMPUTE_COUNT];
+		bool texels[TEXELS_COUNT];
+		double seconds;
+		Real pruneThreshold;
+		u32 probes;
+		std::vector<u32> waves;
+		bool measure;
+		bool csv;
+
+		BenchmarkOptions() : seconds(0.5), pruneThreshold(OceanSettings().pruneThreshold), probes(10000), measure(false), csv(false)
+		{
+			compute[COMPUTE_FLOAT] = compute[COMPUTE_DOUBLE] = true;
+			texels[TEXELS_FLOAT] = texels[TEXELS_HALF] = true;
+
+			for(u32 size = 64; size <= 2048; size *= 2)
+				sizes.push_back(size);
+
+			u32 hardware_threads = WorkerPool::GetHardwareThreadCount();
+			for(u32 count = 1; count < hardware_threads; count *= 2)
+				threads.push_back(count);
+			threads.push_back(hardware_threads);
+
+			waves.push_back(64);
+			waves.push_back(256);
+			waves.push_back(1024);
+		}
+	};
+
+	// Milliseconds per frame of each stage of one measurement.
+	struct Result
+	{
+		double spectrum;	// Once per reset, not per frame.
+		double planning;	// Once per reset, not per frame.
+		double evolution;
+		double fft;
+		double normals;
+		double foam;
+		double bounds;		// Min/max pyramid of the displacements.
+		double pack;		// Texels for the displacement maps.
+		double total;
+		double binsPerSecond;
+		double activeBins;		// Fraction of the half spectrum evolved.
+		double prunedEnergy;	// Fraction of the energy of the spectrum left out.
+		double megabytes;		// Held by the cascade.
+	};
+
+	// Milliseconds per step of the buoyancy measurement.
+	struct BuoyancyResult
+	{
+		double query;	// QueryOceanSurface of as many positions as there are probes, with the buoyancy query options.
+		double step;	// BuoyancySystem::Step, which queries the probes once and integrates the bodies.
+		double probesPerSecond;
+	};
+
+	// One row of the sparse spectrum measurement. Times in milliseconds, errors in world units.
+	struct SparseResult
+	{
+		u32 waves;				// Kept.
+		double build;			// Once per reset, not per frame.
+		double simulate;		// Simulate and PackTexels of the cascade, per frame.
+		double evaluate[2];		// SetTime and Evaluate of k_SparsePointCounts points, per frame.
+		double crossover;		// Points at which evaluating costs as much as simulating, measured.
+		u32 modelCrossover;		// Same from the cost model, GetBreakEvenPointCount.
+		double heightError;		// Largest difference with the texels at their centres.
+		double heightBound;		// ErrorBounds::maxHeightError, plus the rounding of the texels, no more than that of the sums.
+		double horizontalError;
+		double horizontalBound;
+		bool pass;
+	};
+
+	std::vector<u32> ParseList(const char* text)
+	{
+		std::vector<u32> values;
+		while(*text != '\0')
+		{
+			char* end = NULL;
+			unsigned long value = strtoul(text, &end, 10);
+			if(end == text)
+				break;
+
+			if(value > 0)
+				values.push_back(static_cast<u32>(value));
+			text = (*end == ',') ? end + 1 : end;
+		}
+
+		return values;
+	}
+
+	// Comma separated names, each one enabling its entry of enabled. False on an unknown name or an empty list.
+	bool ParseNames(const char* text, const char* const* names, u32 count, bool* enabled)
+	{
+		for(u32 n = 0; n < count; ++n)
+			enabled[n] = false;
+
+		bool any = false;
+		while(*text != '\0')
+		{
+			const char* end = strchr(text, ',');
+			size_t length = (end != NULL) ? static_cast<size_t>(end - text) : strlen(text);
+
+			bool found = false;
+			for(u32 n = 0; n < count && !found; ++n)
+			{
+				found = strlen(names[n]) == length && strncmp(names[n], text, length) == 0;
+				if(found)
+					enabled[n] = any = true;
+			}
+
+			if(!found)
+				return false;
+
+			text = (end != NULL) ? end + 1 : text + length;
+		}
+
+		return any;
+	}
+
+	bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+	{
+		for(int a = 1; a < argc; ++a)
+		{
+			bool has_value = (a + 1 < argc);
+			if(strcmp(argv[a], "--sizes") == 0 && has_value)
+				options.sizes = ParseList(argv[++a]);
+			else if(strcmp(argv[a], "--threads") == 0 && has_value)
+				options.threads = ParseList(argv[++a]);
+			else if(strcmp(argv[a], "--compute") == 0 && has_value)
+			{
+				if(!ParseNames(argv[++a], k_ComputeNames, COMPUTE_COUNT, options.compute))
+					return false;
+			}
+			else if(strcmp(argv[a], "--texels") == 0 && has_value)
+			{
+				if(!ParseNames(argv[++a], k_TexelNames, TEXELS_COUNT, options.texels))
+					return false;
+			}
+			else if(strcmp(argv[a], "--seconds") == 0 && has_value)
+				options.seconds = atof(argv[++a]);
+			else if(strcmp(argv[a], "--prune") == 0 && has_value)
+				options.pruneThreshold = static_cast<Real>(atof(argv[++a]));
+			else if(strcmp(argv[a], "--probes") == 0 && has_value)
+				options.probes = static_cast<u32>(strtoul(argv[++a], NULL, 10));
+			else if(strcmp(argv[a], "--waves") == 0 && has_value)
+				options.waves = ParseList(argv[++a]);
+			else if(strcmp(argv[a], "--measure") == 0)
+				options.measure = true;
+			else if(strcmp(argv[a], "--csv") == 0)
+				options.csv = true;
+			else
+				return false;
+		}
+
+		return !options.sizes.empty() && !options.threads.empty();
+	}
+
+	// T is the precision of the simulation, Texel the storage of the packed texels.
+	template <typename T, typename Texel>
+	Result Measure(u32 size, u32 threads, const BenchmarkOptions& options)
+	{
+		OceanSettings settings;
+		settings.cascadeCount = 1;
+		settings.cascades[0].resolution = size;
+		settings.threadCount = threads;
+		settings.planningMode = options.measure ? FFT_PLAN_MEASURE : FFT_PLAN_ESTIMATE;
+		settings.pruneThreshold = options.pruneThreshold;
+
+		OceanSimulationT<T> simulation;
+		simulation.Reset(settings);
+
+		Result result;
+		CascadeTimings reset_timings = simulation.GetTimings();
+		result.spectrum = 1000.0 * reset_timings.spectrum;
+		result.planning = 1000.0 * reset_timings.planning;
+
+		const OceanCascadeT<T>& cascade = simulation.GetCascade(0);
+		std::vector<Texel> displacement(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 4);
+		std::vector<Texel> slope(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 2);
+
+		// The first frames resynchronise the phases and build the rotations, the steady state steps them.
+		u32 frame = 0;
+		for(; frame < k_WarmUpFrames; ++frame)
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+		simulation.ResetTimings();
+
+		double pack_seconds = 0.0;
+		u32 frames = 0;
+		Clock::time_point start = Clock::now();
+		double seconds = 0.0;
+		do
+		{
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+
+			Clock::time_point pack_start = Clock::now();
+			cascade.PackTexels(&displacement[0], &slope[0]);
+			pack_seconds += std::chrono::duration<double>(Clock::now() - pack_start).count();
+
+			++frame;
+			++frames;
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while(seconds < options.seconds || frames < k_MinFrames);
+
+		CascadeTimings timings = simulation.GetTimings();
+		result.evolution = 1000.0 * timings.evolution / frames;
+		result.fft = 1000.0 * timings.fft / frames;
+		result.normals = 1000.0 * timings.normals / frames;
+		result.foam = 1000.0 * timings.foam / frames;
+		result.bounds = 1000.0 * timings.bounds / frames;
+		result.pack = 1000.0 * pack_seconds / frames;
+		result.total = 1000.0 * seconds / frames;
+		result.binsPerSecond = static_cast<double>(cascade.GetM()) * cascade.GetN() * frames / seconds;
+		result.activeBins = static_cast<double>(cascade.GetActiveBinCount()) / (cascade.GetM() * (cascade.GetN() / 2 + 1));
+		result.prunedEnergy = cascade.GetPrunedEnergyFraction();
+		result.megabytes = cascade.GetMemory().GetTotal() / (1024.0 * 1024.0);
+
+		return result;
+	}
+
+	Result Measure(ComputePrecision compute, TexelStorage texels, u32 size, u32 threads, const BenchmarkOptions& options)
+	{
+		if(compute == COMPUTE_DOUBLE)
+			return (texels == TEXELS_HALF) ? Measure<double, Half>(size, threads, options) : Measure<double, float>(size, threads, options);
+
+		return (texels == TEXELS_HALF) ? Measure<float, Half>(size, threads, options) : Measure<float, float>(size, threads, options);
+	}
+
+	// Boxes of 8 probes on a grid over the patch of a float cascade, stepped on its packed texels every frame.
+	BuoyancyResult MeasureBuoyancy(u32 size, u32 threads, const BenchmarkOptions& options)
+	{
+		OceanSettings settings;
+		settings.cascadeCount = 1;
+		settings.cascades[0].resolution = size;
+		settings.threadCount = threads;
+		settings.planningMode = options.measure ? FFT_PLAN_MEASURE : FFT_PLAN_ESTIMATE;
+		settings.pruneThreshold = options.pruneThreshold;
+
+		OceanSimulationT<float> simulation;
+		simulation.Reset(settings);
+
+		const OceanCascadeT<float>& cascade = simulation.GetCascade(0);
+		std::vector<OceanTexel> displacement(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 4);
+		std::vector<OceanTexel> slope(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 2);
+
+		OceanQuerySurface surface;
+		surface.cascadeCount = 1;
+		OceanQueryCascade& query_cascade = surface.cascades[0];
+		query_cascade.displacement[0] = query_cascade.displacement[1] = &displacement[0];
+		query_cascade.slope[0] = query_cascade.slope[1] = &slope[0];
+		query_cascade.blend = 1.0f;
+		query_cascade.M = cascade.GetM();
+		query_cascade.N = cascade.GetN();
+		query_cascade.texelsPerUnitX = cascade.GetM() / cascade.GetPatchSize();
+		query_cascade.texelsPerUnitZ = cascade.GetN() / cascade.GetPatchSize();
+
+		// Boxes half as wide as the grid spacing, floating about half under water.
+		u32 body_count = (options.probes + k_ProbesPerBody - 1) / k_ProbesPerBody;
+		u32 bodies_per_row = static_cast<u32>(ceil(sqrt(static_cast<double>(body_count))));
+		Real spacing = cascade.GetPatchSize() / bodies_per_row;
+		Real half_width = 0.25f * spacing;
+
+		glm::vec3 probes[k_ProbesPerBody];
+		for(u32 p = 0; p < k_ProbesPerBody; ++p)
+			probes[p] = glm::vec3((p & 1) ? half_width : -half_width, (p & 2) ? half_width : -half_width, (p & 4) ? half_width : -half_width);
+
+		BuoyancyBodyDesc desc;
+		desc.probeCount = k_ProbesPerBody;
+		desc.probes = probes;
+		desc.probeVolume = half_width * half_width * half_width;
+		desc.probeHeight = half_width;
+		desc.mass = 0.5f * k_ProbesPerBody * desc.probeVolume;
+		desc.inertia = desc.mass * half_width * half_width;
+		desc.linearDrag = desc.mass;
+		desc.angularDrag = desc.inertia;
+
+		BuoyancySystem buoyancy;
+		for(u32 b = 0; b < body_count; ++b)
+		{
+			desc.position = glm::vec3(((b % bodies_per_row) + 0.5f) * spacing, 0.0f, ((b / bodies_per_row) + 0.5f) * spacing);
+			buoyancy.AddBody(desc);
+		}
+
+		// The query samples the same positions every step, where the bodies start.
+		u32 probe_count = buoyancy.GetProbeCount();
+		std::vector<Real> x(probe_count), z(probe_count), height(probe_count);
+		for(u32 p = 0; p < probe_count; ++p)
+		{
+			u32 b = p / k_ProbesPerBody;
+			x[p] = ((b % bodies_per_row) + 0.5f) * spacing + probes[p % k_ProbesPerBody].x;
+			z[p] = ((b / bodies_per_row) + 0.5f) * spacing + probes[p % k_ProbesPerBody].z;
+		}
+
+		OceanQueryResults results;
+		results.height = &height[0];
+
+		WorkerPool& pool = simulation.GetWorkerPool();
+		double query_seconds = 0.0;
+		double step_seconds = 0.0;
+		u32 steps = 0;
+
+		// Bounded by the time spent simulating as well, which dwarfs the steps on large grids.
+		Clock::time_point start = Clock::now();
+		for(u32 frame = 0; steps < k_MinFrames || std::chrono::duration<double>(Clock::now() - start).count() < options.seconds; ++frame)
+		{
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+			cascade.PackTexels(&displacement[0], &slope[0]);
+
+			Clock::time_point query_start = Clock::now();
+			QueryOceanSurface(surface, probe_count, &x[0], &z[0], results, buoyancy.GetSettings().query, &pool);
+			Clock::time_point step_start = Clock::now();
+			buoyancy.Step(surface, k_FrameStep, &pool);
+			Clock::time_point step_end = Clock::now();
+
+			// The first steps settle the bodies on the surface.
+			if(frame >= k_WarmUpFrames)
+			{
+				query_seconds += std::chrono::duration<double>(step_start - query_start).count();
+				step_seconds += std::chrono::duration<double>(step_end - step_start).count();
+				++steps;
+			}
+		}
+
+		BuoyancyResult result;
+		result.query = 1000.0 * query_seconds / steps;
+		result.step = 1000.0 * step_seconds / steps;
+		result.probesPerSecond = static_cast<double>(probe_count) * steps / step_seconds;
+		return result;
+	}
+
+	// Times Build once and SetTime + Evaluate at each point count until half the time of a measurement is spent on it.
+	SparseResult MeasureSparseWaves(const OceanCascadeT<float>& cascade, Real t, u32 waves, double simulate, const std::vector<float>& displacement, WorkerPool& pool, const BenchmarkOptions& options)
+	{
+		const u32 M = cascade.GetM();
+		const u32 N = cascade.GetN();
+
+		SparseResult result;
+		SparseSpectrum sparse;
+		Clock::time_point build_start = Clock::now();
+		sparse.Build(cascade, waves, k_HeightScale);
+		result.build = 1000.0 * std::chrono::duration<double>(Clock::now() - build_start).count();
+		result.waves = sparse.GetComponentCount();
+
+		// Points spread over the patch, off the texel centres.
+		std::vector<Real> x(k_SparsePointCounts[1]), z(k_SparsePointCounts[1]), height(k_SparsePointCounts[1]);
+		for(u32 p = 0; p < k_SparsePointCounts[1]; ++p)
+		{
+			x[p] = cascade.GetPatchSize() * (p % 64 + 0.37f) / 64.0f;
+			z[p] = cascade.GetPatchSize() * (p / 64 + 0.61f) / 64.0f;
+		}
+
+		for(u32 c = 0; c < 2; ++c)
+		{
+			u32 runs = 0;
+			double seconds = 0.0;
+			do
+			{
+				Clock::time_point start = Clock::now();
+				sparse.SetTime(t);
+				sparse.Evaluate(k_SparsePointCounts[c], &x[0], &z[0], &height[0], NULL, NULL, &pool);
+				seconds += std::chrono::duration<double>(Clock::now() - start).count();
+				++runs;
+			} while(runs < k_MinFrames || seconds < 0.25 * options.seconds);
+			result.evaluate[c] = 1000.0 * seconds / runs;
+		}
+
+		// Linear in the points, what is left of the simulation after the fixed cost buys that many more.
+		double per_point = (result.evaluate[1] - result.evaluate[0]) / (k_SparsePointCounts[1] - k_SparsePointCounts[0]);
+		double fixed = result.evaluate[0] - per_point * k_SparsePointCounts[0];
+		result.crossover = (per_point > 0.0) ? std::max(0.0, (simulate - fixed) / per_point) : 0.0;
+		result.modelCrossover = sparse.GetBreakEvenPointCount(M, N, cascade.GetFFTFieldCount());
+		result.simulate = simulate;
+
+		// Texel (x, y) is at (x, y) patch size / M from texel (0, 0). A spread of them, every one on small grids.
+		const u32 texel_count = M * N;
+		const u32 stride = (texel_count > k_SparseCheckTexels) ? (texel_count / k_SparseCheckTexels) | 1 : 1;
+		std::vector<Real> texel_x, texel_z;
+		std::vector<u32> texels;
+		for(u32 texel = 0; texel < texel_count; texel += stride)
+		{
+			texels.push_back(texel);
+			texel_x.push_back(cascade.GetPatchSize() * (texel % M) / M);
+			texel_z.push_back(cascade.GetPatchSize() * (texel / M) / N);
+		}
+
+		u32 count = static_cast<u32>(texels.size());
+		std::vector<Real> sparse_y(count, 0.0f), sparse_x(count, 0.0f), sparse_z(count, 0.0f);
+		sparse.SetTime(t);
+		sparse.Evaluate(count, &texel_x[0], &texel_z[0], &sparse_y[0], &sparse_x[0], &sparse_z[0], &pool);
+
+		result.heightError = result.horizontalError = 0.0;
+		for(u32 p = 0; p < count; ++p)
+		{
+			const float* texel = &displacement[4 * texels[p]];
+			result.heightError = std::max(result.heightError, static_cast<double>(fabs(sparse_y[p] - texel[1])));
+			result.horizontalError = std::max(result.horizontalError, static_cast<double>(fabs(sparse_x[p] - texel[0])));
+			result.horizontalError = std::max(result.horizontalError, static_cast<double>(fabs(sparse_z[p] - texel[2])));
+		}
+
+		const SparseSpectrum::ErrorBounds& bounds = sparse.GetErrorBounds();
+		result.heightBound = bounds.maxHeightError + bounds.roundingHeightError;
+		result.horizontalBound = bounds.maxHorizontalError + bounds.roundingHorizontalError;
+		result.pass = result.heightError <= result.heightBound && result.horizontalError <= result.horizontalBound;
+		return result;
+	}
+
+	// One row per number of waves kept, on an unpruned float cascade simulated like in Measure.
+	std::vector<SparseResult> MeasureSparse(u32 size, u32 threads, const BenchmarkOptions& options)
+	{
+		OceanSettings settings;
+		settings.cascadeCount = 1;
+		settings.cascades[0].resolution = size;
+		settings.threadCount = threads;
+		settings.planningMode = options.measure ? FFT_PLAN_MEASURE : FFT_PLAN_ESTIMATE;
+		settings.pruneThreshold = 0.0f;
+
+		OceanSimulationT<float> simulation;
+		simulation.Reset(settings);
+
+		const OceanCascadeT<float>& cascade = simulation.GetCascade(0);
+		std::vector<float> displacement(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 4);
+		std::vector<float> slope(static_cast<size_t>(cascade.GetM()) * cascade.GetN() * 2);
+
+		u32 frame = 0;
+		for(; frame < k_WarmUpFrames; ++frame)
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+
+		u32 frames = 0;
+		double seconds = 0.0;
+		do
+		{
+			Clock::time_point start = Clock::now();
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+			cascade.PackTexels(&displacement[0], &slope[0]);
+			seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+			++frame;
+			++frames;
+		} while(seconds < 0.5 * options.seconds || frames < k_MinFrames);
+		double simulate = 1000.0 * seconds / frames;
+		Real t = (frame - 1) * k_FrameStep;
+
+		std::vector<u32> waves = options.waves;
+		if(cascade.GetM() <= k_MaxAllWavesSize)
+			waves.push_back(k_AllWaves);
+
+		std::vector<SparseResult> results;
+		for(size_t w = 0; w < waves.size(); ++w)
+			results.push_back(MeasureSparseWaves(cascade, t, waves[w], simulate, displacement, simulation.GetWorkerPool(), options));
+		return results;
+	}
+
+	// Counts the tiles of every level of the bounds pyramid that differ from the bounds of their texels, found by brute
+	// force. A tile of size s at (r, c) covers texels (r s, c s) to ((r + 1) s, (c + 1) s) included, wrapping around.
+	template <typename T>
+	u32 CheckBounds(u32 size, u32 threads, u32& tile_count)
+	{
+		OceanSettings settings;
+		settings.cascadeCount = 1;
+		settings.cascades[0].resolution = size;
+		settings.threadCount = threads;
+		settings.planningMode = FFT_PLAN_ESTIMATE;
+
+		OceanSimulationT<T> simulation;
+		simulation.Reset(settings);
+		for(u32 frame = 0; frame < k_WarmUpFrames; ++frame)
+			simulation.SimulateAll(frame * k_FrameStep, k_HeightScale);
+
+		const OceanCascadeT<T>& cascade = simulation.GetCascade(0);
+		const u32 M = cascade.GetM();
+		const u32 N = cascade.GetN();
+
+		u32 mismatches = 0;
+		tile_count = 0;
+		for(u32 l = 0; l < cascade.GetBoundsLevelCount(); ++l)
+		{
+			const u32 tile_size = cascade.GetBoundsTileSize(l);
+			for(u32 r = 0; r < cascade.GetBoundsRows(l); ++r)
+			{
+				for(u32 c = 0; c < cascade.GetBoundsCols(l); ++c)
+				{
+					DisplacementBoundsT<T> expected;
+					expected.minX = expected.minY = expected.minZ = std::numeric_limits<T>::max();
+					expected.maxX = expected.maxY = expected.maxZ = -std::numeric_limits<T>::max();
+
+					for(u32 i = r * tile_size; i <= std::min((r + 1) * tile_size, M); ++i)
+					{
+						for(u32 j = c * tile_size; j <= std::min((c + 1) * tile_size, N); ++j)
+						{
+							int row = static_cast<int>(i % M);
+							int column = static_cast<int>(j % N);
+							T x = k_HorizontalDisplacementScale * cascade.GetDisplacementX()(row, column);
+							T y = cascade.GetDisplacementY()(row, column);
+							T z = k_HorizontalDisplacementScale * cascade.GetDisplacementZ()(row, column);
+							expected.minX = std::min(expected.minX, x); expected.maxX = std::max(expected.maxX, x);
+							expected.minY = std::min(expected.minY, y); expected.maxY = std::max(expected.maxY, y);
+							expected.minZ = std::min(expected.minZ, z); expected.maxZ = std::max(expected.maxZ, z);
+						}
+					}
+
+					// Min and max don't round, the pyramid is exact.
+					const DisplacementBoundsT<T>& tile = cascade.GetDisplacementBounds(l, r, c);
+					if(tile.minX != expected.minX || tile.maxX != expected.maxX || tile.minY != expected.minY || tile.maxY != expected.maxY
+						|| tile.minZ != expected.minZ || tile.maxZ != expected.maxZ)
+					{
+						++mismatches;
+					}
+					++tile_count;
+				}
+			}
+		}
+
+		return mismatches;
+	}
+
+	// Bounds pyramid check, a table of its own. False when any tile is off.
+	bool PrintBoundsCheck(const BenchmarkOptions& options)
+	{
+		if(options.csv)
+			printf("\ncompute,size,threads,tiles,mismatches,check\n");
+		else
+			printf("\n%-7s %-6s %-7s | %9s %10s | %5s\n", "compute", "size", "threads", "tiles", "mismatches", "check");
+
+		bool passed = true;
+		for(u32 compute = 0; compute < COMPUTE_COUNT; ++compute)
+		{
+			if(!options.compute[compute])
+				continue;
+
+			for(u32 s = 0; s < sizeof(k_BoundsCheckSizes) / sizeof(u32); ++s)
+			{
+				for(u32 t = 0; t < sizeof(k_BoundsCheckThreads) / sizeof(u32); ++t)
+				{
+					u32 size = k_BoundsCheckSizes[s];
+					u32 threads = k_BoundsCheckThreads[t];
+					u32 tiles = 0;
+					u32 mismatches = (compute == COMPUTE_DOUBLE) ? CheckBounds<double>(size, threads, tiles) : CheckBounds<float>(size, threads, tiles);
+					passed = passed && mismatches == 0;
+
+					if(options.csv)
+						printf("%s,%u,%u,%u,%u,%s\n", k_ComputeNames[compute], size, threads, tiles, mismatches, (mismatches == 0) ? "pass" : "FAIL");
+					else
+						printf("%-7s %-6u %-7u | %9u %10u | %5s\n", k_ComputeNames[compute], size, threads, tiles, mismatches, (mismatches == 0) ? "pass" : "FAIL");
+				}
+			}
+		}
+
+		return passed;
+	}
+
+	// Buoyancy, a table of its own.
+	void PrintBuoyancy(const BenchmarkOptions& options)
+	{
+		if(options.csv)
+		{
+			printf("\nsize,threads,probes,query_ms,step_ms,probes_per_s\n");
+		}
+		else
+		{
+			printf("\n%-6s %-7s %-8s | %9s %9s %12s\n", "size", "threads", "probes", "query", "step", "Mprobes/s");
+			printf("%-6s %-7s %-8s | %9s %9s %12s\n", "", "", "", "ms", "ms", "");
+		}
+
+		for(size_t s = 0; s < options.sizes.size(); ++s)
+		{
+			for(size_t t = 0; t < options.threads.size(); ++t)
+			{
+				u32 size = options.sizes[s];
+				u32 threads = options.threads[t];
+				u32 probes = (options.probes + k_ProbesPerBody - 1) / k_ProbesPerBody * k_ProbesPerBody;
+				BuoyancyResult result = MeasureBuoyancy(size, threads, options);
+
+				if(options.csv)
+					printf("%u,%u,%u,%.4f,%.4f,%.0f\n", size, threads, probes, result.query, result.step, result.probesPerSecond);
+				else
+					printf("%-6u %-7u %-8u | %9.3f %9.3f %12.2f\n", size, threads, probes, result.query, result.step, result.probesPerSecond * 1e-6);
+				fflush(stdout);
+			}
+		}
+	}
+
+	// Sparse spectrum, a table of its own. False when any row is off by more than its bounds.
+	bool PrintSparse(const BenchmarkOptions& options)
+	{
+		if(options.csv)
+		{
+			printf("\nsize,threads,waves,build_ms,simulate_ms,evaluate_%u_ms,evaluate_%u_ms,crossover_points,model_crossover_points,height_error,height_bound,horizontal_error,horizontal_bound,check\n",
+				k_SparsePointCounts[0], k_SparsePointCounts[1]);
+		}
+		else
+		{
+			printf("\n%-6s %-7s %-8s | %9s %9s %9s %9s | %10s %10s | %9s %9s %9s %9s | %5s\n", "size", "threads", "waves", "build", "simulate", "evaluate", "evaluate",
+				"crossover", "model", "height", "bound", "chop", "bound", "check");
+			printf("%-6s %-7s %-8s | %9s %9s %6u pt %6u pt | %10s %10s | %9s %9s %9s %9s | %5s\n", "", "", "", "ms/reset", "ms", k_SparsePointCounts[0], k_SparsePointCounts[1],
+				"points", "points", "error", "", "error", "", "");
+		}
+
+		bool passed = true;
+		for(size_t s = 0; s < options.sizes.size(); ++s)
+		{
+			for(size_t t = 0; t < options.threads.size(); ++t)
+			{
+				u32 size = options.sizes[s];
+				u32 threads = options.threads[t];
+				std::vector<SparseResult> results = MeasureSparse(size, threads, options);
+				for(size_t r = 0; r < results.size(); ++r)
+				{
+					const SparseResult& result = results[r];
+					passed = passed && result.pass;
+
+					if(options.csv)
+					{
+						printf("%u,%u,%u,%.4f,%.4f,%.4f,%.4f,%.0f,%u,%.3g,%.3g,%.3g,%.3g,%s\n", size, threads, result.waves, result.build, result.simulate, result.evaluate[0], result.evaluate[1],
+							result.crossover, result.modelCrossover, result.heightError, result.heightBound, result.horizontalError, result.horizontalBound, result.pass ? "pass" : "FAIL");
+					}
+					else
+					{
+						printf("%-6u %-7u %-8u | %9.2f %9.3f %9.3f %9.3f | %10.0f %10u | %9.2e %9.2e %9.2e %9.2e | %5s\n", size, threads, result.waves, result.build, result.simulate, result.evaluate[0], result.evaluate[1],
+							result.crossover, result.modelCrossover, result.heightError, result.heightBound, result.horizontalError, result.horizontalBound, result.pass ? "pass" : "FAIL");
+					}
+				}
+				fflush(stdout);
+			}
+		}
+
+		return passed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		printf("Usage: SimulationBenchmark [--sizes 64,128,...] [--threads 1,2,...] [--compute float,double] [--texels float,half] [--seconds s] [--prune p] [--probes n] [--waves 64,...] [--measure] [--csv]\n");
+		return 1;
+	}
+
+	if(options.csv)
+	{
+		printf("compute,texels,size,threads,spectrum_ms,planning_ms,evolution_ms,fft_ms,normals_ms,foam_ms,bounds_ms,pack_ms,frame_ms,bins_per_s,active_bins,pruned_energy,memory_mb\n");
+	}
+	else
+	{
+		printf("SIMD level: %s, %u hardware threads, %s plans\n\n", GetSIMDLevelName(DetectSIMDLevel()), WorkerPool::GetHardwareThreadCount(), options.measure ? "measured" : "estimated");
+		printf("%-7s %-6s %-6s %-7s | %10s %10s | %9s %9s %9s %9s %9s %9s %9s %12s | %7s %10s %9s\n", "compute", "texels", "size", "threads", "spectrum", "planning", "evolve", "fft", "normals", "foam", "bounds", "pack", "frame", "Mbins/s", "active", "pruned", "memory");
+		printf("%-7s %-6s %-6s %-7s | %10s %10s | %9s %9s %9s %9s %9s %9s %9s %12s | %7s %10s %9s\n", "", "", "", "", "ms/reset", "ms/reset", "ms", "ms", "ms", "ms", "ms", "ms", "ms", "", "%bins", "energy", "MB");
+	}
+
+	for(u32 compute = 0; compute < COMPUTE_COUNT; ++compute)
+	{
+		for(u32 texels = 0; texels < TEXELS_COUNT; ++texels)
+		{
+			if(!options.compute[compute] || !options.texels[texels])
+				continue;
+
+			const char* compute_name = k_ComputeNames[compute];
+			const char* texel_name = k_TexelNames[texels];
+			for(size_t s = 0; s < options.sizes.size(); ++s)
+			{
+				for(size_t t = 0; t < options.threads.size(); ++t)
+				{
+					u32 size = options.sizes[s];
+					u32 threads = options.threads[t];
+					Result result = Measure(static_cast<ComputePrecision>(compute), static_cast<TexelStorage>(texels), size, threads, options);
+
+					if(options.csv)
+					{
+						printf("%s,%s,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.0f,%.4f,%.3g,%.2f\n", compute_name, texel_name, size, threads, result.spectrum, result.planning,
+							result.evolution, result.fft, result.normals, result.foam, result.bounds, result.pack, result.total, result.binsPerSecond, result.activeBins, result.prunedEnergy, result.megabytes);
+					}
+					else
+					{
+						printf("%-7s %-6s %-6u %-7u | %10.2f %10.2f | %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %12.2f | %7.1f %10.2g %9.2f\n", compute_name, texel_name, size, threads, result.spectrum, result.planning,
+							result.evolution, result.fft, result.normals, result.foam, result.bounds, result.pack, result.total, result.binsPerSecond * 1e-6, 100.0 * result.activeBins, result.prunedEnergy, result.megabytes);
+					}
+					fflush(stdout);
+				}
+			}
+		}
+	}
+
+	if(options.probes > 0)
+		PrintBuoyancy(options);
+
+	bool passed = true;
+	if(!options.waves.empty())
+		passed = PrintSparse(options) && passed;
+	passed = PrintBoundsCheck(options) && passed;
+
+	return passed ? 0 : 1;
+}
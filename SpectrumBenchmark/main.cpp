@@ -0,0 +1,244 @@
+// Microbenchmark of the ocean spectrum kernels.
+// Runs every kernel at every SIMD level this CPU supports, checks it against a reference and reports
+// the throughput in bins per nanosecond. The phase kernels are checked against the per-bin std::complex
+// update they replace, the input kernels against the scalar kernels.
+
+#include "SpectrumKernels.h"
+#include "SpectrumPlanes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace acqua;
+
+namespace
+{
+	enum Kernel
+	{
+		KERNEL_ROTATE,
+		KERNEL_RENORMALIZE,
+		KERNEL_BUILD_ROTATIONS,
+		KERNEL_DISPLACEMENT_INPUTS,	// spectrumInputs with the height and chop fields only.
+		KERNEL_ALL_INPUTS,			// spectrumInputs with the slopes and the Jacobian as well.
+		KERNEL_COUNT
+	};
+
+	const char* k_KernelNames[KERNEL_COUNT] = { "rotate", "renormalize", "buildRotations", "displacementInputs", "allInputs" };
+
+	// Inputs and outputs of the kernels for a M x (N/2+1) half spectrum.
+	struct Spectrum
+	{
+		u32 M;
+		u32 N;
+
+		SpectrumPlanes h0;			// Complex, fields 0 (h0) and 1 (h0Minus).
+		SpectrumPlanes phase;		// Complex, fields 0 (phase) and 1 (step).
+		SpectrumPlanes waves;		// Real, planes 0 (omega), 1 (1/|k|) and 2 (kz).
+		SpectrumPlanes out;			// Complex, fields 0 (y), 1 (x), 2 (z), 3 and 4 (slopes), 5 to 7 (Jacobian).
+
+		void Init(u32 m, u32 n)
+		{
+			M = m;
+			N = n;
+			u32 cols = N / 2 + 1;
+
+			h0.ResizeComplex(M, cols, 2);
+			phase.ResizeComplex(M, cols, 2);
+			waves.Resize(M, cols, 3);
+			out.ResizeComplex(M, cols, 8);
+			out.Zero();
+
+			srand(1234);
+			for(u32 i = 0; i < M; ++i)
+			{
+				float kx = 2.0f * 3.14159265f * (i <= M / 2 ? static_cast<float>(i) : -static_cast<float>(M - i)) / M;
+				for(u32 j = 0; j < cols; ++j)
+				{
+					float kz = 2.0f * 3.14159265f * j / N;
+					float k = sqrt(kx * kx + kz * kz);
+
+					waves.Row(0, i)[j] = sqrt(9.81f * k);
+					waves.Row(1, i)[j] = (k == 0.0f) ? 0.0f : 1.0f / k;
+					waves.Row(2, i)[j] = kz;
+
+					for(u32 p = 0; p < 4; ++p)
+						h0.Row(p, i)[j] = rand() / static_cast<float>(RAND_MAX) - 0.5f;
+
+					// Off the unit circle by up to a part in a thousand, like phases that have drifted.
+					float angle = rand() / static_cast<float>(RAND_MAX) * 6.2831853f;
+					float magnitude = 1.0f + 0.002f * (rand() / static_cast<float>(RAND_MAX) - 0.5f);
+					phase.Re(0, i)[j] = magnitude * cos(angle);
+					phase.Im(0, i)[j] = magnitude * sin(angle);
+					phase.Re(1, i)[j] = cos(0.01f);
+					phase.Im(1, i)[j] = sin(0.01f);
+				}
+			}
+		}
+
+		void Run(const SpectrumKernels& kernels, Kernel kernel)
+		{
+			u32 cols = N / 2 + 1;
+			for(u32 i = 0; i < M; ++i)
+			{
+				switch(kernel)
+				{
+				case KERNEL_ROTATE:
+					kernels.rotate(cols, phase.Re(0, i), phase.Im(0, i), phase.Re(1, i), phase.Im(1, i));
+					break;
+
+				case KERNEL_RENORMALIZE:
+					kernels.renormalize(cols, phase.Re(0, i), phase.Im(0, i));
+					break;
+
+				case KERNEL_BUILD_ROTATIONS:
+					kernels.buildRotations(cols, waves.Row(0, i), 1.0f / 60.0f, 0, out.Re(0, i), out.Im(0, i));
+					break;
+
+				case KERNEL_DISPLACEMENT_INPUTS:
+				case KERNEL_ALL_INPUTS:
+					{
+						bool all = (kernel == KERNEL_ALL_INPUTS);
+
+						SpectrumInputRow row;
+						row.count = cols;
+						row.h0Re = h0.Re(0, i); row.h0Im = h0.Im(0, i);
+						row.h0MinusRe = h0.Re(1, i); row.h0MinusIm = h0.Im(1, i);
+						row.phaseRe = phase.Re(0, i); row.phaseIm = phase.Im(0, i);
+						row.kInverse = waves.Row(1, i);
+						row.kz = waves.Row(2, i);
+						row.kx = 0.1f * i;
+						row.scale = 0.02f;
+						row.chop = 0.5f;
+						row.slopeScaleX = 0.02f;
+						row.slopeScaleZ = 0.03f;
+						row.jacobianScaleXX = 0.02f;
+						row.jacobianScaleZZ = 0.03f;
+						row.jacobianScaleXZ = 0.025f;
+						row.yRe = out.Re(0, i); row.yIm = out.Im(0, i);
+						row.xRe = out.Re(1, i); row.xIm = out.Im(1, i);
+						row.zRe = out.Re(2, i); row.zIm = out.Im(2, i);
+						row.slopeXRe = all ? out.Re(3, i) : NULL; row.slopeXIm = all ? out.Im(3, i) : NULL;
+						row.slopeZRe = all ? out.Re(4, i) : NULL; row.slopeZIm = all ? out.Im(4, i) : NULL;
+						row.xxRe = all ? out.Re(5, i) : NULL; row.xxIm = all ? out.Im(5, i) : NULL;
+						row.zzRe = all ? out.Re(6, i) : NULL; row.zzIm = all ? out.Im(6, i) : NULL;
+						row.xzRe = all ? out.Re(7, i) : NULL; row.xzIm = all ? out.Im(7, i) : NULL;
+						kernels.spectrumInputs(row);
+					}
+					break;
+
+				default:
+					break;
+				}
+			}
+		}
+
+		// The phase kernels as a complex multiply per bin, the way the blitz arrays were updated.
+		void RunReference(Kernel kernel)
+		{
+			u32 cols = N / 2 + 1;
+			for(u32 i = 0; i < M; ++i)
+			{
+				for(u32 j = 0; j < cols; ++j)
+				{
+					std::complex<float> p(phase.Re(0, i)[j], phase.Im(0, i)[j]);
+					if(kernel == KERNEL_ROTATE)
+						p *= std::complex<float>(phase.Re(1, i)[j], phase.Im(1, i)[j]);
+					else
+						p *= 0.5f * (3.0f - std::norm(p));
+					phase.Re(0, i)[j] = p.real();
+					phase.Im(0, i)[j] = p.imag();
+				}
+			}
+		}
+
+		// Largest difference between the outputs of two runs, relative to the largest reference value.
+		float Compare(const Spectrum& reference) const
+		{
+			float max_difference = 0.0f;
+			float max_value = 1e-30f;
+			u32 cols = N / 2 + 1;
+
+			for(u32 p = 0; p < out.GetPlaneCount(); ++p)
+			{
+				for(u32 i = 0; i < M; ++i)
+				{
+					for(u32 j = 0; j < cols; ++j)
+					{
+						max_difference = std::max(max_difference, static_cast<float>(fabs(out.Row(p, i)[j] - reference.out.Row(p, i)[j])));
+						max_value = std::max(max_value, static_cast<float>(fabs(reference.out.Row(p, i)[j])));
+					}
+				}
+			}
+
+			// Rotate and renormalize work in place on the phases.
+			for(u32 p = 0; p < 2; ++p)
+			{
+				for(u32 i = 0; i < M; ++i)
+				{
+					for(u32 j = 0; j < cols; ++j)
+					{
+						max_difference = std::max(max_difference, static_cast<float>(fabs(phase.Row(p, i)[j] - reference.phase.Row(p, i)[j])));
+					}
+				}
+			}
+
+			return max_difference / std::max(max_value, 1.0f);
+		}
+	};
+}
+
+int main()
+{
+	const u32 sizes[] = { 128, 256, 512, 1024, 2048 };
+	const u32 num_sizes = sizeof(sizes) / sizeof(u32);
+	const double min_seconds = 0.2; // Per measurement.
+
+	SIMDLevel best_level = DetectSIMDLevel();
+	printf("Best SIMD level: %s\n\n", GetSIMDLevelName(best_level));
+	printf("%-20s %-8s %-8s %12s %12s %12s\n", "kernel", "size", "level", "ms/spectrum", "bins/ns", "max rel err");
+
+	for(u32 s = 0; s < num_sizes; ++s)
+	{
+		u32 size = sizes[s];
+		for(u32 kernel = 0; kernel < KERNEL_COUNT; ++kernel)
+		{
+			// One verification run per level against the reference, starting from the same inputs.
+			Spectrum reference;
+			reference.Init(size, size);
+			if(kernel == KERNEL_ROTATE || kernel == KERNEL_RENORMALIZE)
+				reference.RunReference(static_cast<Kernel>(kernel));
+			else
+				reference.Run(SpectrumKernels::Get(SIMD_SCALAR), static_cast<Kernel>(kernel));
+
+			for(u32 level = SIMD_SCALAR; level <= static_cast<u32>(best_level); ++level)
+			{
+				const SpectrumKernels& kernels = SpectrumKernels::Get(static_cast<SIMDLevel>(level));
+
+				Spectrum spectrum;
+				spectrum.Init(size, size);
+				spectrum.Run(kernels, static_cast<Kernel>(kernel));
+				float error = spectrum.Compare(reference);
+
+				// Time it.
+				u32 runs = 0;
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				double seconds = 0.0;
+				do
+				{
+					spectrum.Run(kernels, static_cast<Kernel>(kernel));
+					++runs;
+					seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				} while(seconds < min_seconds);
+
+				double bins = static_cast<double>(size) * (size / 2 + 1) * runs;
+				printf("%-20s %-8u %-8s %12.4f %12.3f %12.2e\n", k_KernelNames[kernel], size, GetSIMDLevelName(kernels.level), 1000.0 * seconds / runs, bins / (seconds * 1e9), error);
+			}
+		}
+	}
+
+	return 0;
+}